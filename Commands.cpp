@@ -1,4 +1,9 @@
 #include "Commands.h"
+#include "stats.h"
+#include "signals.h"
+#include "io.h"
+#include "glob_expand.h"
+#include "textscan.h"
 #include <iostream>
 #include <vector>
 #include <sstream>
@@ -8,6 +13,11 @@
 #include <climits>
 #include <cstdlib>
 #include <cassert>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
 
 using namespace std;
 
@@ -41,16 +51,42 @@ string _trim(const std::string& s)
   return _rtrim(_ltrim(s));
 }
 
-int _parseCommandLine(const char* cmd_line, char** args) {
+// the rest of line after its first n words
+static string _skipWords(const string& line, int n) {
+    size_t pos = line.find_first_not_of(WHITESPACE);
+    for (int i = 0; i < n && pos != string::npos; i++) {
+        pos = line.find_first_of(WHITESPACE, pos);
+        pos = (pos == string::npos ? pos : line.find_first_not_of(WHITESPACE, pos));
+    }
+    return (pos == string::npos ? "" : _trim(line.substr(pos)));
+}
+
+int _parseCommandLine(const char* cmd_line, std::vector<char*>& args) {
   FUNC_ENTRY()
   int i = 0;
   std::istringstream iss(_trim(string(cmd_line)).c_str());
   for(std::string s; iss >> s; ) {
-    args[i] = (char*)malloc(s.length()+1);
-    memset(args[i], 0, s.length()+1);
-    strcpy(args[i], s.c_str());
-    args[++i] = nullptr;
+    if (_hasLiteralText(s)) {
+      s = _decodeLiteral(s);
+    }
+    if (s.empty()) {
+      continue; // held only variables smash does not know, they expand to nothing
+    }
+    if (i > 0 && _hasGlobChars(s.c_str())) {
+      // matches go straight into argv, a word that matches nothing stays as is (like bash)
+      vector<string> matches;
+      if (_globExpand(s, matches)) {
+        for (const string& match : matches) {
+          args.push_back(strdup(match.c_str()));
+          i++;
+        }
+        continue;
+      }
+    }
+    args.push_back(strdup(s.c_str()));
+    i++;
   }
+  args.push_back(nullptr);
   return i;
 
   FUNC_EXIT()
@@ -61,10 +97,9 @@ bool _isBackgroundComamnd(const char* cmd_line) {
   return str[str.find_last_not_of(WHITESPACE)] == '&';
 }
 
-void _removeBackgroundSign(char* cmd_line) {
-  const string str(cmd_line);
+void _removeBackgroundSign(string& cmd_line) {
   // find last character other than spaces
-  unsigned int idx = str.find_last_not_of(WHITESPACE);
+  size_t idx = cmd_line.find_last_not_of(WHITESPACE);
   // if all characters are spaces then return
   if (idx == string::npos) {
     return;
@@ -76,15 +111,182 @@ void _removeBackgroundSign(char* cmd_line) {
   // replace the & (background sign) with space and then remove all tailing spaces.
   cmd_line[idx] = ' ';
   // truncate the command line string up to the last non-space character
-  cmd_line[str.find_last_not_of(WHITESPACE, idx) + 1] = 0;
+  cmd_line.erase(cmd_line.find_last_not_of(WHITESPACE) + 1);
 }
 
-double calcDiffTimeParam( time_t timestamp ) {
+// "cmd &!" is a background job whose output is captured: drops the '!' and leaves the '&' to is_BG
+bool _removeCaptureSign(string& cmd_line) {
+  size_t idx = cmd_line.find_last_not_of(WHITESPACE);
+  if (idx == string::npos || idx == 0 || cmd_line[idx] != '!' || cmd_line[idx - 1] != '&') {
+    return false;
+  }
+  cmd_line.erase(idx);
+  return true;
+}
+
+ssize_t _fullread ( int fd, char *buff, size_t nbytes ) {
+    ssize_t rbytes = 1;
+    ssize_t sum_rbytes = 0;
+
+    while ( rbytes != 0 )
+    {
+        rbytes = read(fd, buff, nbytes);
+        if ( -1 == rbytes ) {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        nbytes -= rbytes;
+        buff += rbytes;
+        sum_rbytes += rbytes;
+    }
+    return sum_rbytes;
+}
+
+ssize_t _fullwrite( int fd, const char *buff, size_t nbytes) {
+    ssize_t wbytes = 0;
+    ssize_t sum_wbytes = 0;
+
+    while ( nbytes > 0 )
+    {
+        wbytes = write(fd, buff, nbytes);
+        if ( -1 == wbytes ) {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        nbytes -= wbytes;
+        buff += wbytes;
+        sum_wbytes += wbytes;
+    }
+    return sum_wbytes;
+}
+
+/*
+ * Emits a fully formatted buffer through cout and flushes it, so listing built-ins cost one syscall
+ * per invocation instead of one per line. Going through cout keeps them capturable by $(...).
+ */
+void _writeOutput(const string& buff) {
+    cout.write(buff.data(), buff.size());
+    cout.flush();
+    if (!cout) {
+        cout.clear();
+        throw SmashSysFailure("write failed");
+    }
+}
+
+string _jsonEscape(const string& str) {
+    string escaped;
+    escaped.reserve(str.size());
+    for (char c : str) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            case '\r': escaped += "\\r"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char hex[8];
+                    snprintf(hex, sizeof(hex), "\\u%04x", (unsigned char)c);
+                    escaped += hex;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+time_t _currTime() {
     time_t curr_timestamp = time(nullptr);
     if (curr_timestamp == ((time_t) -1))
         throw SmashSysFailure("time failed");
+    return curr_timestamp;
+}
+
+double _timevalToSecs(const struct timeval& tv) {
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Reads the cpu time and peak resident set size of a live process from procfs.
+ */
+bool _readProcUsage(pid_t pid, double* cpu_secs, long* maxrss_kb) {
+    char path[64];
+    char buff[1024];
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    ssize_t rbytes = read(fd, buff, sizeof(buff) - 1);
+    close(fd);
+    if (rbytes <= 0)
+        return false;
+    buff[rbytes] = '\0';
+
+    // the comm field may contain spaces, so start parsing after its closing parenthesis (field 3 onwards)
+    char* fields = strrchr(buff, ')');
+    if (fields == nullptr)
+        return false;
+    unsigned long utime = 0, stime = 0;
+    if (sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+        return false;
+    *cpu_secs = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+
+    *maxrss_kb = 0;
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return true;
+    string status_buff(4096, '\0');
+    rbytes = _fullread(fd, &status_buff[0], status_buff.size() - 1);
+    close(fd);
+    if (rbytes <= 0)
+        return true;
+    status_buff.resize(rbytes);
+    size_t pos = status_buff.find("VmHWM:");
+    if (pos != string::npos)
+        *maxrss_kb = strtol(status_buff.c_str() + pos + strlen("VmHWM:"), nullptr, 10);
+    return true;
+}
+
+/*
+ * Terminates a forked child that did not exec. exit(3) would also flush/rewind the stdio input buffer,
+ * moving the offset of the script smash reads from (it is shared with the parent), so only our own
+ * output is flushed before leaving with _exit(2).
+ */
+[[noreturn]] void _exitChild(int status) {
+    cout.flush();
+    cerr.flush();
+    fflush(stdout);
+    _exit(status);
+}
+
+/*
+ * fork wrapper used by every command that spawns a process, so spawn latency is measured in one place.
+ */
+pid_t _fork() {
+    // cout is not synced with stdio, so pending output must not be duplicated into the child
+    cout.flush();
+    SmallShell& smash = SmallShell::getInstance();
+    JobCgroupPtr cgroup = smash.cgroups.forFork(smash.spawn_attrs.cgroupLimits());
+    uint64_t start_ns = _monotonicNs();
+    pid_t pid = fork();
+    if (pid > 0) {
+        SmashStats::getInstance().record(STAT_FORK, _monotonicNs() - start_ns);
+    }
+    // before anything else runs in the child, so nothing the job starts is left outside
+    if (pid == 0 && cgroup != nullptr && !cgroup->join()) {
+        perror("smash error: cgroup: join failed");
+        _exitChild(EXIT_FAILURE);
+    }
+    return pid;
+}
 
-    return ( difftime(curr_timestamp, timestamp) );
+double calcDiffTimeParam( time_t timestamp ) {
+    return ( difftime(_currTime(), timestamp) );
 }
 
 double calcDiffTimeRemaining( time_t timestamp ) {
@@ -93,14 +295,15 @@ double calcDiffTimeRemaining( time_t timestamp ) {
 
 ////////////////////Command Class start//////////////////////////////////////
 
-Command::Command(const char* cmd_line){
-  is_BG = _isBackgroundComamnd(cmd_line);
-  strcpy(this->cmd_line,cmd_line);
-  strcpy(this->raw_cmd_line, cmd_line);
+Command::Command(const char* cmd_line) : cmd_line(cmd_line), raw_cmd_line(cmd_line) {
+  if (_hasLiteralText(this->raw_cmd_line))
+    shown_line = _decodeLiteral(this->raw_cmd_line);
+  capture_output = _removeCaptureSign(this->cmd_line);
+  is_BG = _isBackgroundComamnd(this->cmd_line.c_str());
 
   if(is_BG)
     _removeBackgroundSign(this->cmd_line);
-  n_args = _parseCommandLine(this->cmd_line, args);
+  n_args = _parseCommandLine(this->cmd_line.c_str(), args);
 }
 
 Command::~Command(){
@@ -111,7 +314,7 @@ Command::~Command(){
 }
 
 ostream& operator<<(ostream& os, const Command& cm) {
-    os << cm.raw_cmd_line;
+    os << cm.getRawCmdLine();
     return os;
 }
 
@@ -143,11 +346,25 @@ pid_t ShowPidCommand::execute(){
     return DEFAULT_PROCESS_ID;
 }
 
+TrueCommand::TrueCommand(const char* cmd_line) : BuiltInCommand(cmd_line) {}
+
+pid_t TrueCommand::execute() {
+    SmallShell::getInstance().setLastExitStatus(0);
+    return DEFAULT_PROCESS_ID;
+}
+
+FalseCommand::FalseCommand(const char* cmd_line) : BuiltInCommand(cmd_line) {}
+
+pid_t FalseCommand::execute() {
+    SmallShell::getInstance().setLastExitStatus(1);
+    return DEFAULT_PROCESS_ID;
+}
+
 GetCurrDirCommand::GetCurrDirCommand(const char* cmd_line) : BuiltInCommand(cmd_line) {}
 
 pid_t GetCurrDirCommand::execute(){
     SmallShell& smash = SmallShell::getInstance();
-    cout << smash.getCurrDir() << endl;
+    cout << smash.getCurrDir() << '\n';
     return DEFAULT_PROCESS_ID;
 }
 
@@ -178,6 +395,7 @@ pid_t ChangeDirCommand::execute() {
         return true;
     }
 
+    smash.getCurrDir(); // resolve the lazily cached dir before leaving it, cd - needs it
     if (chdir(dest_dir.c_str()) == 0) {
         smash.setCurrDir();
     } else {
@@ -186,9 +404,18 @@ pid_t ChangeDirCommand::execute() {
     return DEFAULT_PROCESS_ID;
 }
 
-JobsCommand::JobsCommand(const char* cmd_line, JobsList* jobs_list) : BuiltInCommand(cmd_line), jobs_list(jobs_list) {}
+JobsCommand::JobsCommand(const char* cmd_line, JobsList* jobs_list) : BuiltInCommand(cmd_line), jobs_list(jobs_list) {
+    for (int i = 1; i < n_args; i++) {
+        if (args[i] == string("-j")) {
+            this->as_json = true;
+        } else if (args[i] == string("-l")) {
+            this->long_format = true;
+        }
+    }
+}
+
 pid_t JobsCommand::execute() {
-    this->jobs_list->printJobsList();
+    this->jobs_list->printJobsList(this->as_json, this->long_format);
     return DEFAULT_PROCESS_ID;
 }
 
@@ -204,6 +431,23 @@ bool _isnumber(char* str) {
     return true;
 }
 
+// "64K", "1M", "2G" or plain bytes
+bool _parseSize(const char* str, size_t* size) {
+    char* end = nullptr;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str || *str == '-') {
+        return false;
+    }
+    switch (*end) {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+    *size = value;
+    return *end == '\0';
+}
+
 bool _getnumber (char* str, int* num) {
     int sign = 1;
     if (*str == '-') {
@@ -257,15 +501,23 @@ pid_t ForegroundCommand::execute() {
         }
     }
 
-    cout << *(job_entry->cmd) << " : " << job_entry->pid << endl;
-    if ( kill(job_entry->pid, SIGCONT) == -1 ) {
+    cout << *(job_entry->cmd) << " : " << job_entry->pid << '\n';
+    if ( job_entry->sendSignal(SIGCONT) == -1 ) {
         throw SmashSysFailure("kill failed");
     }
 
     this->jobs_list->updateCurrFGJob(job_entry->pid, job_entry->cmd, job_entry->id);
     this->jobs_list->removeJobByJobId(job_entry->id);
+    cout.flush(); // the job owns the terminal until it stops or exits
 
-    waitpid(job_entry->pid, nullptr, WUNTRACED);
+    int status = 0;
+    {
+        StatTimer timer(STAT_WAIT);
+        SmallShell& smash = SmallShell::getInstance();
+        if (smash.waitForeground(job_entry->pid, &status, job_entry->pidfd) == job_entry->pid) {
+            smash.setLastExitStatus(_exitCode(status));
+        }
+    }
 
     this->jobs_list->resetCurrFGJob();
     return DEFAULT_PROCESS_ID;
@@ -305,8 +557,8 @@ pid_t BackgroundCommand::execute() {
         }
     }
 
-    cout << *(job_entry->cmd) << " : " << job_entry->pid << endl;
-    if ( kill(job_entry->pid, SIGCONT) == -1 ) {
+    cout << *(job_entry->cmd) << " : " << job_entry->pid << '\n';
+    if ( job_entry->sendSignal(SIGCONT) == -1 ) {
         throw SmashSysFailure("kill failed");
     }
     job_entry->status = UNFINISHED;
@@ -316,14 +568,35 @@ pid_t BackgroundCommand::execute() {
 
 QuitCommand::QuitCommand(const char *cmd_line, JobsList *jobs) : BuiltInCommand(cmd_line), jobs(jobs) {
     kill = ( n_args >= 2 && args[1] == string("kill") );
+    for (int i = 2; kill && i < n_args; i++) {
+        if (args[i] == string("-t")) {
+            this->term_first = true;
+        } else if (args[i] == string("-v")) {
+            this->verbose = true;
+        }
+    }
 }
 
 pid_t QuitCommand::execute() {
+    // quit even if some of the jobs could not be signaled
+    SmallShell::quitSmash();
+    SmallShell::getInstance().append_fds.clear();
+
     if (this->kill) {
-        this->jobs->killAllJobs();
+        uint64_t start_ns = _monotonicNs();
+        this->jobs->killAllJobs(this->term_first);
+        uint64_t elapsed_ns = _monotonicNs() - start_ns;
+        SmashStats::getInstance().record(STAT_SHUTDOWN, elapsed_ns);
+        if (this->verbose) {
+            cout << MSG_PREFIX << "shutdown took " << elapsed_ns / 1000000 << " ms" << '\n';
+        }
+    }
+
+    const char* stats_file = getenv(STATS_FILE_ENV);
+    if (stats_file != nullptr && *stats_file != '\0') {
+        SmashStats::getInstance().dumpToFile(stats_file);
     }
 
-    SmallShell::quitSmash();
     return DEFAULT_PROCESS_ID;
 //    exit(0);
 }
@@ -347,156 +620,1305 @@ pid_t KillCommand::execute() {
         throw SmashCmdError("kill: job-id " + to_string(this->dest_jid) + " does not exist");
     }
 
-    if ( kill(job->pid, this->sig_num) == -1 ) {
+    if ( job->sendSignal(this->sig_num) == -1 ) {
         if (errno == EINVAL) {
             throw SmashCmdError("kill: invalid arguments");
         }
         throw SmashSysFailure("kill failed");
     }
 
-    cout << "signal number " << this->sig_num << " was sent to pid " << job->pid << endl;
+    cout << "signal number " << this->sig_num << " was sent to pid " << job->pid << '\n';
     this->jobs->removeFinishedJobs();
 
     return DEFAULT_PROCESS_ID;
 }
 
 
-///////////////////Built in commands end//////////////////////////
-
-
-
-///////////////////SmallShell start//////////////////////////
-
-SmallShell::SmallShell(){
-    this->pid = getpid();
-    this->curr_dir = string();
-    this->setCurrDir();
+TimesCommand::TimesCommand(const char* cmd_line) : BuiltInCommand(cmd_line) {
+    this->long_format = ( n_args >= 2 && args[1] == string("-l") );
 }
 
-SmallShell::~SmallShell(){
-// TODO: add your implementation
+string _formatTimes(const struct timeval& user, const struct timeval& sys) {
+    ostringstream out;
+    out << fixed << setprecision(3);
+    out << user.tv_sec / 60 << "m" << fmod(_timevalToSecs(user), 60) << "s ";
+    out << sys.tv_sec / 60 << "m" << fmod(_timevalToSecs(sys), 60) << "s";
+    return out.str();
 }
 
-void SmallShell::setPromptLine(const string new_prmp_line){
-  this->prompt = new_prmp_line;
-}
+pid_t TimesCommand::execute() {
+    struct rusage self_usage, children_usage;
+    if (-1 == getrusage(RUSAGE_SELF, &self_usage) || -1 == getrusage(RUSAGE_CHILDREN, &children_usage)) {
+        throw SmashSysFailure("getrusage failed");
+    }
 
-void SmallShell::printPromptLine() const{
-   cout << this->prompt << "> ";
+    // same layout as bash: the shell itself on the first line, all of its reaped children on the second
+    string out = _formatTimes(self_usage.ru_utime, self_usage.ru_stime) + "\n";
+    out += _formatTimes(children_usage.ru_utime, children_usage.ru_stime) + "\n";
+    if (this->long_format) {
+        out += "maxrss " + to_string(self_usage.ru_maxrss) + "KB " + to_string(children_usage.ru_maxrss) + "KB\n";
+    }
+    _writeOutput(out);
+    return DEFAULT_PROCESS_ID;
 }
 
-void SmallShell::printSmashId() const{
-   cout << "smash pid is " << this->pid << endl ;
+HistoryCommand::HistoryCommand(const char* cmd_line, History* history) : BuiltInCommand(cmd_line),
+                                                                         history(history) {
+    if (n_args == 1) {
+        return;
+    }
+    if (args[1] == string("-s")) {
+        if (n_args < 3) {
+            throw SmashCmdError("history: invalid arguments");
+        }
+        // the search text is the rest of the line, spaces included
+        string line = this->getRawCmdLine();
+        this->needle = _trim(line.substr(line.find("-s") + 2));
+        this->search = true;
+        return;
+    }
+    int num = 0;
+    if (n_args > 2 || _getnumber(args[1], &num) != IS_NUMBER || num <= 0) {
+        throw SmashCmdError("history: invalid arguments");
+    }
+    this->count = num;
 }
 
-string SmallShell::getCurrDir() {
-    return this->curr_dir;
-}
+pid_t HistoryCommand::execute() {
+    vector<size_t> numbers;
+    if (this->search) {
+        numbers = this->history->search(this->needle);
+    } else {
+        size_t total = this->history->size();
+        size_t first = (this->count == 0 || this->count >= total ? 1 : total - this->count + 1);
+        for (size_t n = first; n <= total; n++) {
+            numbers.push_back(n);
+        }
+    }
 
-void SmallShell::setCurrDir() {
-    char buff[PATH_MAX];
-    getcwd(buff, PATH_MAX);
+    string entry;
+    char number[24];
+    for (size_t n : numbers) {
+        if (this->history->get(n, entry)) {
+            snprintf(number, sizeof(number), "%5zu  ", n);
+            cout << number << entry << '\n';
+        }
+    }
+    return DEFAULT_PROCESS_ID;
+}
 
-    this->prev_dir = curr_dir;
-    this->curr_dir = string(buff);
+ExportCommand::ExportCommand(const char* cmd_line, VarTable* variables) : BuiltInCommand(cmd_line),
+                                                                       variables(variables) {
+    string name, value;
+    for (int i = 1; i < n_args; i++) {
+        if (!_splitAssignment(args[i], name, value) && !_isValidVarName(args[i])) {
+            throw SmashCmdError(string("export: `") + args[i] + "': not a valid identifier");
+        }
+    }
 }
 
-/**
-* Creates and returns a pointer to Command class which matches the given command line (cmd_line)
-*/
-CommandPtr SmallShell::CreateCommand(const char* cmd_line) {
-    string cmd_s = _trim((cmd_line));
-    string firstWord = cmd_s.substr(0, cmd_s.find_first_of(" &\n"));
+pid_t ExportCommand::execute() {
+    if (n_args == 1) {
+        for (const string& entry : this->variables->exportedList()) {
+            size_t eq = entry.find('=');
+            cout << "export " << entry.substr(0, eq) << "=\"" << entry.substr(eq + 1) << "\"\n";
+        }
+        return DEFAULT_PROCESS_ID;
+    }
+    string name, value;
+    for (int i = 1; i < n_args; i++) {
+        if (_splitAssignment(args[i], name, value)) {
+            this->variables->set(name, value, true);
+        } else {
+            this->variables->exportVar(args[i]);
+        }
+    }
+    return DEFAULT_PROCESS_ID;
+}
 
-    if (firstWord.empty()) {
-        return nullptr;
+UnsetCommand::UnsetCommand(const char* cmd_line, VarTable* variables) : BuiltInCommand(cmd_line),
+                                                                    variables(variables) {
+    for (int i = 1; i < n_args; i++) {
+        if (!_isValidVarName(args[i])) {
+            throw SmashCmdError(string("unset: `") + args[i] + "': not a valid identifier");
+        }
     }
+}
 
-    if (cmd_s.find_first_of('>') != string::npos) {
-        return make_shared<RedirectionCommand>(cmd_line);
-    } else if (cmd_s.find_first_of('|') != string::npos) {
-        return make_shared<PipeCommand>(cmd_line);
-    } else if (firstWord == "chprompt") {
-        return make_shared<ChPromptCommand>(cmd_line);
-    } else if (firstWord == "showpid") {
-        return make_shared<ShowPidCommand>(cmd_line);
-    } else if (firstWord == "pwd") {
-        return make_shared<GetCurrDirCommand>(cmd_line);
-    } else if (firstWord == "cd") {
-        return make_shared<ChangeDirCommand>(cmd_line, this->prev_dir);
-    } else if (firstWord == "jobs") {
-        return make_shared<JobsCommand>(cmd_line, &(this->jobs_list));
-    } else if (firstWord == "fg") {
-        return make_shared<ForegroundCommand>(cmd_line, &(this->jobs_list));
-    } else if (firstWord == "bg") {
-        return make_shared<BackgroundCommand>(cmd_line, &(this->jobs_list));
-    } else if (firstWord == "quit") {
-        return make_shared<QuitCommand>(cmd_line, &(this->jobs_list));
-    } else if (firstWord == "kill") {
-        return make_shared<KillCommand>(cmd_line, &(this->jobs_list));
-    } else if (firstWord == "tail") {
-        return make_shared<TailCommand>(cmd_line);
-    } else if (firstWord == "touch") {
-        return make_shared<TouchCommand>(cmd_line);
-    } else if (firstWord == "timeout") {
-        return make_shared<AlarmCommand>(cmd_line, &(this->time_out_manager));
+pid_t UnsetCommand::execute() {
+    for (int i = 1; i < n_args; i++) {
+        this->variables->unset(args[i]);
     }
+    return DEFAULT_PROCESS_ID;
+}
 
-    return make_shared<ExternalCommand>(cmd_line);
+AssignCommand::AssignCommand(const char* cmd_line, VarTable* variables) : BuiltInCommand(cmd_line),
+                                                                      variables(variables) {
+    _parseAssignment(this->cmd_line, this->name, this->value);
 }
 
-void SmallShell::executeCommand(const char *cmd_line) {
-    this->jobs_list.removeFinishedJobs();
+pid_t AssignCommand::execute() {
+    this->variables->set(this->name, this->value);
+    return DEFAULT_PROCESS_ID;
+}
 
+/*
+ * Body of a forked child that runs cmd and exits with its status. External commands are exec'd in place,
+ * anything else runs here and its own child, if any, is waited for.
+ */
+[[noreturn]] void _runCommandInChild(const CommandPtr& cmd) {
+    SmallShell& smash = SmallShell::getInstance();
     try {
-        CommandPtr cmd = CreateCommand(cmd_line);
-        if (cmd != nullptr) {
-            pid_t fork_pid = cmd->execute();
-            if (fork_pid == DEFAULT_PROCESS_ID) {
-//                delete (cmd);
-                return; //it was FG, no need to add to list
-            }
-            /*not Built in command*/
-            if(cmd->is_BG) {
-                this->jobs_list.addJob(fork_pid, cmd);
-            } else {
-                this->jobs_list.updateCurrFGJob(fork_pid, cmd);
-                waitpid(fork_pid, nullptr, WUNTRACED);
-                this->jobs_list.resetCurrFGJob();
-//                delete (cmd);
-            }
+        auto* external = dynamic_cast<ExternalCommand*>(cmd.get());
+        if (external != nullptr) {
+            external->execInPlace(); // no second fork for the common case
+        }
+        pid_t child = cmd->execute();
+        if (child != DEFAULT_PROCESS_ID) {
+            int status = 0;
+            _waitProcess(child, &status, WUNTRACED);
+            smash.setLastExitStatus(_exitCode(status));
         }
     }
     catch (SmashCmdError& err) {
         cerr << err.what() << endl;
+        _exitChild(1);
     } catch (SmashSysFailure& err) {
         perror(err.what());
-    }  
-  // Please note that you must fork smash process for some commands (e.g., external commands....)
-}
-
+        _exitChild(1);
+    }
+    _exitChild(smash.getLastExitStatus());
+}
+
+ParallelCommand::ParallelCommand(const char* cmd_line) : BuiltInCommand(cmd_line) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    this->max_jobs = (n_cpus > 0 ? n_cpus : 1);
+
+    const char* file = nullptr;
+    int i = 1;
+    for (; i < n_args && args[i][0] == '-'; i++) {
+        string flag = args[i];
+        int num = 0;
+        if (flag == "-k") {
+            this->keep_order = true;
+        } else if (flag == "-j" && i + 1 < n_args && _getnumber(args[i + 1], &num) == IS_NUMBER && num > 0) {
+            this->max_jobs = num;
+            i++;
+        } else if (flag == "-f" && i + 1 < n_args) {
+            file = args[++i];
+        } else {
+            throw SmashCmdError("parallel: invalid arguments");
+        }
+    }
 
-SmashError::SmashError(const string& msg) : msg(string(ERROR_PREFIX) + msg) {}
+    if (file != nullptr) {
+        if (i != n_args) {
+            throw SmashCmdError("parallel: invalid arguments");
+        }
+        int fd = open(file, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw SmashSysFailure("open failed");
+        }
+        LineReader reader(fd);
+        string line;
+        while (reader.readRawLine(line)) {
+            line = _trim(line);
+            if (!line.empty()) {
+                this->tasks.push_back({line});
+            }
+        }
+        close(fd);
+        return;
+    }
 
-const char* SmashError::what() const noexcept {
-    return msg.c_str();
+    // cmd ::: arg..., the command taken from the line so its expanded text stays literal
+    string command;
+    std::istringstream words(_skipWords(this->cmd_line, i));
+    for (string word; words >> word && word != PARALLEL_ARGS_SEPARATOR; ) {
+        command += (command.empty() ? "" : " ") + word;
+    }
+    while (i < n_args && args[i] != string(PARALLEL_ARGS_SEPARATOR)) {
+        i++;
+    }
+    if (command.empty() || i == n_args) {
+        throw SmashCmdError("parallel: invalid arguments");
+    }
+    size_t placeholder = command.find(PARALLEL_PLACEHOLDER);
+    for (i++; i < n_args; i++) {
+        string line = command;
+        string arg = _literalText(args[i], false); // one word, whatever it holds
+        if (placeholder == string::npos) {
+            line += " " + arg;
+        } else {
+            line.replace(placeholder, strlen(PARALLEL_PLACEHOLDER), arg);
+        }
+        this->tasks.push_back({line});
+    }
 }
 
-///////////////////SmallShell end///////////////////////////
-
+void ParallelCommand::launch(size_t index, int epoll_fd) {
+    Task_t& task = this->tasks[index];
+    CommandPtr cmd;
+    try {
+        cmd = SmallShell::getInstance().CreateCommand(task.line.c_str());
+    } catch (SmashError& err) {
+        cerr << err.what() << endl;
+    }
+    if (cmd == nullptr) {
+        task.exited = true;
+        task.failed = (task.line.find_first_not_of(WHITESPACE) != string::npos);
+        return;
+    }
+    cmd->is_BG = false;
 
+    int fd[2];
+    if (this->keep_order && -1 == pipe2(fd, O_CLOEXEC)) {
+        throw SmashSysFailure("pipe failed");
+    }
+    pid_t pid = _fork();
+    if (pid < 0) {
+        if (this->keep_order) {
+            close_pipe(fd);
+        }
+        throw SmashSysFailure("fork failed");
+    }
+    if (pid == 0) {
+        setpgrp();
+        if (this->keep_order && -1 == dup2(fd[STDOUT_FD], STDOUT_FD)) {
+            perror("smash error: dup2 failed");
+            _exitChild(1);
+        }
+        _runCommandInChild(cmd);
+    }
 
-//////////////////////Job Entry start///////////////////////
-double JobsList::JobEntry_t::calcDiffTime() {
-    return ( calcDiffTimeParam (this->timestamp) );
+    // tasks reuse the job entry (pidfd, signaling, wait status) but never enter the jobs list
+    task.job = make_shared<JobsList::JobEntry_t>(index + 1, _currTime(), pid, cmd, UNFINISHED);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    if (task.job->pidfd != -1) {
+        ev.data.u64 = index << 1;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, task.job->pidfd, &ev);
+    }
+    if (this->keep_order) {
+        close(fd[STDOUT_FD]);
+        task.out_fd = fd[STDIN_FD];
+        ev.data.u64 = (index << 1) | 1;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, task.out_fd, &ev);
+    }
 }
-//////////////////////Job Entry end///////////////////////
-
 
+void ParallelCommand::drainOutput(Task_t& task, int epoll_fd) {
+    size_t len = task.output.size();
+    task.output.resize(len + CAPTURE_READ_SIZE);
+    ssize_t rbytes;
+    do {
+        rbytes = read(task.out_fd, &task.output[len], CAPTURE_READ_SIZE);
+    } while (rbytes == -1 && errno == EINTR);
+    task.output.resize(len + (rbytes > 0 ? rbytes : 0));
+    if (rbytes <= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, task.out_fd, nullptr);
+        close(task.out_fd);
+        task.out_fd = -1;
+    }
+}
 
-//////////////////Jobs List start////////////////////////////
-
-JobsList::JobEntry JobsList::getJobByJobId(job_id jobId) {
+bool ParallelCommand::reap(Task_t& task, int options) {
+    if (task.exited || task.job == nullptr) {
+        return false;
+    }
+    if (_waitProcess(task.job->pid, &task.job->exit_status, options, &task.job->usage) != task.job->pid) {
+        return false;
+    }
+    task.exited = true;
+    task.failed = (_exitCode(task.job->exit_status) != 0);
+    return true;
+}
+
+int ParallelCommand::killRunning() {
+    int n_killed = 0;
+    for (Task_t& task : this->tasks) {
+        if (task.job != nullptr && !task.exited) {
+            task.job->sendSignal(SIGKILL);
+            killpg(task.job->pid, SIGKILL);
+            reap(task, 0);
+            n_killed++;
+        }
+        if (task.out_fd != -1) {
+            close(task.out_fd);
+            task.out_fd = -1;
+        }
+    }
+    return n_killed;
+}
+
+pid_t ParallelCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    smash.fg_interrupted = 0;
+    smash.variables.envp(); // built once here instead of in every child
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        throw SmashSysFailure("epoll_create1 failed");
+    }
+    size_t next = 0;
+    size_t running = 0;
+    size_t next_to_print = 0;
+    int n_failed = 0;
+    struct epoll_event events[EPOLL_BATCH_SIZE];
+
+    while (next < this->tasks.size() || running > 0) {
+        if (smash.fg_interrupted) {
+            cout << MSG_PREFIX << "parallel: " << killRunning() << " running tasks were killed" << '\n';
+            close(epoll_fd);
+            smash.setLastExitStatus(128 + SIGINT);
+            return DEFAULT_PROCESS_ID;
+        }
+        try {
+            while (running < this->max_jobs && next < this->tasks.size()) {
+                launch(next, epoll_fd);
+                running += (this->tasks[next++].job != nullptr);
+            }
+        } catch (...) {
+            // a failed pipe or fork ends the run: the tasks already started go with it
+            killRunning();
+            close(epoll_fd);
+            throw;
+        }
+
+        // without pidfd support, exits are only noticed by polling
+        bool polling = false;
+        for (size_t i = next_to_print; i < next && !polling; i++) {
+            Task_t& task = this->tasks[i];
+            polling = (task.job != nullptr && !task.exited && task.job->pidfd == -1);
+        }
+        int n_ready = 0;
+        if (running > 0 || (this->keep_order && next_to_print < next)) {
+            n_ready = epoll_wait(epoll_fd, events, EPOLL_BATCH_SIZE, polling ? REAP_POLL_INTERVAL_MS : -1);
+        }
+        for (int i = 0; i < n_ready; i++) {
+            Task_t& task = this->tasks[events[i].data.u64 >> 1];
+            if (events[i].data.u64 & 1) {
+                drainOutput(task, epoll_fd);
+            } else if (reap(task, WNOHANG)) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, task.job->pidfd, nullptr);
+                running--;
+                n_failed += task.failed;
+            }
+        }
+        for (size_t i = next_to_print; polling && i < next; i++) {
+            Task_t& task = this->tasks[i];
+            if (task.job != nullptr && task.job->pidfd == -1 && reap(task, WNOHANG)) {
+                running--;
+                n_failed += task.failed;
+            }
+        }
+
+        // hand finished tasks back in input order (-k), or just forget them
+        while (next_to_print < next && this->tasks[next_to_print].exited &&
+               this->tasks[next_to_print].out_fd == -1) {
+            Task_t& task = this->tasks[next_to_print++];
+            n_failed += (task.job == nullptr && task.failed);
+            cout << task.output;
+            task = Task_t();
+        }
+        if (this->keep_order) {
+            cout.flush();
+        }
+    }
+
+    close(epoll_fd);
+    smash.setLastExitStatus(std::min(n_failed, PARALLEL_MAX_EXIT_STATUS));
+    return DEFAULT_PROCESS_ID;
+}
+
+OutputCommand::OutputCommand(const char* cmd_line, CaptureTable* captures) : BuiltInCommand(cmd_line),
+                                                                            captures(captures) {
+    int job_arg = 1;
+    if (n_args == 3 && args[1] == string("-f")) {
+        this->follow = true;
+        job_arg = 2;
+    }
+    if (n_args != job_arg + 1) {
+        throw SmashCmdError("output: invalid arguments");
+    }
+    char* job_spec = args[job_arg] + (args[job_arg][0] == '%' ? 1 : 0);
+    if (_getnumber(job_spec, &this->dest_jid) != IS_NUMBER || this->dest_jid <= 0) {
+        throw SmashCmdError("output: invalid arguments");
+    }
+}
+
+/*
+ * Writes out to stdout a pipe-sized piece at a time, only once stdout can take it, and drains the
+ * capture pipes while it cannot: a terminal that stops reading stalls "output -f", never the jobs.
+ * Returns false when ctrl-C cut it short.
+ */
+static bool _writeDraining(CaptureTable& captures, const string& out) {
+    SmallShell& smash = SmallShell::getInstance();
+    size_t done = 0;
+    while (done < out.size() && !smash.fg_interrupted) {
+        struct pollfd fds[2] = {{STDOUT_FD, POLLOUT, 0}, {captures.eventFd(), POLLIN, 0}};
+        if (-1 == poll(fds, 2, SIGNAL_POLL_INTERVAL_MS) && errno != EINTR) {
+            throw SmashSysFailure("poll failed");
+        }
+        if (fds[1].revents & POLLIN) {
+            captures.drain(0);
+        }
+        if (fds[0].revents & (POLLOUT | POLLERR | POLLHUP)) {
+            ssize_t wbytes = write(STDOUT_FD, out.data() + done, std::min(out.size() - done, (size_t)PIPE_BUF));
+            if (wbytes == -1 && errno != EINTR) {
+                throw SmashSysFailure("write failed");
+            }
+            done += std::max(wbytes, (ssize_t)0);
+        }
+    }
+    return done == out.size();
+}
+
+pid_t OutputCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    this->captures->drain(0);
+    const RingBuffer* ring = this->captures->ring(this->dest_jid);
+    if (ring == nullptr) {
+        throw SmashCmdError("output: job-id " + to_string(this->dest_jid) + " has no captured output");
+    }
+    cout.flush();
+    smash.fg_interrupted = 0;
+    uint64_t offset = 0;
+    while (true) {
+        if (ring->begin() > offset) {
+            cerr << MSG_PREFIX << "output: " << (ring->begin() - offset) << " bytes were overwritten" << endl;
+        }
+        string out;
+        ring->read(offset, out);
+        offset = ring->end();
+        if (!_writeDraining(*this->captures, out) || !this->follow || !this->captures->isOpen(this->dest_jid)) {
+            break;
+        }
+        // woken by any pipe, a closed one included, or after a while to notice ctrl-C
+        this->captures->drain(SIGNAL_POLL_INTERVAL_MS);
+        if (smash.fg_interrupted || (ring = this->captures->ring(this->dest_jid)) == nullptr) {
+            break;
+        }
+    }
+    return DEFAULT_PROCESS_ID;
+}
+
+CaptureCommand::CaptureCommand(const char* cmd_line, CaptureTable* captures) : BuiltInCommand(cmd_line),
+                                                                               captures(captures) {
+    for (int i = 1; i < n_args; i++) {
+        string arg = args[i];
+        if (arg == "on" || arg == "off") {
+            this->capture_all = (arg == "on");
+            continue;
+        }
+        if (arg != "-s" || i + 1 == n_args) {
+            throw SmashCmdError("capture: invalid arguments");
+        }
+        size_t size;
+        if (!_parseSize(args[++i], &size) || size < CAPTURE_MIN_RING_SIZE || size > CAPTURE_MAX_RING_SIZE) {
+            throw SmashCmdError("capture: invalid arguments");
+        }
+        this->ring_size = size;
+    }
+}
+
+pid_t CaptureCommand::execute() {
+    if (this->capture_all != -1) {
+        this->captures->setCaptureAll(this->capture_all);
+    }
+    if (this->ring_size != 0) {
+        this->captures->setRingSize(this->ring_size);
+    }
+    if (n_args == 1) {
+        cout << "capture: " << (this->captures->captureAll() ? "on" : "off") << ", ring size "
+             << this->captures->ringSize() << " bytes\n";
+    }
+    return DEFAULT_PROCESS_ID;
+}
+
+StatsCommand::StatsCommand(const char* cmd_line) : BuiltInCommand(cmd_line) {
+    for (int i = 1; i < n_args; i++) {
+        if (args[i] == string("-j")) {
+            this->as_json = true;
+        } else if (args[i] == string("-r")) {
+            this->reset = true;
+        } else {
+            throw SmashCmdError("stats: invalid arguments");
+        }
+    }
+}
+
+pid_t StatsCommand::execute() {
+    SmashStats& stats = SmashStats::getInstance();
+    if (this->reset) {
+        stats.reset();
+        return DEFAULT_PROCESS_ID;
+    }
+    _writeOutput(stats.format(this->as_json));
+    return DEFAULT_PROCESS_ID;
+}
+
+///////////////////Built in commands end//////////////////////////
+
+
+
+///////////////////SmallShell start//////////////////////////
+
+SmallShell::SmallShell(){
+    this->pid = getpid();
+    // curr_dir is resolved on first use, keeping getcwd off the startup path
+}
+
+SmallShell::~SmallShell(){
+// TODO: add your implementation
+}
+
+void SmallShell::setPromptLine(const string new_prmp_line){
+  this->prompt = new_prmp_line;
+}
+
+string SmallShell::getPromptLine() const{
+   if (this->script_parser.pending()) {
+       return SCRIPT_CONTINUATION_PROMPT;
+   }
+   return this->prompt + "> ";
+}
+
+void SmallShell::printSmashId() const{
+   cout << "smash pid is " << this->pid << '\n' ;
+}
+
+int SmallShell::getLastExitStatus() const {
+    return this->last_exit_status;
+}
+
+void SmallShell::setLastExitStatus(int status) {
+    this->last_exit_status = status;
+}
+
+string SmallShell::getCurrDir() {
+    if (this->curr_dir.empty()) {
+        char buff[PATH_MAX];
+        if (getcwd(buff, PATH_MAX) == nullptr) {
+            throw SmashSysFailure("getcwd failed");
+        }
+        this->curr_dir = string(buff);
+    }
+    return this->curr_dir;
+}
+
+void SmallShell::setCurrDir() {
+    // the directory we are leaving was cached (or resolved) by getCurrDir() before the chdir
+    this->prev_dir = curr_dir;
+    this->curr_dir = string();
+    // like bash, and exported like bash does, so $PWD and the children's environment follow cd
+    this->variables.set("OLDPWD", this->prev_dir, true);
+    this->variables.set("PWD", this->getCurrDir(), true);
+}
+
+TimeOutManager& SmallShell::getTimeOutManager() {
+    if (this->time_out_manager == nullptr) {
+        installAlarmHandler();
+        this->time_out_manager = std::unique_ptr<TimeOutManager>(new TimeOutManager());
+    }
+    return *this->time_out_manager;
+}
+
+string SmallShell::substituteCommands(const string& line) {
+    if (line.find("$(") == string::npos && line.find('`') == string::npos) {
+        return line;
+    }
+    string out;
+    char quote = '\0';
+    size_t assignment_end = _assignmentEnd(line);
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '\\' && quote != '\'' && i + 1 < line.size()) {
+            out += c;
+            out += line[++i];
+            continue;
+        }
+        if ((c == '\'' || c == '"') && (quote == '\0' || quote == c)) {
+            quote = (quote == c ? '\0' : c);
+        }
+
+        string inner;
+        bool in_quotes = (quote == '\'');
+        bool split = (quote == '\0' && i >= assignment_end);
+        if (!in_quotes && c == '$' && i + 1 < line.size() && line[i + 1] == '(') {
+            size_t end = i + 2;
+            int depth = 1;
+            for (; end < line.size() && depth > 0; end++) {
+                depth += (line[end] == '(') - (line[end] == ')');
+            }
+            if (depth != 0) {
+                throw SmashCmdError("syntax error: unterminated $(");
+            }
+            inner = line.substr(i + 2, end - i - 3);
+            i = end - 1;
+        } else if (!in_quotes && c == '`') {
+            size_t end = line.find('`', i + 1);
+            if (end == string::npos) {
+                throw SmashCmdError("syntax error: unterminated `");
+            }
+            inner = line.substr(i + 1, end - i - 1);
+            i = end;
+        } else {
+            out += c;
+            continue;
+        }
+        // the output is text: its words split unless quoted or assigned, but nothing in it is parsed as syntax
+        out += _literalText(captureOutput(inner), split);
+    }
+    return out;
+}
+
+/*
+ * Runs cmd_line and returns its output, with the trailing newlines dropped. Output-only built-ins run in-process into a
+ * buffer; everything else runs in a child (a subshell, like in bash) and is read back from a pipe.
+ */
+string SmallShell::captureOutput(const string& cmd_line) {
+    string line = substituteCommands(_trim(cmd_line)); // nested substitutions first
+    string output;
+    CommandPtr cmd = CreateCommand(line.c_str());
+    if (cmd == nullptr) {
+        return output;
+    }
+    cmd->is_BG = false;
+
+    if (dynamic_cast<BuiltInCommand*>(cmd.get()) != nullptr && !cmd->mutatesShell()) {
+        OutputCapture capture(cout);
+        cmd->execute();
+        output = capture.str();
+    } else {
+        int fd[2];
+        if (-1 == pipe2(fd, O_CLOEXEC)) {
+            throw SmashSysFailure("pipe failed");
+        }
+        pid_t pid = _fork();
+        if (pid < 0) {
+            close_pipe(fd);
+            throw SmashSysFailure("fork failed");
+        }
+        if (pid == 0) {
+            setpgrp();
+            if (-1 == dup2(fd[STDOUT_FD], STDOUT_FD)) {
+                perror("smash error: dup2 failed");
+                _exitChild(1);
+            }
+            _runCommandInChild(cmd);
+        }
+
+        close(fd[STDOUT_FD]);
+        // ctrl-C kills the substituted command like any foreground command
+        this->jobs_list.updateCurrFGJob(pid, cmd);
+        // large reads straight into the result, no intermediate buffer
+        size_t len = 0;
+        ssize_t rbytes;
+        do {
+            output.resize(len + CAPTURE_READ_SIZE);
+            do {
+                rbytes = read(fd[STDIN_FD], &output[len], CAPTURE_READ_SIZE);
+            } while (rbytes == -1 && errno == EINTR);
+            len += (rbytes > 0 ? rbytes : 0);
+        } while (rbytes > 0);
+        output.resize(len);
+        close(fd[STDIN_FD]);
+
+        int status = 0;
+        if (_waitProcess(pid, &status, 0) == pid) {
+            this->last_exit_status = _exitCode(status);
+        }
+        this->jobs_list.resetCurrFGJob();
+    }
+
+    output.erase(output.find_last_not_of('\n') + 1);
+    return output;
+}
+
+/**
+* Creates and returns a pointer to Command class which matches the given command line (cmd_line)
+*/
+static CommandPtr _createStreamCommand(const string& name, const char* cmd_line) {
+    if (!SmallShell::getInstance().spawn_attrs.empty()) {
+        return nullptr; // the attributes are meant for a process of its own
+    }
+    shared_ptr<StreamCommand> cmd;
+    if (name == "cat") {
+        cmd = make_shared<CatCommand>(cmd_line);
+    } else if (name == "head") {
+        cmd = make_shared<HeadCommand>(cmd_line);
+    } else if (name == "wc") {
+        cmd = make_shared<WcCommand>(cmd_line);
+    } else if (name == "grep") {
+        cmd = make_shared<GrepCommand>(cmd_line);
+    } else {
+        cmd = make_shared<CpCommand>(cmd_line);
+    }
+    return (cmd->isSupported() ? cmd : nullptr);
+}
+
+CommandPtr SmallShell::CreateCommand(const char* cmd_line) {
+    string cmd_s = _trim((cmd_line));
+    string firstWord = cmd_s.substr(0, cmd_s.find_first_of(" &\n"));
+
+    if (firstWord.empty()) {
+        return nullptr;
+    }
+
+    if (firstWord == "run") {
+        return make_shared<RunCommand>(cmd_line); // its command may hold '>' and '|' of its own
+    } else if (cmd_s.find_first_of('>') != string::npos) {
+        return make_shared<RedirectionCommand>(cmd_line);
+    } else if (cmd_s.find_first_of('|') != string::npos) {
+        return make_shared<PipeCommand>(cmd_line);
+    } else if (firstWord == "chprompt") {
+        return make_shared<ChPromptCommand>(cmd_line);
+    } else if (firstWord == "showpid") {
+        return make_shared<ShowPidCommand>(cmd_line);
+    } else if (firstWord == "true" || firstWord == ":") {
+        return make_shared<TrueCommand>(cmd_line);
+    } else if (firstWord == "false") {
+        return make_shared<FalseCommand>(cmd_line);
+    } else if (firstWord == "pwd") {
+        return make_shared<GetCurrDirCommand>(cmd_line);
+    } else if (firstWord == "cd") {
+        return make_shared<ChangeDirCommand>(cmd_line, this->prev_dir);
+    } else if (firstWord == "jobs") {
+        return make_shared<JobsCommand>(cmd_line, &(this->jobs_list));
+    } else if (firstWord == "fg") {
+        return make_shared<ForegroundCommand>(cmd_line, &(this->jobs_list));
+    } else if (firstWord == "bg") {
+        return make_shared<BackgroundCommand>(cmd_line, &(this->jobs_list));
+    } else if (firstWord == "quit") {
+        return make_shared<QuitCommand>(cmd_line, &(this->jobs_list));
+    } else if (firstWord == "kill") {
+        return make_shared<KillCommand>(cmd_line, &(this->jobs_list));
+    } else if (firstWord == "tail") {
+        return make_shared<TailCommand>(cmd_line);
+    } else if (firstWord == "cat" || firstWord == "head" || firstWord == "wc" || firstWord == "grep" ||
+               firstWord == "cp") {
+        CommandPtr cmd = _createStreamCommand(firstWord, cmd_line);
+        if (cmd != nullptr) {
+            return cmd;
+        }
+        return make_shared<ExternalCommand>(cmd_line); // options or syntax only the real tool has
+    } else if (firstWord == "touch") {
+        return make_shared<TouchCommand>(cmd_line);
+    } else if (firstWord == "timeout") {
+        return make_shared<AlarmCommand>(cmd_line, &(this->getTimeOutManager()));
+    } else if (firstWord == "times") {
+        return make_shared<TimesCommand>(cmd_line);
+    } else if (firstWord == "stats") {
+        return make_shared<StatsCommand>(cmd_line);
+    } else if (firstWord == "history") {
+        return make_shared<HistoryCommand>(cmd_line, &(this->history));
+    } else if (firstWord == "parallel") {
+        return make_shared<ParallelCommand>(cmd_line);
+    } else if (firstWord == "output") {
+        return make_shared<OutputCommand>(cmd_line, &(this->captures));
+    } else if (firstWord == "capture") {
+        return make_shared<CaptureCommand>(cmd_line, &(this->captures));
+    } else if (firstWord == "export") {
+        return make_shared<ExportCommand>(cmd_line, &(this->variables));
+    } else if (firstWord == "unset") {
+        return make_shared<UnsetCommand>(cmd_line, &(this->variables));
+    } else if (firstWord.find('=') != string::npos) {
+        string name, value;
+        if (_parseAssignment(cmd_s, name, value)) {
+            return make_shared<AssignCommand>(cmd_line, &(this->variables));
+        }
+    }
+
+    return make_shared<ExternalCommand>(cmd_line);
+}
+
+/*
+ * Starts cmd with out_fd as its stdout and stderr. Like the server does for its clients, smash's own
+ * fds 1 and 2 point at out_fd only while the command is started, so every launch path inherits it.
+ */
+static pid_t _executeWithOutput(Command& cmd, int out_fd) {
+    cout.flush();
+    cerr.flush();
+    int saved_out = fcntl(STDOUT_FD, F_DUPFD_CLOEXEC, 0);
+    int saved_err = fcntl(STDERR_FD, F_DUPFD_CLOEXEC, 0);
+    if (saved_out == -1 || saved_err == -1) {
+        int saved_errno = errno;
+        close(saved_out);
+        close(saved_err);
+        errno = saved_errno;
+        throw SmashSysFailure("dup failed");
+    }
+    auto restore = [&]() {
+        dup2(saved_out, STDOUT_FD);
+        dup2(saved_err, STDERR_FD);
+        close(saved_out);
+        close(saved_err);
+    };
+    dup2(out_fd, STDOUT_FD);
+    dup2(out_fd, STDERR_FD);
+    pid_t pid;
+    try {
+        pid = cmd.execute();
+    } catch (SmashError&) {
+        int saved_errno = errno;
+        restore();
+        errno = saved_errno;
+        throw;
+    }
+    restore();
+    return pid;
+}
+
+/*
+ * Without captured jobs this is a plain waitpid. With them, the wait also watches their pipes: a long
+ * foreground command must not leave background jobs blocked on a full pipe. Exits wake the loop
+ * through a pidfd, stops (which raise no pidfd event) are noticed within SIGNAL_POLL_INTERVAL_MS.
+ */
+pid_t SmallShell::waitForeground(pid_t pid, int* status, int pidfd) {
+    if (!this->captures.active()) {
+        return _waitProcess(pid, status, WUNTRACED);
+    }
+    int own_pidfd = (pidfd == -1 ? _pidfdOpen(pid) : -1);
+    int exit_fd = (pidfd == -1 ? own_pidfd : pidfd);
+    pid_t ret;
+    while ((ret = _waitProcess(pid, status, WUNTRACED | WNOHANG)) == 0) {
+        struct pollfd fds[2] = {{this->captures.eventFd(), POLLIN, 0}, {exit_fd, POLLIN, 0}};
+        int timeout = (exit_fd == -1 ? REAP_POLL_INTERVAL_MS : SIGNAL_POLL_INTERVAL_MS);
+        if (poll(fds, (exit_fd == -1 ? 1 : 2), timeout) > 0 && (fds[0].revents & POLLIN)) {
+            this->captures.drain(0);
+        }
+    }
+    if (own_pidfd != -1) {
+        close(own_pidfd);
+    }
+    return ret;
+}
+
+/*
+ * A line typed or read at the prompt. Blocks (for, while, until, if and function definitions) are
+ * collected until they close and then run from their parsed form; anything else runs right away.
+ */
+void SmallShell::executeCommand(const char *cmd_line) {
+    string line = cmd_line;
+    try {
+        if (this->history.isEnabled()) {
+            string trimmed = _trim(line);
+            string expanded;
+            if (this->history.expand(trimmed, expanded)) {
+                cout << expanded << '\n'; // like bash, show what is actually run
+                trimmed = expanded;
+                line = expanded;
+            }
+            this->history.add(trimmed);
+        }
+    } catch (SmashCmdError& err) {
+        this->last_exit_status = 1;
+        cerr << err.what() << endl;
+        return;
+    }
+
+    if (!this->script_parser.pending() && !ScriptParser::opensBlock(line)) {
+        this->executeLine(line, true);
+        return;
+    }
+    ScriptBlock block;
+    try {
+        if (!this->script_parser.feed(line, block)) {
+            return; // more lines to come
+        }
+    } catch (SmashCmdError& err) {
+        this->last_exit_status = EXIT_SYNTAX_ERROR;
+        cerr << err.what() << endl;
+        return;
+    }
+    this->fg_interrupted = 0;
+    this->runBlock(block);
+}
+
+void SmallShell::endOfInput() {
+    if (this->script_parser.pending()) {
+        this->script_parser.reset();
+        this->last_exit_status = EXIT_SYNTAX_ERROR;
+        cerr << ERROR_PREFIX "syntax error: unexpected end of file" << endl;
+    }
+}
+
+void SmallShell::executeLine(const string& line, bool expands) {
+    StatTimer command_timer(STAT_COMMAND);
+    this->jobs_list.removeFinishedJobs();
+    DirCache::getInstance().clear(); // directories may have changed since the last prompt
+    this->cgroups.beginCommand();
+
+    try {
+        uint64_t parse_start_ns = _monotonicNs();
+        // variables are substituted before the line is split into words (and into pipe/redirection parts)
+        string substituted = (expands ? this->variables.expand(line, this->last_exit_status, this->pid) : line);
+        uint64_t parse_ns = _monotonicNs() - parse_start_ns;
+        // then $(...), whose commands run on their own and are not parse time
+        if (expands) {
+            substituted = this->substituteCommands(substituted);
+        }
+        const char* cmd_line = substituted.c_str();
+        if (!this->functions.empty()) {
+            string name = _trim(substituted);
+            auto function = this->functions.find(name.substr(0, name.find_first_of(WHITESPACE + "&")));
+            if (function != this->functions.end()) {
+                this->callFunction(function->second, substituted); // a copy: the body may redefine it
+                return;
+            }
+        }
+        parse_start_ns = _monotonicNs();
+        CommandPtr cmd = this->command_cache.get(substituted);
+        if (cmd == nullptr) {
+            cmd = CreateCommand(cmd_line);
+            this->command_cache.put(substituted, cmd);
+        }
+        SmashStats::getInstance().record(STAT_PARSE, parse_ns + _monotonicNs() - parse_start_ns);
+        if (cmd != nullptr) {
+            this->last_exit_status = 0;
+            cmd->spawn_desc = this->spawn_attrs.describe();
+            int capture_fd = -1;
+            pid_t fork_pid;
+            if (cmd->is_BG && (cmd->capture_output || this->captures.captureAll())) {
+                int fd[2];
+                this->captures.openPipe(fd);
+                try {
+                    fork_pid = _executeWithOutput(*cmd, fd[STDOUT_FD]);
+                } catch (SmashError&) {
+                    close_pipe(fd);
+                    throw;
+                }
+                close(fd[STDOUT_FD]); // the job holds the only write end now
+                capture_fd = fd[STDIN_FD];
+            } else {
+                fork_pid = cmd->execute();
+            }
+            cmd->cgroup = this->cgroups.takePending();
+            if (fork_pid == DEFAULT_PROCESS_ID) {
+//                delete (cmd);
+                if (capture_fd != -1) {
+                    close(capture_fd);
+                }
+                return; //it was FG, no need to add to list
+            }
+            /*not Built in command*/
+            if(cmd->is_BG) {
+                job_id id = this->jobs_list.addJob(fork_pid, cmd);
+                if (capture_fd != -1) {
+                    this->captures.add(id, capture_fd); // kept even if the job is already done
+                }
+            } else {
+                this->jobs_list.updateCurrFGJob(fork_pid, cmd);
+                int status = 0;
+                uint64_t wait_start_ns = _monotonicNs();
+                if (this->waitForeground(fork_pid, &status) == fork_pid) {
+                    this->last_exit_status = _exitCode(status);
+                }
+                SmashStats::getInstance().record(STAT_WAIT, _monotonicNs() - wait_start_ns);
+                this->jobs_list.resetCurrFGJob();
+//                delete (cmd);
+            }
+        }
+    }
+    catch (SmashCmdError& err) {
+        this->last_exit_status = 1;
+        cerr << err.what() << endl;
+    } catch (SmashSysFailure& err) {
+        this->last_exit_status = 1;
+        cout.flush(); // perror goes through stdio, which is not tied to cout like cerr
+        perror(err.what());
+    }  
+  // Please note that you must fork smash process for some commands (e.g., external commands....)
+}
+
+// the words of an expanded for list, split on whitespace with their globs expanded, as plain text
+static vector<string> _splitWords(const string& line) {
+    vector<string> words;
+    std::istringstream iss(line);
+    for (string text; iss >> text; ) {
+        string word = _decodeLiteral(text);
+        if (word.empty()) {
+            continue;
+        }
+        vector<string> matches;
+        if (_hasGlobChars(word.c_str()) && _globExpand(word, matches)) {
+            words.insert(words.end(), matches.begin(), matches.end());
+        } else {
+            words.push_back(word);
+        }
+    }
+    return words;
+}
+
+/*
+ * Runs a function's body with the words after its name as $1.., in smash itself: a call is a
+ * statement, so it cannot be piped, redirected or sent to the background.
+ */
+void SmallShell::callFunction(ScriptNodePtr function, const string& cmd_line) {
+    if (cmd_line.find_first_of("|>") != string::npos || _isBackgroundComamnd(cmd_line.c_str())) {
+        throw SmashCmdError(function->text + ": functions cannot be piped, redirected or run in the background");
+    }
+    if (this->call_depth == SCRIPT_MAX_CALL_DEPTH) {
+        throw SmashCmdError(function->text + ": maximum function nesting level exceeded (" +
+                            std::to_string(SCRIPT_MAX_CALL_DEPTH) + ")");
+    }
+    vector<char*> argv;
+    int n_args = _parseCommandLine(cmd_line.c_str(), argv);
+    vector<string> args(argv.begin() + 1, argv.begin() + n_args);
+    for (char* arg : argv) {
+        free(arg);
+    }
+
+    unsigned caller_loops = this->loop_depth;
+    this->variables.pushArgs(std::move(args));
+    this->call_depth++;
+    this->loop_depth = 0; // break and continue do not reach the caller's loops
+    this->last_exit_status = 0;
+    try {
+        this->runBlock(function->bodies[0]); // return only sets the status
+    } catch (...) {
+        this->call_depth--;
+        this->loop_depth = caller_loops;
+        this->variables.popArgs();
+        throw;
+    }
+    this->call_depth--;
+    this->loop_depth = caller_loops;
+    this->variables.popArgs();
+}
+
+ScriptFlow SmallShell::runBlock(const ScriptBlock& block) {
+    for (const ScriptNodePtr& node : block) {
+        if (this->quit || this->fg_interrupted) {
+            return FLOW_STOP; // ctrl-C stops every loop and call up to the prompt, like quit does
+        }
+        ScriptFlow flow = this->runNode(node);
+        if (flow != FLOW_NEXT) {
+            return flow;
+        }
+    }
+    return FLOW_NEXT;
+}
+
+bool SmallShell::loopDone(ScriptFlow& flow) {
+    if (flow == FLOW_BREAK || flow == FLOW_CONTINUE) {
+        if (--this->flow_levels > 0) {
+            return true; // "break N": on to the enclosing loop
+        }
+        bool done = (flow == FLOW_BREAK);
+        flow = FLOW_NEXT;
+        return done;
+    }
+    return (flow != FLOW_NEXT);
+}
+
+ScriptFlow SmallShell::runNode(const ScriptNodePtr& node) {
+    const ScriptNode_t& n = *node;
+    ScriptFlow flow = FLOW_NEXT;
+    switch (n.kind) {
+    case NODE_LINE:
+        this->executeLine(n.text, n.expands);
+        return FLOW_NEXT;
+
+    case NODE_FUNCTION:
+        this->functions[n.text] = node;
+        this->last_exit_status = 0;
+        return FLOW_NEXT;
+
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+    case NODE_RETURN: {
+        const char* name = (n.kind == NODE_BREAK ? "break" : (n.kind == NODE_CONTINUE ? "continue" : "return"));
+        string arg = n.text;
+        if (n.expands) {
+            arg = _trim(this->variables.expand(arg, this->last_exit_status, this->pid));
+        }
+        char* end = nullptr;
+        long value = (arg.empty() ? 0 : strtol(arg.c_str(), &end, 10));
+        if (!arg.empty() && (*end != '\0' || arg.find_first_of(WHITESPACE) != string::npos ||
+                             (n.kind != NODE_RETURN && value < 1))) {
+            cerr << ERROR_PREFIX << name << ": " << arg << ": invalid argument" << endl;
+            this->last_exit_status = 1;
+            return FLOW_NEXT;
+        }
+        if (n.kind == NODE_RETURN) {
+            if (this->call_depth == 0) {
+                cerr << ERROR_PREFIX "return: only meaningful in a function" << endl;
+                this->last_exit_status = 1;
+                return FLOW_NEXT;
+            }
+            if (!arg.empty()) {
+                this->last_exit_status = (int)(value & 0xff);
+            }
+            return FLOW_RETURN;
+        }
+        if (this->loop_depth == 0) {
+            cerr << ERROR_PREFIX << name << ": only meaningful in a loop" << endl;
+            this->last_exit_status = 1;
+            return FLOW_NEXT;
+        }
+        this->flow_levels = std::min((unsigned long)(arg.empty() ? 1 : value), (unsigned long)this->loop_depth);
+        this->last_exit_status = 0;
+        return (n.kind == NODE_BREAK ? FLOW_BREAK : FLOW_CONTINUE);
+    }
+
+    case NODE_FOR: {
+        vector<string> words;
+        try {
+            string list = n.words;
+            if (n.expands) {
+                list = this->substituteCommands(this->variables.expand(list, this->last_exit_status, this->pid));
+            }
+            words = _splitWords(list);
+        } catch (SmashCmdError& err) {
+            this->last_exit_status = 1;
+            cerr << err.what() << endl;
+            return FLOW_NEXT;
+        }
+        this->last_exit_status = 0;
+        this->loop_depth++;
+        for (const string& word : words) {
+            this->variables.set(n.text, word);
+            flow = this->runBlock(n.bodies[0]);
+            if (this->loopDone(flow)) {
+                break;
+            }
+        }
+        this->loop_depth--;
+        return flow;
+    }
+
+    case NODE_WHILE:
+    case NODE_UNTIL: {
+        int status = 0; // of the last body run, 0 if none was
+        this->loop_depth++;
+        while (true) {
+            flow = this->runBlock(n.conds[0]);
+            if (this->loopDone(flow) || (this->last_exit_status == 0) != (n.kind == NODE_WHILE)) {
+                break;
+            }
+            flow = this->runBlock(n.bodies[0]);
+            status = this->last_exit_status;
+            if (this->loopDone(flow)) {
+                break;
+            }
+        }
+        this->loop_depth--;
+        if (flow == FLOW_NEXT) {
+            this->last_exit_status = status;
+        }
+        return flow;
+    }
+
+    case NODE_IF:
+        for (size_t i = 0; i < n.conds.size(); i++) {
+            flow = this->runBlock(n.conds[i]);
+            if (flow != FLOW_NEXT) {
+                return flow;
+            }
+            if (this->last_exit_status == 0) {
+                return this->runBlock(n.bodies[i]);
+            }
+        }
+        if (n.bodies.size() > n.conds.size()) {
+            return this->runBlock(n.bodies.back());
+        }
+        this->last_exit_status = 0;
+        return FLOW_NEXT;
+    }
+    return FLOW_NEXT;
+}
+
+
+///////////////////SmallShell end///////////////////////////
+
+///////////////////CommandCache start//////////////////////////
+
+CommandPtr CommandCache::get(const string& line) {
+    auto found = this->by_line.find(line);
+    if (found == this->by_line.end() || found->second->second.use_count() != 1) {
+        return nullptr; // a command still held elsewhere, say by a running $(...), is parsed anew
+    }
+    this->entries.splice(this->entries.begin(), this->entries, found->second);
+    return found->second->second;
+}
+
+void CommandCache::put(const string& line, const CommandPtr& cmd) {
+    if (cmd == nullptr || !cmd->reusable() || _hasGlobChars(line.c_str())) {
+        return;
+    }
+    size_t hash = std::hash<string>()(line);
+    size_t& seen = this->seen[hash % this->seen.size()];
+    if (seen != hash) {
+        seen = hash; // the first time, or pushed out by another line: remembered, not kept yet
+        return;
+    }
+    auto slot = this->by_line.emplace(line, this->entries.end());
+    if (!slot.second) {
+        return; // a copy made while the cached one was in use
+    }
+    if (this->entries.size() == this->capacity) {
+        this->by_line.erase(this->entries.back().first);
+        this->entries.pop_back();
+    }
+    this->entries.emplace_front(line, cmd);
+    slot.first->second = this->entries.begin();
+}
+
+///////////////////CommandCache end//////////////////////////
+
+
+
+
+
+//////////////////////Job Entry start///////////////////////
+JobsList::JobEntry_t::JobEntry_t(job_id id, time_t timestamp, pid_t pid, CommandPtr cmd, JOB_STATUS status) :
+    id(id), timestamp(timestamp), pid(pid), cmd(cmd), status(status) {
+    this->pidfd = _pidfdOpen(pid);
+}
+
+JobsList::JobEntry_t::~JobEntry_t() {
+    if (this->pidfd != -1) {
+        close(this->pidfd);
+    }
+}
+
+/*
+ * Signals the job through its pidfd so a reaped and reused pid can never be hit; falls back to kill(2)
+ * on kernels without pidfd support.
+ */
+int JobsList::JobEntry_t::sendSignal(int sig_num) const {
+    int ret = -1;
+    if (this->pidfd != -1) {
+        ret = _pidfdSendSignal(this->pidfd, sig_num);
+    }
+    if (this->pidfd == -1 || (ret == -1 && errno == ENOSYS)) {
+        ret = kill(this->pid, sig_num);
+    }
+    // under --cgroups, also the rest of the job's tree, which may have left its process group
+    if (this->cmd->cgroup != nullptr) {
+        int saved_errno = errno;
+        this->cmd->cgroup->signalAll(sig_num, this->pid);
+        errno = saved_errno;
+    }
+    return ret;
+}
+
+double JobsList::JobEntry_t::calcDiffTime() {
+    return ( calcDiffTimeParam (this->timestamp) );
+}
+
+double JobsList::JobEntry_t::calcDiffTime(time_t now) {
+    return ( difftime(now, this->timestamp) );
+}
+//////////////////////Job Entry end///////////////////////
+
+
+
+//////////////////Jobs List start////////////////////////////
+
+JobsList::JobEntry JobsList::getJobByJobId(job_id jobId) {
     auto map_elem = this->jobs_list.find(jobId);
     if (map_elem == this->jobs_list.end()) return nullptr;
     return (map_elem->second);
@@ -535,34 +1957,78 @@ JobsList::JobEntry JobsList::getLastStoppedJob(job_id* jobId) {
     return nullptr; //not an error, just no stopped jobs at jobs list
 }
 
+JobsList::JobsList() {
+    this->engine.onJobEvent([this](const EngineJob_t& done) { this->jobExited(done); });
+}
+
+JobsList::~JobsList() {
+    for (auto& entry : this->jobs_list) {
+        this->engine.release(entry.second->engine_id);
+    }
+}
+
+void JobsList::watchJob(const JobEntry& job) {
+    // the engine shares the entry's pidfd, which outlives its tracking
+    job->engine_id = this->engine.adopt(job->pid, job->cmd->getRawCmdLine(), job->pidfd);
+}
+
+void JobsList::unwatchJob(const JobEntry& job) {
+    this->engine.release(job->engine_id);
+}
+
+void JobsList::eraseJob(const JobEntry& job) {
+    this->unwatchJob(job);
+    this->jobs_list.erase(job->id);
+    this->proc_to_job_id.erase(job->pid);
+}
+
 void JobsList::removeJobByProcessId(pid_t pid_to_remove) {
-    auto map_element = this->proc_to_job_id.find(pid_to_remove);
-    if(map_element == this->proc_to_job_id.end()) return;
-    
-    job_id jid_to_remove = map_element->second;
-    this->jobs_list.erase(jid_to_remove);
-    this->proc_to_job_id.erase(pid_to_remove);
+    JobEntry job_entry = getJobByProcessId(pid_to_remove);
+    if (job_entry == nullptr) return;
+    this->eraseJob(job_entry);
 }
 
 void JobsList::removeJobByJobId(job_id job_id_to_remove) {
     JobEntry job_entry = getJobByJobId(job_id_to_remove);
     if (job_entry == nullptr) return;
-    pid_t process_to_remove = job_entry->pid;
-    this->jobs_list.erase(job_id_to_remove);
-    this->proc_to_job_id.erase(process_to_remove);
+    this->eraseJob(job_entry);
 }
 
 
-void JobsList::removeFinishedJobs() {
-    pid_t done_pid;
-    while ((done_pid = waitpid(-1, nullptr, WNOHANG)) > 0) {
-        this->removeJobByProcessId(done_pid);
+void JobsList::recordFinishedJob(const JobEntry& job, int status, const struct rusage& usage) {
+    job->exit_status = status;
+    job->usage = usage;
+    if (job->cmd->cgroup != nullptr) {
+        job->cmd->cgroup->readUsage(&job->cgroup_cpu_secs, &job->cgroup_peak_kb);
+        job->cmd->cgroup = nullptr; // removed unless something the job started is still running
+    }
+    if (this->finished_jobs.size() >= FINISHED_JOBS_HISTORY) {
+        this->finished_jobs.erase(this->finished_jobs.begin());
+    }
+    this->finished_jobs.push_back(job);
+}
+
+void JobsList::jobExited(const EngineJob_t& done) {
+    if (done.state != ENGINE_EXITED) {
+        return;
+    }
+    JobEntry job = this->getJobByProcessId(done.pgid);
+    if (job == nullptr || job->engine_id != done.id) {
+        this->engine.forget(done.id);
+        return;
     }
+    this->recordFinishedJob(job, done.exit_status, done.usage);
+    this->eraseJob(job);
 }
 
-void JobsList::addJob(pid_t pid, CommandPtr cmd, bool isStopped, job_id jobId) {
+void JobsList::removeFinishedJobs() {
+    StatTimer timer(STAT_REAP);
+    // a pidfd becomes readable once its process exits, so only the finished jobs are visited
+    this->engine.poll(0);
+}
+
+job_id JobsList::addJob(pid_t pid, CommandPtr cmd, bool isStopped, job_id jobId) {
     this->removeFinishedJobs(); //cleanup all done jobs before inserting a new one
-    if( waitpid(pid , nullptr, WNOHANG) == pid ) return;
     if( jobId == DEFAULT_JOB_ID) {
         this->getLastJob(&jobId);
         jobId += 1;
@@ -573,23 +2039,106 @@ void JobsList::addJob(pid_t pid, CommandPtr cmd, bool isStopped, job_id jobId) {
         throw SmashSysFailure("time failed");
     }
     JobEntry entry = make_shared<JobEntry_t>(jobId, timestamp, pid, cmd, status);
+    this->watchJob(entry);
     this->proc_to_job_id.insert({entry->pid, entry->id});
     this->jobs_list.insert({entry->id, entry});
+    // one that is already done leaves the list again, and jobs -l shows how it ended
+    this->removeFinishedJobs();
+    return entry->id;
 }
 
 
-void JobsList::printJobsList() {
+string _describeExitStatus(int status) {
+    if (WIFSIGNALED(status))
+        return "signal " + to_string(WTERMSIG(status));
+    return "exit " + to_string(WEXITSTATUS(status));
+}
+
+void JobsList::printJobsList(bool as_json, bool long_format) {
     this->removeFinishedJobs();
+    if (this->jobs_list.empty() && (!long_format || this->finished_jobs.empty())) {
+        return;
+    }
+
+    time_t now = _currTime();
+    ostringstream out;
     for (auto iter = this->jobs_list.begin() ; iter != this->jobs_list.end() ; iter++) {
         JobEntry job_entry = iter->second;
-        cout << "[" << job_entry->id << "] ";
-        cout << *(job_entry->cmd) << " : ";
-        cout << job_entry->pid << " ";
-        cout << job_entry->calcDiffTime() << " secs";
+        double cpu_secs = 0;
+        long maxrss_kb = 0;
+        if (long_format) {
+            _readProcUsage(job_entry->pid, &cpu_secs, &maxrss_kb);
+            long peak_kb = -1;
+            if (job_entry->cmd->cgroup != nullptr && job_entry->cmd->cgroup->readUsage(&cpu_secs, &peak_kb) &&
+                peak_kb >= 0) {
+                maxrss_kb = peak_kb;
+            }
+        }
+        if (as_json) {
+            ostringstream cmd_str;
+            cmd_str << *(job_entry->cmd);
+            out << "{\"job_id\":" << job_entry->id;
+            out << ",\"pid\":" << job_entry->pid;
+            out << ",\"cmd\":\"" << _jsonEscape(cmd_str.str()) << "\"";
+            out << ",\"elapsed\":" << job_entry->calcDiffTime(now);
+            out << ",\"status\":\"" << (job_entry->status == STOPPED ? "stopped" : "running") << "\"";
+            if (long_format) {
+                out << ",\"cpu_secs\":" << cpu_secs << ",\"maxrss_kb\":" << maxrss_kb;
+                if (!job_entry->cmd->spawn_desc.empty()) {
+                    out << ",\"spawn\":\"" << _jsonEscape(job_entry->cmd->spawn_desc) << "\"";
+                }
+                if (job_entry->cmd->cgroup != nullptr) {
+                    out << ",\"cgroup\":\"" << _jsonEscape(job_entry->cmd->cgroup->getPath()) << "\"";
+                }
+            }
+            out << "}\n";
+            continue;
+        }
+        out << "[" << job_entry->id << "] ";
+        out << *(job_entry->cmd) << " : ";
+        out << job_entry->pid << " ";
+        out << job_entry->calcDiffTime(now) << " secs";
         if(job_entry->status == STOPPED)
-            cout << " (stopped)";
-        cout << endl;
-    }  
+            out << " (stopped)";
+        if (long_format) {
+            out << " cpu " << cpu_secs << "s maxrss " << maxrss_kb << "KB";
+            if (!job_entry->cmd->spawn_desc.empty()) {
+                out << " spawn " << job_entry->cmd->spawn_desc;
+            }
+            if (job_entry->cmd->cgroup != nullptr) {
+                const string& path = job_entry->cmd->cgroup->getPath();
+                out << " cgroup " << path.substr(path.find_last_of('/') + 1);
+            }
+        }
+        out << "\n";
+    }
+
+    if (long_format) {
+        // jobs reaped since the last long listing, reported once with their final accounting
+        for (const JobEntry& job_entry : this->finished_jobs) {
+            double cpu_secs = _timevalToSecs(job_entry->usage.ru_utime) + _timevalToSecs(job_entry->usage.ru_stime);
+            if (job_entry->cgroup_cpu_secs >= 0) {
+                cpu_secs = job_entry->cgroup_cpu_secs;
+            }
+            long maxrss_kb = (job_entry->cgroup_peak_kb >= 0 ? job_entry->cgroup_peak_kb : job_entry->usage.ru_maxrss);
+            if (as_json) {
+                ostringstream cmd_str;
+                cmd_str << *(job_entry->cmd);
+                out << "{\"job_id\":" << job_entry->id;
+                out << ",\"pid\":" << job_entry->pid;
+                out << ",\"cmd\":\"" << _jsonEscape(cmd_str.str()) << "\"";
+                out << ",\"status\":\"done\",\"exit_code\":" << _exitCode(job_entry->exit_status);
+                out << ",\"cpu_secs\":" << cpu_secs << ",\"maxrss_kb\":" << maxrss_kb << "}\n";
+                continue;
+            }
+            out << "[" << job_entry->id << "] ";
+            out << *(job_entry->cmd) << " : ";
+            out << job_entry->pid << " done (" << _describeExitStatus(job_entry->exit_status) << ")";
+            out << " cpu " << cpu_secs << "s maxrss " << maxrss_kb << "KB\n";
+        }
+        this->finished_jobs.clear();
+    }
+    _writeOutput(out.str());
 }
 
 void JobsList::updateCurrFGJob(pid_t pid, CommandPtr cmd, job_id jobId) {
@@ -602,30 +2151,90 @@ void JobsList::resetCurrFGJob() {
     this->curr_FG_job = nullptr;
 }
 
-void JobsList::killAllJobs() {
-    this->removeFinishedJobs();
-
-    cout << MSG_PREFIX << "sending SIGKILL signal to " << this->jobs_list.size() << " jobs:" << endl;
-    for (auto iter = this->jobs_list.begin(), next_it = iter; iter != this->jobs_list.end(); iter = next_it) {
-        ++next_it;
+/*
+ * Signals the whole process group of every job. The leader is signaled through its pidfd first; its pgid
+ * can't be reused before we reap it, so the killpg that follows is safe as well.
+ * Returns the number of jobs that could not be signaled.
+ */
+int JobsList::signalAllJobs(int sig_num) {
+    int n_failed = 0;
+    for (auto iter = this->jobs_list.begin(); iter != this->jobs_list.end(); ++iter) {
         JobEntry job = iter->second;
-        cout << job->pid << ": " << *(job->cmd) << endl;
-        if ( kill(job->pid, SIGKILL) == -1 ) {
-            throw SmashSysFailure("kill failed");
+        bool leader_signaled = ( job->sendSignal(sig_num) == 0 );
+        bool group_signaled = ( killpg(job->pid, sig_num) == 0 );
+        if (!leader_signaled && !group_signaled && errno != ESRCH) {
+            n_failed += 1;
+        }
+    }
+    return n_failed;
+}
+
+/*
+ * Reaps jobs until none is left or the timeout expires, sleeping in the engine's poll in between.
+ */
+void JobsList::reapAllJobs(long timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    this->removeFinishedJobs();
+    while (!this->jobs_list.empty()) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long remaining_ms = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+        if (remaining_ms <= 0) {
+            return;
         }
-        this->jobs_list.erase(iter);
-        this->proc_to_job_id.erase(job->pid);
+        this->engine.poll((int)remaining_ms);
+    }
+}
+
+void JobsList::killAllJobs(bool term_first) {
+    this->removeFinishedJobs();
+
+    ostringstream out;
+    out << MSG_PREFIX << "sending SIGKILL signal to " << this->jobs_list.size() << " jobs:\n";
+    for (auto iter = this->jobs_list.begin(); iter != this->jobs_list.end(); ++iter) {
+        out << iter->second->pid << ": " << *(iter->second->cmd) << "\n";
+    }
+    _writeOutput(out.str());
+
+    if (term_first && !this->jobs_list.empty()) {
+        this->signalAllJobs(SIGTERM);
+        this->signalAllJobs(SIGCONT); // stopped jobs only act on SIGTERM once resumed
+        this->reapAllJobs(QUIT_TERM_GRACE_MS);
+    }
+
+    int n_failed = this->signalAllJobs(SIGKILL);
+    this->reapAllJobs(QUIT_KILL_DEADLINE_MS);
+    SmallShell::getInstance().cgroups.killAll(); // daemons of jobs that already finished
+
+    // whatever survived the deadline is left to init
+    while (!this->jobs_list.empty()) {
+        this->eraseJob(this->jobs_list.begin()->second);
+    }
+
+    if (n_failed > 0) {
+        throw SmashSysFailure("kill failed");
     }
 }
 
 void JobsList::killCurrFGJob() {
     if(this->curr_FG_job == nullptr)
         return;
-    if(-1 == kill(this->curr_FG_job->pid, SIGKILL) ) {
+    if(-1 == this->curr_FG_job->sendSignal(SIGKILL) ) {
         throw SmashSysFailure("kill failed");
     }
-    waitpid(this->curr_FG_job->pid, nullptr, 0);
-    cout << MSG_PREFIX << "process " << this->curr_FG_job->pid << " was killed" << endl;
+    int status = 0;
+    if (_waitProcess(this->curr_FG_job->pid, &status, 0) == this->curr_FG_job->pid) {
+        SmallShell::getInstance().setLastExitStatus(_exitCode(status));
+    }
+    (SafeMessage() << MSG_PREFIX << "process " << (long)this->curr_FG_job->pid << " was killed\n").emit();
     resetCurrFGJob();
 }
 
@@ -633,19 +2242,24 @@ void JobsList::stopCurrFGJob() {
     JobEntry job = this->curr_FG_job;
     if(job == nullptr)
         return;
-    if(-1 == kill(job->pid, SIGSTOP) ) {
+    if(-1 == job->sendSignal(SIGSTOP) ) {
         throw SmashSysFailure("kill failed");
     }
     addJob(job->pid, job->cmd, true, job->id);
-    cout << MSG_PREFIX << "process " << job->pid << " was stopped" << endl;
+    (SafeMessage() << MSG_PREFIX << "process " << (long)job->pid << " was stopped\n").emit();
     resetCurrFGJob();
 }
 
 CommandPtr JobsList::getCmdForPID(pid_t pid_to_check) {
+    JobEntry job = this->getJobForPID(pid_to_check);
+    return ( job == nullptr ? nullptr : job->cmd );
+}
+
+JobsList::JobEntry JobsList::getJobForPID(pid_t pid_to_check) {
     if (this->curr_FG_job != nullptr && this->curr_FG_job->pid == pid_to_check)
-        return this->curr_FG_job->cmd;
-    
-    return ( this->getJobByProcessId(pid_to_check)->cmd );
+        return this->curr_FG_job;
+
+    return ( this->getJobByProcessId(pid_to_check) );
 }
 
 //////////////////Jobs List end////////////////////////////
@@ -655,8 +2269,40 @@ CommandPtr JobsList::getCmdForPID(pid_t pid_to_check) {
 
 ExternalCommand::ExternalCommand(const char *cmd_line) : Command(cmd_line){}
 
+/*
+ * A line bash would only split into words and exec (globs included, smash already expanded them)
+ * can be exec'd directly, skipping a bash startup per command.
+ */
+bool _isSimpleCommand(const char* cmd_line) {
+    // expanded text is literal (LITERAL_MARK), a variable smash does not know is bash's to expand
+    if (strpbrk(cmd_line, SHELL_SPECIAL_CHARS UNKNOWN_VAR_MARK_STR) != nullptr) {
+        return false;
+    }
+    string first_word = _trim(cmd_line);
+    first_word = first_word.substr(0, first_word.find_first_of(WHITESPACE));
+    return first_word.find('=') == string::npos; // VAR=value cmd
+}
+
+pid_t ExternalCommand::launchThroughZygote(int out_fd) {
+    SmallShell& smash = SmallShell::getInstance();
+    if (!smash.zygote.isRunning() || !smash.spawn_attrs.empty() || smash.cgroups.enabled()) {
+        return -1; // the zygote's children take neither spawn attributes nor job cgroups, a fork here does
+    }
+    if (_isSimpleCommand(this->cmd_line.c_str())) {
+        return smash.zygote.launch(this->args.data(), true, smash.getCurrDir(), smash.variables, out_fd);
+    }
+    string shell_text = _shellText(this->cmd_line);
+    char* argv[] = {(char*)"/bin/bash", (char*)"-c", &shell_text[0], nullptr};
+    return smash.zygote.launch(argv, false, smash.getCurrDir(), smash.variables, out_fd);
+}
+
 pid_t ExternalCommand::execute() {
-    pid_t fork_pid = fork();
+    SmallShell::getInstance().variables.envp(); // rebuild a stale envp once here, not in every child
+    pid_t zygote_pid = this->launchThroughZygote(STDOUT_FD);
+    if (zygote_pid > 0) {
+        return zygote_pid;
+    }
+    pid_t fork_pid = _fork();
     if (fork_pid < 0) {
         throw SmashSysFailure("fork failed");
     }
@@ -664,20 +2310,37 @@ pid_t ExternalCommand::execute() {
     if (fork_pid == 0) {
         // child process
         setpgrp();
-        char* argv[] = {(char*)"/bin/bash", (char*)"-c", this->cmd_line, nullptr};
-        execv(argv[0], argv);
-        /*
-         * Panic mode
-         * https://stackoverflow.com/questions/3703013/what-can-cause-exec-to-fail-what-happens-next
-         */
-        perror("execv failed");
-        exit(EXIT_FAILURE);
+        execInPlace();
     } else {
         // parent process (smash)
         return (fork_pid);
     }
 }
 
+void ExternalCommand::execInPlace() {
+    const char* failed_call = nullptr;
+    if (!SmallShell::getInstance().spawn_attrs.apply(&failed_call)) {
+        perror((string("smash error: run: ") + failed_call + " failed").c_str());
+        _exitChild(EXIT_FAILURE);
+    }
+    char** envp = SmallShell::getInstance().variables.envp();
+    if (_isSimpleCommand(this->cmd_line.c_str())) {
+        _execPath(this->args[0], this->args.data(), envp);
+        int exec_errno = errno; // perror may clobber it
+        perror("smash error: execvp failed");
+        _exitChild(exec_errno == ENOENT ? EXIT_NOT_FOUND : EXIT_NOT_EXECUTABLE);
+    }
+    string shell_text = _shellText(this->cmd_line);
+    char* argv[] = {(char*)"/bin/bash", (char*)"-c", &shell_text[0], nullptr};
+    execve(argv[0], argv, envp);
+    /*
+     * Panic mode
+     * https://stackoverflow.com/questions/3703013/what-can-cause-exec-to-fail-what-happens-next
+     */
+    perror("execv failed");
+    _exitChild(EXIT_FAILURE);
+}
+
 
 
 ///////////////////External Commands end//////////////////////////
@@ -696,7 +2359,7 @@ RedirectionCommand::RedirectionCommand(const char* cmd_line):Command(cmd_line) {
         this->flag |=  O_TRUNC;
     }
     size_t last_index = str_cmd_line.find_last_of('>');
-    this->output_file = _trim(str_cmd_line.substr(last_index+1));
+    this->output_file = _decodeLiteral(_trim(str_cmd_line.substr(last_index+1)));
 
 //    SmallShell& smash = SmallShell::getInstance();
     this->inner_cmd_line = _trim(str_cmd_line.substr(0,index_of_sub));
@@ -707,15 +2370,62 @@ RedirectionCommand::RedirectionCommand(const char* cmd_line):Command(cmd_line) {
 }
 
 pid_t RedirectionCommand::execute() {
-    pid_t pid = fork();
+    SmallShell& smash = SmallShell::getInstance();
+    const mode_t mode = S_IRUSR|S_IWUSR|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH;
+    // ">>" targets stay open between lines, the child only dup2's them (-1: opened by the child)
+    int append_fd = ((this->flag & O_APPEND) ? smash.append_fds.get(this->output_file, mode) : -1);
+    CommandPtr cmd;
+    if (append_fd != -1 || smash.zygote.isRunning()) {
+        try {
+            cmd = smash.CreateCommand(this->inner_cmd_line.c_str());
+        } catch (SmashError& err) {
+            // built-in errors are reported by the forked child below, after the file is created
+        }
+    }
+    // parallel's tasks write to fd 1 itself, not through cout
+    if (append_fd != -1 && dynamic_cast<BuiltInCommand*>(cmd.get()) != nullptr && !cmd->mutatesShell() &&
+        dynamic_cast<ParallelCommand*>(cmd.get()) == nullptr) {
+        // an output-only built-in appends in-process, like under $(...): the line costs no fork and no open
+        FdOutputBuffer out(append_fd);
+        out.install(cout);
+        cmd->execute();
+        return DEFAULT_PROCESS_ID;
+    }
+    if (smash.zygote.isRunning()) {
+        // an external command only needs the file as its stdout, the zygote can start it without a fork here
+        auto* external = dynamic_cast<ExternalCommand*>(cmd.get());
+        if (external != nullptr) {
+            int fd = (append_fd != -1 ? append_fd : open(this->output_file.c_str(), this->flag | O_CLOEXEC, mode));
+            if (fd == -1) {
+                throw SmashSysFailure("open failed");
+            }
+            pid_t child_pid = external->launchThroughZygote(fd);
+            if (fd != append_fd) {
+                close(fd);
+            }
+            if (child_pid > 0) {
+                int status = 0;
+                _waitProcess(child_pid, &status, 0);
+                smash.setLastExitStatus(_exitCode(status));
+                return DEFAULT_PROCESS_ID;
+            }
+        }
+    }
+    pid_t pid = _fork();
     if(pid == 0) { 
         setpgrp();
         try {
-            if (-1 == close(STDOUT_FD)) {
-                throw SmashSysFailure("close failed");
-            }
-            if (-1 == open(this->output_file.c_str(), this->flag, S_IRUSR|S_IWUSR|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH)) {
-                throw SmashSysFailure("open failed");
+            if (append_fd != -1) {
+                if (-1 == dup2(append_fd, STDOUT_FD)) {
+                    throw SmashSysFailure("dup2 failed");
+                }
+            } else {
+                if (-1 == close(STDOUT_FD)) {
+                    throw SmashSysFailure("close failed");
+                }
+                if (-1 == open(this->output_file.c_str(), this->flag, mode)) {
+                    throw SmashSysFailure("open failed");
+                }
             }
 
             SmallShell& smash = SmallShell::getInstance();
@@ -724,27 +2434,32 @@ pid_t RedirectionCommand::execute() {
                 cmd->is_BG = false;
                 pid_t child_pid = cmd->execute();
                 if (child_pid != DEFAULT_PROCESS_ID) {
-                    waitpid(child_pid, nullptr, WUNTRACED);
+                    int status = 0;
+                    _waitProcess(child_pid, &status, WUNTRACED);
+                    smash.setLastExitStatus(_exitCode(status));
                 }
             }
 //            this->cmd->execute();
+            cout.flush();
             if (-1 == close(STDOUT_FD)) {
                 throw SmashSysFailure("close failed");
             }
         }
         catch (SmashCmdError& err) {
             cerr << err.what() << endl;
-            exit(1);
+            _exitChild(1);
         } catch (SmashSysFailure& err) {
             perror(err.what());
-            exit(1);
+            _exitChild(1);
         }
 
-        exit(0);
+        _exitChild(SmallShell::getInstance().getLastExitStatus());
     } else if (pid < 0) {
         throw SmashSysFailure("fork failed");
     } else {
-        waitpid(pid, nullptr , 0);
+        int status = 0;
+        _waitProcess(pid, &status, 0);
+        SmallShell::getInstance().setLastExitStatus(_exitCode(status));
     }
     return DEFAULT_PROCESS_ID;
 }
@@ -758,10 +2473,25 @@ PipeCommand::PipeCommand(const char *cmd_line) : Command(cmd_line), write_fd(STD
         index_after_pipe += 1;
     }
 
+    SmallShell& smash = SmallShell::getInstance();
+    string size_str;
+    if (str_cmd_line[index_after_pipe] == '{') {
+        size_t close_brace = str_cmd_line.find('}', index_after_pipe);
+        if (close_brace == string::npos) {
+            throw SmashCmdError("pipe: invalid size");
+        }
+        size_str = str_cmd_line.substr(index_after_pipe + 1, close_brace - index_after_pipe - 1);
+        index_after_pipe = close_brace + 1;
+    } else if (const Var_t* var = smash.variables.get(PIPE_SIZE_VAR)) {
+        size_str = var->value;
+    }
+    if (!size_str.empty() && (!_parseSize(size_str.c_str(), &this->pipe_size) || this->pipe_size == 0)) {
+        throw SmashCmdError("pipe: invalid size " + size_str);
+    }
+
     string src_cmd_line = _trim(str_cmd_line.substr(0, index_of_pipe));
     string dest_cmd_line = _trim(str_cmd_line.substr(index_after_pipe));
 
-    SmallShell& smash = SmallShell::getInstance();
     this->cmd_src = smash.CreateCommand(src_cmd_line.c_str());
     this->cmd_dest = smash.CreateCommand(dest_cmd_line.c_str());
 
@@ -770,9 +2500,21 @@ PipeCommand::PipeCommand(const char *cmd_line) : Command(cmd_line), write_fd(STD
     this->cmd_dest->is_BG = false;
 }
 
-void close_pipe(int fd[2]) {
-    if ( -1 == close(fd[0]) || -1 == close(fd[1]) ) {
-        throw SmashSysFailure("close failed");
+/*
+ * Resizes a new pipe. Unprivileged processes are capped at pipe-max-size (1M by default): asking for
+ * more gets that maximum. Past the per-user pipe memory limit the pipe keeps its size.
+ */
+void _setPipeSize(int fd, size_t size) {
+    if (-1 != fcntl(fd, F_SETPIPE_SZ, (int)std::min(size, (size_t)INT_MAX)) || errno != EPERM) {
+        return;
+    }
+    char buff[BUFFER_SIZE] = {};
+    int max_fd = open(PIPE_MAX_SIZE_FILE, O_RDONLY | O_CLOEXEC);
+    if (max_fd != -1 && read(max_fd, buff, sizeof(buff) - 1) > 0) {
+        fcntl(fd, F_SETPIPE_SZ, atoi(buff));
+    }
+    if (max_fd != -1) {
+        close(max_fd);
     }
 }
 
@@ -781,11 +2523,14 @@ pid_t PipeCommand::execute() {
     if ( -1 == pipe(fd) ) {
         throw SmashSysFailure("pipe failed");
     }
+    if (this->pipe_size != 0) {
+        _setPipeSize(fd[STDIN_FD], this->pipe_size);
+    }
 
     pid_t src_pid;
     pid_t dest_pid;
 
-    src_pid = fork();
+    src_pid = _fork();
     if (src_pid == 0) {
         setpgrp();
         try {
@@ -795,22 +2540,24 @@ pid_t PipeCommand::execute() {
             close_pipe(fd);
             pid_t src_child = this->cmd_src->execute();
             if (src_child != DEFAULT_PROCESS_ID) {
-                waitpid(src_child, nullptr, WUNTRACED);
+                int status = 0;
+                _waitProcess(src_child, &status, WUNTRACED);
+                SmallShell::getInstance().setLastExitStatus(_exitCode(status));
             }
         }
         catch (SmashCmdError& err) {
             cerr << err.what() << endl;
-            exit(1);
+            _exitChild(1);
         } catch (SmashSysFailure& err) {
             perror(err.what());
-            exit(1);
+            _exitChild(1);
         }
-        exit(0);
+        _exitChild(SmallShell::getInstance().getLastExitStatus());
     } else if (src_pid < 0) {
         throw SmashSysFailure("fork failed");
     }
 
-    dest_pid = fork();
+    dest_pid = _fork();
     if (dest_pid == 0) {
         setpgrp();
         try {
@@ -821,17 +2568,19 @@ pid_t PipeCommand::execute() {
             close_pipe(fd);
             pid_t dest_child = this->cmd_dest->execute();
             if (dest_child != DEFAULT_PROCESS_ID) {
-                waitpid(dest_child, nullptr, WUNTRACED);
+                int status = 0;
+                _waitProcess(dest_child, &status, WUNTRACED);
+                SmallShell::getInstance().setLastExitStatus(_exitCode(status));
             }
         }
         catch (SmashCmdError& err) {
             cerr << err.what() << endl;
-            exit(1);
+            _exitChild(1);
         } catch (SmashSysFailure& err) {
             perror(err.what());
-            exit(1);
+            _exitChild(1);
         }
-        exit(0);
+        _exitChild(SmallShell::getInstance().getLastExitStatus());
     } else if (dest_pid < 0) {
         throw SmashSysFailure("fork failed");
         // TODO check if first fork succeeded and kill it if necessary (only if TA says we should do this)
@@ -839,11 +2588,11 @@ pid_t PipeCommand::execute() {
 
     close_pipe(fd);
 
-    bool src_fin = false, dest_fin = false;
-    while (!src_fin || !dest_fin) {
-        src_fin = src_fin || (waitpid(src_pid, nullptr, WNOHANG) == src_pid);
-        dest_fin = dest_fin || (waitpid(dest_pid, nullptr, WNOHANG) == dest_pid);
-    }
+    // the pipeline's exit status is the one of its last stage, like in bash
+    int status = 0;
+    _waitProcess(src_pid, &status, 0);
+    _waitProcess(dest_pid, &status, 0);
+    SmallShell::getInstance().setLastExitStatus(_exitCode(status));
 
     return DEFAULT_PROCESS_ID;
 }
@@ -858,98 +2607,129 @@ TailCommand::TailCommand(const char *cmd_line) : BuiltInCommand(cmd_line), line_
             throw SmashCmdError("tail: invalid arguments");
         }
         else if (!_isnumber(this->args[1]+1)) {
-            throw SmashCmdError("tail: invalid arguments");
-        }
-
-        this->line_count = (int)stoul(this->args[1]+1);
-        this->filename = this->args[2];
-    }
-
-    if (n_args == 2) {
-        this->filename = this->args[1];
-    }
-}
-
-ssize_t _fullread ( int fd, char *buff, size_t nbytes ) {
-    ssize_t rbytes = 1;
-    ssize_t sum_rbytes = 0;
-
-    while ( rbytes != 0 )
-    {
-        rbytes = read(fd, buff, nbytes);
-        if ( -1 == rbytes ) {
-            if ( errno == EINTR )
-                continue;
-            return -1;
-        }
-        nbytes -= rbytes;
-        buff += rbytes;
-        sum_rbytes += rbytes;
-    }
-    return sum_rbytes;
-}
-
-ssize_t _fullwrite( int fd, char *buff, size_t nbytes) {
-    ssize_t wbytes = 0;
-    ssize_t sum_wbytes = 0;
-
-    while ( nbytes > 0 )
-    {
-        wbytes = write(fd, buff, nbytes);
-        if ( -1 == wbytes ) {
-            if ( errno == EINTR )
-                continue;
-            return -1;
-        }
-        nbytes -= wbytes;
-        buff += wbytes;
-        sum_wbytes += wbytes;
+            throw SmashCmdError("tail: invalid arguments");
+        }
+
+        this->line_count = (int)stoul(this->args[1]+1);
+        this->filename = this->args[2];
     }
-    return sum_wbytes;
-}
 
+    if (n_args == 2) {
+        this->filename = this->args[1];
+    }
+}
 
+/*
+ * Scans the file backwards a TAIL_SCAN_BLOCK_SIZE block at a time (pread, no seeking back and forth)
+ * for the start of its last line_count lines.
+ */
 off_t findLastLinesPos(int fd, int line_count) {
-    char buff[BUFFER_SIZE];
-    ssize_t rbytes;
+    vector<char> buff(TAIL_SCAN_BLOCK_SIZE);
     off_t pos = lseek(fd, 0, SEEK_END);
     if (pos == -1) {
         throw SmashSysFailure("lseek failed");
     }
 
-    size_t bytes_to_read;
     // We want to see line_count newline chars ('\n') regardless of the last char in the file -
     // we don't care whether the last char is a newline, because we need to get line_count lines
     pos -= 1;
     while (pos > 0) {
-        if (pos - BUFFER_SIZE >= 0) {
-            bytes_to_read = BUFFER_SIZE;
-            pos = lseek(fd, pos - BUFFER_SIZE, SEEK_SET);
-        } else {
-            bytes_to_read = pos;
-            pos = lseek(fd, 0, SEEK_SET);
-        }
-        if (pos == -1) {
-            throw SmashSysFailure("lseek failed");
-        }
-        // we assume that read reads the whole BUFFER_SIZE bytes, if not - how should we handle that? try again? loop? ignore? TODO ask TA
-        rbytes = _fullread(fd, buff, bytes_to_read);
+        size_t bytes_to_read = (size_t)std::min(pos, (off_t)TAIL_SCAN_BLOCK_SIZE);
+        pos -= bytes_to_read;
+        ssize_t rbytes = pread(fd, buff.data(), bytes_to_read, pos);
         if (rbytes == -1) {
             throw SmashSysFailure("read failed");
         }
-        for (int i = ((int)rbytes - 1); i >= 0; i--) {
-            if (buff[i] == '\n') {
-                line_count -= 1;
-                if (line_count == 0) {
-                    return pos + i + 1; // pos + i is the exact position of the newline in the file, so we want the next char
-                }
+        const char* end = buff.data() + rbytes;
+        long newlines = std::count((const char*)buff.data(), end, '\n');
+        if (newlines < line_count) {
+            line_count -= newlines; // the start is further back, skip the block in one pass
+            continue;
+        }
+        const char* newline;
+        while ((newline = (const char*)memrchr(buff.data(), '\n', end - buff.data())) != nullptr) {
+            if (--line_count == 0) {
+                return pos + (newline - buff.data()) + 1; // the line starts right after the newline
             }
+            end = newline;
         }
     }
 
     return 0;
 }
 
+static const char* const COPY_METHOD_NAMES[] = {"none", "copy_file_range", "sendfile", "splice", "read/write"};
+
+// the kernel or the filesystem does not do this method for this pair of fds (O_APPEND gives EBADF)
+static bool _isCopyUnsupported(int err) {
+    return err == EINVAL || err == EXDEV || err == ENOSYS || err == EOPNOTSUPP || err == EBADF || err == ESPIPE;
+}
+
+/*
+ * Copies in_fd from its offset to its end into out_fd at its offset without the data passing through
+ * smash: copy_file_range between files (the filesystem may reflink or copy server-side), then
+ * sendfile from a file, then splice from or into a pipe. A method the fds do not allow hands over to
+ * the next one where it stopped. Returns the method that reached the end, or COPY_NONE when the rest
+ * is left to a buffer copy by the caller. Stops between chunks on ctrl-C.
+ */
+static CopyMethod _copyInKernel(int in_fd, int out_fd, uint64_t* copied) {
+    struct stat in_stat, out_stat;
+    if (fstat(in_fd, &in_stat) == -1 || fstat(out_fd, &out_stat) == -1) {
+        return COPY_NONE;
+    }
+    // files reporting no size (procfs, sysfs) would look empty to copy_file_range and sendfile
+    bool from_file = S_ISREG(in_stat.st_mode) && in_stat.st_size > 0;
+    bool via_pipe = S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode);
+    SmallShell& smash = SmallShell::getInstance();
+    for (CopyMethod method : {COPY_FILE_RANGE, COPY_SENDFILE, COPY_SPLICE}) {
+        if ((method == COPY_FILE_RANGE && !(from_file && S_ISREG(out_stat.st_mode))) ||
+            (method == COPY_SENDFILE && !from_file) || (method == COPY_SPLICE && !via_pipe)) {
+            continue;
+        }
+        while (!smash.fg_interrupted) {
+            ssize_t moved;
+            if (method == COPY_FILE_RANGE) {
+                moved = copy_file_range(in_fd, nullptr, out_fd, nullptr, COPY_CHUNK_SIZE, 0);
+            } else if (method == COPY_SENDFILE) {
+                moved = sendfile(out_fd, in_fd, nullptr, COPY_CHUNK_SIZE);
+            } else {
+                moved = splice(in_fd, nullptr, out_fd, nullptr, SPLICE_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+            }
+            if (moved == 0) {
+                return method;
+            }
+            if (moved > 0) {
+                *copied += moved;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (_isCopyUnsupported(errno)) {
+                break;
+            } else {
+                throw SmashSysFailure(string(COPY_METHOD_NAMES[method]) + " failed");
+            }
+        }
+        if (smash.fg_interrupted) {
+            return method;
+        }
+    }
+    return COPY_NONE;
+}
+
+/*
+ * Copies the rest of in_fd to wherever cout writes (a pipe, a file, maybe a terminal) inside the
+ * kernel, after what was printed before. Returns false when cout is captured in memory or the rest
+ * is left to be copied through a buffer.
+ */
+static bool _copyToStdout(int in_fd) {
+    int out_fd = _streamFd(cout);
+    if (out_fd == -1) {
+        return false;
+    }
+    cout.flush();
+    uint64_t copied = 0;
+    return _copyInKernel(in_fd, out_fd, &copied) != COPY_NONE;
+}
+
 pid_t TailCommand::execute() {
     
     if (this->line_count == 0) {
@@ -960,25 +2740,31 @@ pid_t TailCommand::execute() {
     if (-1 == fd) {
         throw SmashSysFailure("open failed");
     }
+    FdGuard input(fd); // closed on every throw below
 
     off_t pos = findLastLinesPos(fd, this->line_count);
     if (-1 == lseek(fd, pos, SEEK_SET)) {
         throw SmashSysFailure("lseek failed");
     }
-    char buff[BUFFER_SIZE];
+    if (_copyToStdout(fd)) {
+        return DEFAULT_PROCESS_ID;
+    }
+    vector<char> buff(TAIL_SCAN_BLOCK_SIZE);
     ssize_t rbytes = -1;
     while (rbytes != 0) {
-        rbytes = _fullread(fd, buff, BUFFER_SIZE);
+        rbytes = _fullread(fd, buff.data(), buff.size());
         if (rbytes == -1) {
             throw SmashSysFailure("read failed");
         }
 
-        if (-1 == _fullwrite(STDOUT_FD, buff, rbytes)) {
+        // through cout: batched with the rest of the output, and capturable by $(...)
+        if (!cout.write(buff.data(), rbytes)) {
+            cout.clear();
             throw SmashSysFailure("write failed");
         }
     }
 
-    if (-1 == close(fd)) {
+    if (-1 == close(input.release())) {
         throw SmashSysFailure("close failed");
     }
 
@@ -1001,16 +2787,23 @@ TouchCommand::TouchCommand(const char *cmd_line) : BuiltInCommand(cmd_line), tim
         time_str = time_str.substr(pos+1);
     }
 
-    tm time_obj{ .tm_sec = date_parts[0], .tm_min = date_parts[1], .tm_hour = date_parts[2],
-                .tm_mday = date_parts[3], .tm_mon = date_parts[4] - 1, .tm_year = (date_parts[5] - 1900),
-                .tm_wday = 0, .tm_yday = 0, .tm_isdst = -1, .tm_gmtoff = 0 };
+    tm time_obj{};
+    time_obj.tm_sec = date_parts[0];
+    time_obj.tm_min = date_parts[1];
+    time_obj.tm_hour = date_parts[2];
+    time_obj.tm_mday = date_parts[3];
+    time_obj.tm_mon = date_parts[4] - 1;
+    time_obj.tm_year = date_parts[5] - 1900;
+    time_obj.tm_isdst = -1;
 
     this->timestamp = mktime(&time_obj);
 //    assert(this->timestamp != -1);
 }
 
 pid_t TouchCommand::execute() {
-    utimbuf times{ .actime = this->timestamp, .modtime = this->timestamp };
+    utimbuf times{};
+    times.actime = this->timestamp;
+    times.modtime = this->timestamp;
     if ( -1 == utime(this->filename, &times) ) {
         throw SmashSysFailure("utime failed");
     }
@@ -1019,6 +2812,639 @@ pid_t TouchCommand::execute() {
 }
 
 
+///////////////////Streaming built-ins start//////////////////////////
+
+// a head count: digits with an optional K, M or G suffix
+static bool _parseCount(const char* str, uint64_t* count) {
+    size_t size;
+    if (!isdigit((unsigned char)str[0]) || !_parseSize(str, &size)) {
+        return false;
+    }
+    *count = size;
+    return true;
+}
+
+// one read, retried on EINTR: a pipeline stage passes on whatever arrived instead of waiting for more
+static ssize_t _readSome(int fd, char* buff, size_t nbytes) {
+    ssize_t rbytes;
+    do {
+        rbytes = read(fd, buff, nbytes);
+    } while (rbytes == -1 && errno == EINTR);
+    return rbytes;
+}
+
+static void _emit(const char* data, size_t len) {
+    if (!cout.write(data, len)) {
+        cout.clear();
+        throw SmashSysFailure("write failed");
+    }
+}
+
+static void _printInputError(const string& tool, const string& file) {
+    int err = errno;
+    cout.flush(); // keeps the order of output and errors
+    cerr << ERROR_PREFIX << tool << ": " << file << ": " << strerror(err) << endl;
+}
+
+// GNU wc in the C locale: whitespace ends a word, a printable character starts one, other bytes do neither
+static uint64_t _countWords(const char* data, size_t len, bool& in_word) {
+    uint64_t words = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = data[i];
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            in_word = false;
+        } else if (c > ' ' && c < 0x7f) {
+            words += !in_word;
+            in_word = true;
+        }
+    }
+    return words;
+}
+
+StreamCommand::StreamCommand(const char* cmd_line) : BuiltInCommand(cmd_line) {
+    // quotes, variables, "&" and the like are left to the real tool under bash
+    this->supported = _isSimpleCommand(cmd_line);
+}
+
+vector<string> StreamCommand::inputs() const {
+    return (this->files.empty() ? vector<string>{STREAM_STDIN_NAME} : this->files);
+}
+
+int StreamCommand::openInput(const string& tool, const string& file) const {
+    if (file == STREAM_STDIN_NAME) {
+        return STDIN_FD;
+    }
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        _printInputError(tool, file);
+    }
+    return fd;
+}
+
+void StreamCommand::closeInput(int fd) const {
+    if (fd != STDIN_FD) {
+        close(fd);
+    }
+}
+
+CatCommand::CatCommand(const char* cmd_line) : StreamCommand(cmd_line) {
+    for (int i = 1; i < this->n_args; i++) {
+        string arg = this->args[i];
+        if (arg.size() > 1 && arg[0] == '-') {
+            this->supported = false; // -n, -A, ...
+            return;
+        }
+        this->files.push_back(arg);
+    }
+}
+
+pid_t CatCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    smash.fg_interrupted = 0;
+    this->buff.resize(STREAM_BUFFER_SIZE);
+    int status = 0;
+    for (const string& file : this->inputs()) {
+        int fd = this->openInput("cat", file);
+        if (fd == -1) {
+            status = 1;
+            continue;
+        }
+        if (!_copyToStdout(fd)) {
+            ssize_t rbytes = 0;
+            while (!smash.fg_interrupted && (rbytes = _readSome(fd, this->buff.data(), this->buff.size())) > 0) {
+                _emit(this->buff.data(), rbytes);
+            }
+            if (rbytes == -1) {
+                _printInputError("cat", file);
+                status = 1;
+            }
+        }
+        this->closeInput(fd);
+        if (smash.fg_interrupted) {
+            break;
+        }
+    }
+    smash.setLastExitStatus(smash.fg_interrupted ? EXIT_INTERRUPTED : status);
+    return DEFAULT_PROCESS_ID;
+}
+
+HeadCommand::HeadCommand(const char* cmd_line) : StreamCommand(cmd_line) {
+    bool options_done = false;
+    for (int i = 1; i < this->n_args && this->supported; i++) {
+        string arg = this->args[i];
+        if (options_done || arg == STREAM_STDIN_NAME || arg[0] != '-') {
+            this->files.push_back(arg);
+            continue;
+        }
+        if (arg == "--") {
+            options_done = true;
+            continue;
+        }
+        if (i == 1 && _isnumber(this->args[i] + 1)) { // head -5
+            this->count = stoull(arg.substr(1));
+            continue;
+        }
+        if (arg[1] == 'n' || arg[1] == 'c') {
+            this->count_bytes = (arg[1] == 'c');
+            const char* value = (arg.size() > 2 ? this->args[i] + 2 : (i + 1 < this->n_args ? this->args[++i] : ""));
+            if (_parseCount(value, &this->count)) {
+                continue;
+            }
+        }
+        this->supported = false; // other options and counts (negative ones included)
+    }
+}
+
+pid_t HeadCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    smash.fg_interrupted = 0;
+    this->buff.resize(STREAM_BUFFER_SIZE);
+    int status = 0;
+    vector<string> names = this->inputs();
+    bool first_header = true;
+    for (const string& file : names) {
+        if (smash.fg_interrupted) {
+            break;
+        }
+        int fd = this->openInput("head", file);
+        if (fd == -1) {
+            status = 1;
+            continue;
+        }
+        if (names.size() > 1) {
+            string header = string(first_header ? "" : "\n") + "==> "
+                            + (file == STREAM_STDIN_NAME ? "standard input" : file) + " <==\n";
+            _emit(header.data(), header.size());
+            first_header = false;
+        }
+        uint64_t left = this->count;
+        ssize_t rbytes = 0;
+        while (left > 0 && !smash.fg_interrupted && (rbytes = _readSome(fd, this->buff.data(), this->buff.size())) > 0) {
+            size_t take = rbytes;
+            if (this->count_bytes) {
+                take = min((uint64_t)take, left);
+                left -= take;
+            } else {
+                const char* last = _findNthByte(this->buff.data(), rbytes, '\n', left);
+                if (last != nullptr) {
+                    take = last + 1 - this->buff.data();
+                    left = 0;
+                } else {
+                    left -= _countByte(this->buff.data(), rbytes, '\n');
+                }
+            }
+            _emit(this->buff.data(), take);
+        }
+        if (rbytes == -1) {
+            _printInputError("head", file);
+            status = 1;
+        }
+        this->closeInput(fd);
+    }
+    smash.setLastExitStatus(smash.fg_interrupted ? EXIT_INTERRUPTED : status);
+    return DEFAULT_PROCESS_ID;
+}
+
+WcCommand::WcCommand(const char* cmd_line) : StreamCommand(cmd_line) {
+    bool options_done = false;
+    for (int i = 1; i < this->n_args && this->supported; i++) {
+        string arg = this->args[i];
+        if (options_done || arg == STREAM_STDIN_NAME || arg[0] != '-') {
+            this->files.push_back(arg);
+            continue;
+        }
+        if (arg == "--") {
+            options_done = true;
+            continue;
+        }
+        for (size_t c = 1; c < arg.size(); c++) {
+            switch (arg[c]) {
+                case 'l': this->count_lines = true; break;
+                case 'w': this->count_words = true; break;
+                case 'c': this->count_bytes = true; break;
+                default: this->supported = false; // -m, -L, long options
+            }
+        }
+    }
+    if (!this->count_lines && !this->count_words && !this->count_bytes) {
+        this->count_lines = this->count_words = this->count_bytes = true;
+    }
+}
+
+string WcCommand::formatCounts(const Counts_t& counts, int width, const string& name) const {
+    string line;
+    auto add = [&](uint64_t value) {
+        string num = to_string(value);
+        if (!line.empty()) {
+            line += ' ';
+        }
+        line += string(max(0, width - (int)num.size()), ' ') + num;
+    };
+    if (this->count_lines) {
+        add(counts.lines);
+    }
+    if (this->count_words) {
+        add(counts.words);
+    }
+    if (this->count_bytes) {
+        add(counts.bytes);
+    }
+    if (!name.empty()) {
+        line += " " + name;
+    }
+    return line + '\n';
+}
+
+pid_t WcCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    smash.fg_interrupted = 0;
+    this->buff.resize(STREAM_BUFFER_SIZE);
+    vector<string> names = this->inputs();
+
+    /*
+     * The column width GNU wc picks before counting: the digits of the regular files' total size, at
+     * least WC_MIN_PIPE_WIDTH with a pipe or terminal among the inputs, 1 for a single count of a
+     * single input. Inputs that cannot be looked at do not count.
+     */
+    int width = 1;
+    if (names.size() > 1 || this->count_lines + this->count_words + this->count_bytes > 1) {
+        uint64_t regular_size = 0;
+        int min_width = 1;
+        for (const string& file : names) {
+            struct stat st;
+            int ret = (file == STREAM_STDIN_NAME ? fstat(STDIN_FD, &st) : stat(file.c_str(), &st));
+            if (ret == -1) {
+                continue;
+            }
+            if (S_ISREG(st.st_mode)) {
+                regular_size += st.st_size;
+            } else {
+                min_width = WC_MIN_PIPE_WIDTH;
+            }
+        }
+        for (; regular_size >= 10; regular_size /= 10) {
+            width++;
+        }
+        width = max(width, min_width);
+    }
+
+    int status = 0;
+    Counts_t total;
+    for (const string& file : names) {
+        if (smash.fg_interrupted) {
+            break;
+        }
+        int fd = this->openInput("wc", file);
+        if (fd == -1) {
+            status = 1;
+            continue;
+        }
+        Counts_t counts;
+        bool in_word = false;
+        ssize_t rbytes = 0;
+        while (!smash.fg_interrupted && (rbytes = _readSome(fd, this->buff.data(), this->buff.size())) > 0) {
+            counts.bytes += rbytes;
+            counts.lines += _countByte(this->buff.data(), rbytes, '\n');
+            if (this->count_words) {
+                counts.words += _countWords(this->buff.data(), rbytes, in_word);
+            }
+        }
+        if (rbytes == -1) {
+            _printInputError("wc", file); // a directory still gets its (zero) line, as with GNU wc
+            status = 1;
+        }
+        this->closeInput(fd);
+        string line = this->formatCounts(counts, width, (this->files.empty() ? "" : file));
+        _emit(line.data(), line.size());
+        total.lines += counts.lines;
+        total.words += counts.words;
+        total.bytes += counts.bytes;
+    }
+    if (names.size() > 1 && !smash.fg_interrupted) {
+        string line = this->formatCounts(total, width, "total");
+        _emit(line.data(), line.size());
+    }
+    smash.setLastExitStatus(smash.fg_interrupted ? EXIT_INTERRUPTED : status);
+    return DEFAULT_PROCESS_ID;
+}
+
+GrepCommand::GrepCommand(const char* cmd_line) : StreamCommand(cmd_line) {
+    bool fixed = false;
+    bool options_done = false;
+    bool have_pattern = false;
+    for (int i = 1; i < this->n_args && this->supported; i++) {
+        string arg = this->args[i];
+        if (!options_done && arg == "--") {
+            options_done = true;
+            continue;
+        }
+        if (!options_done && arg.size() > 1 && arg[0] == '-') {
+            for (size_t c = 1; c < arg.size(); c++) {
+                switch (arg[c]) {
+                    case 'F': fixed = true; break;
+                    case 'v': this->invert = true; break;
+                    case 'c': this->count_only = true; break;
+                    case 'n': this->line_numbers = true; break;
+                    default: this->supported = false; // -i, -E, -r, long options
+                }
+            }
+            continue;
+        }
+        if (!have_pattern) {
+            this->pattern = arg;
+            have_pattern = true;
+        } else {
+            this->files.push_back(arg);
+        }
+    }
+    // without -F, only a pattern that matches itself as a basic regular expression
+    if (!have_pattern || (!fixed && this->pattern.find_first_of(".[]*^$\\") != string::npos)) {
+        this->supported = false;
+    }
+}
+
+// selects the whole lines in [start, end)
+void GrepCommand::selectLines(Scan_t& scan, const char* start, const char* end) {
+    if (start == end) {
+        return;
+    }
+    if (scan.binary && !this->count_only) {
+        scan.binary_match = true; // reported instead of printed, and the rest of the file does not matter
+        scan.selected++;
+        return;
+    }
+    uint64_t n_lines = _countByte(start, end - start, '\n');
+    if (!this->count_only && scan.prefix.empty() && !this->line_numbers) {
+        _emit(start, end - start); // a whole block of lines in one write
+    } else if (!this->count_only) {
+        uint64_t line_no = scan.line_no;
+        for (const char* line = start; line < end;) {
+            const char* next = (const char*)memchr(line, '\n', end - line) + 1;
+            string head = scan.prefix + (this->line_numbers ? to_string(++line_no) + ":" : "");
+            _emit(head.data(), head.size());
+            _emit(line, next - line);
+            line = next;
+        }
+    }
+    scan.selected += n_lines;
+    scan.line_no += n_lines;
+}
+
+/*
+ * Scans the whole lines in [start, end): each match is found by one search over the rest of the
+ * range and only then widened to its line, so a stretch without matches costs a single pass. Returns
+ * false once the rest of the file does not matter (a match in a binary file).
+ */
+bool GrepCommand::scanLines(Scan_t& scan, const char* start, const char* end) {
+    if (!scan.binary && memchr(start, '\0', end - start) != nullptr) {
+        scan.binary = true;
+    }
+    const char* pos = start;
+    while (pos < end && !scan.binary_match) {
+        const char* match = _findBytes(pos, end - pos, this->pattern.data(), this->pattern.size());
+        const char* line_start = end;
+        const char* line_end = end;
+        if (match != nullptr) {
+            const char* prev_nl = (const char*)memrchr(pos, '\n', match - pos);
+            line_start = (prev_nl != nullptr ? prev_nl + 1 : pos);
+            line_end = (const char*)memchr(match, '\n', end - match) + 1;
+        }
+        // the lines before the matching one do not match
+        if (this->invert) {
+            this->selectLines(scan, pos, line_start);
+        } else {
+            scan.line_no += _countByte(pos, line_start - pos, '\n');
+        }
+        if (match == nullptr) {
+            break;
+        }
+        if (!this->invert) {
+            this->selectLines(scan, line_start, line_end);
+        } else {
+            scan.line_no++;
+        }
+        pos = line_end;
+    }
+    return !scan.binary_match;
+}
+
+pid_t GrepCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    smash.fg_interrupted = 0;
+    this->buff.resize(STREAM_BUFFER_SIZE);
+    vector<string> names = this->inputs();
+    bool error = false;
+    uint64_t selected = 0;
+    for (const string& file : names) {
+        if (smash.fg_interrupted) {
+            break;
+        }
+        string name = (file == STREAM_STDIN_NAME ? "(standard input)" : file);
+        int fd = this->openInput("grep", file);
+        if (fd == -1) {
+            error = true;
+            continue;
+        }
+        Scan_t scan;
+        scan.prefix = (names.size() > 1 ? name + ":" : "");
+        size_t used = 0; // an incomplete last line kept at the start of the buffer
+        bool done = false;
+        ssize_t rbytes = 0;
+        while (!done && !smash.fg_interrupted) {
+            if (used == this->buff.size()) {
+                this->buff.resize(this->buff.size() * 2); // a line longer than the buffer
+            }
+            rbytes = _readSome(fd, this->buff.data() + used, this->buff.size() - used);
+            if (rbytes <= 0) {
+                break;
+            }
+            char* start = this->buff.data();
+            const char* last_nl = (const char*)memrchr(start + used, '\n', rbytes);
+            used += rbytes;
+            if (last_nl == nullptr) {
+                continue;
+            }
+            done = !this->scanLines(scan, start, last_nl + 1);
+            used = start + used - (last_nl + 1);
+            memmove(start, last_nl + 1, used);
+        }
+        if (rbytes == -1) {
+            _printInputError("grep", file);
+            error = true;
+        } else if (!done && used > 0 && !smash.fg_interrupted) {
+            // a last line without a newline is printed with one, as GNU grep does
+            if (used == this->buff.size()) {
+                this->buff.resize(used + 1);
+            }
+            this->buff[used++] = '\n';
+            this->scanLines(scan, this->buff.data(), this->buff.data() + used);
+        }
+        this->closeInput(fd);
+        if (this->count_only && rbytes != -1) {
+            string line = scan.prefix + to_string(scan.selected) + '\n';
+            _emit(line.data(), line.size());
+        }
+        if (scan.binary_match) {
+            cout.flush();
+            cerr << "grep: " << name << ": binary file matches" << endl;
+        }
+        selected += scan.selected;
+    }
+    int status = (error ? EXIT_GREP_ERROR : (selected > 0 ? 0 : 1));
+    smash.setLastExitStatus(smash.fg_interrupted ? EXIT_INTERRUPTED : status);
+    return DEFAULT_PROCESS_ID;
+}
+
+CpCommand::CpCommand(const char* cmd_line) : StreamCommand(cmd_line) {
+    bool options_done = false;
+    for (int i = 1; i < this->n_args && this->supported; i++) {
+        string arg = this->args[i];
+        if (options_done || arg == STREAM_STDIN_NAME || arg[0] != '-') {
+            this->files.push_back(arg);
+        } else if (arg == "--") {
+            options_done = true;
+        } else if (arg == "-v") {
+            this->verbose = true;
+        } else if (arg == "--stats") {
+            this->stats = true;
+        } else {
+            this->supported = false; // -r, -p, -a, ...
+        }
+    }
+    if (this->files.size() < 2) {
+        this->supported = false; // the real cp explains the missing operand
+        return;
+    }
+    this->dest = this->files.back();
+    this->files.pop_back();
+}
+
+static void _printCpError(const string& msg, int err) {
+    cout.flush();
+    cerr << ERROR_PREFIX << "cp: " << msg << (err != 0 ? string(": ") + strerror(err) : "") << endl;
+}
+
+bool CpCommand::copyFile(const string& src, const string& target, uint64_t* copied, CopyMethod* method) {
+    struct stat src_stat, target_stat;
+    if (stat(src.c_str(), &src_stat) == -1) {
+        _printCpError("cannot stat '" + src + "'", errno);
+        return false;
+    }
+    if (S_ISDIR(src_stat.st_mode)) {
+        _printCpError("-r not specified; omitting directory '" + src + "'", 0);
+        return false;
+    }
+    if (stat(target.c_str(), &target_stat) == 0 && target_stat.st_dev == src_stat.st_dev &&
+        target_stat.st_ino == src_stat.st_ino) {
+        _printCpError("'" + src + "' and '" + target + "' are the same file", 0);
+        return false;
+    }
+    int in_fd = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd == -1) {
+        _printCpError("cannot open '" + src + "' for reading", errno);
+        return false;
+    }
+    // a new file gets the source's permissions (less the umask), an existing one keeps its own
+    int out_fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, src_stat.st_mode & 0777);
+    if (out_fd == -1) {
+        _printCpError("cannot create regular file '" + target + "'", errno);
+        close(in_fd);
+        return false;
+    }
+    bool ok = true;
+    uint64_t file_copied = 0;
+    SmallShell& smash = SmallShell::getInstance();
+    try {
+        *method = _copyInKernel(in_fd, out_fd, &file_copied);
+        if (*method == COPY_NONE) {
+            *method = COPY_BUFFER;
+            this->buff.resize(STREAM_BUFFER_SIZE);
+            ssize_t rbytes = 0;
+            while (!smash.fg_interrupted && (rbytes = _readSome(in_fd, this->buff.data(), this->buff.size())) > 0) {
+                if (_fullwrite(out_fd, this->buff.data(), rbytes) == -1) {
+                    throw SmashSysFailure("write failed");
+                }
+                file_copied += rbytes;
+            }
+            if (rbytes == -1) {
+                throw SmashSysFailure("read failed");
+            }
+        }
+    } catch (SmashSysFailure&) {
+        _printCpError("error copying '" + src + "' to '" + target + "'", errno);
+        ok = false;
+    }
+    close(in_fd);
+    if (close(out_fd) == -1 && ok) { // delayed write errors (NFS, a full disk)
+        _printCpError("failed to close '" + target + "'", errno);
+        ok = false;
+    }
+    // ctrl-C left the target truncated: not a copy, like the real cp killed by SIGINT it says nothing more
+    if (smash.fg_interrupted) {
+        ok = false;
+    }
+    if (ok) {
+        *copied += file_copied;
+    }
+    return ok;
+}
+
+pid_t CpCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    smash.fg_interrupted = 0;
+    struct stat dest_stat;
+    bool into_dir = (stat(this->dest.c_str(), &dest_stat) == 0 && S_ISDIR(dest_stat.st_mode));
+    if (this->files.size() > 1 && !into_dir) {
+        _printCpError("target '" + this->dest + "' is not a directory", 0);
+        smash.setLastExitStatus(1);
+        return DEFAULT_PROCESS_ID;
+    }
+
+    int status = 0;
+    uint64_t copied = 0;
+    size_t n_copied = 0;
+    bool methods_used[COPY_BUFFER + 1] = {};
+    uint64_t start_ns = _monotonicNs();
+    for (const string& src : this->files) {
+        if (smash.fg_interrupted) {
+            break;
+        }
+        string target = this->dest;
+        if (into_dir) {
+            target += (target.back() == '/' ? "" : "/") + src.substr(src.find_last_of('/') + 1);
+        }
+        CopyMethod method = COPY_NONE;
+        if (!this->copyFile(src, target, &copied, &method)) {
+            status = 1;
+            continue;
+        }
+        n_copied++;
+        methods_used[method] = true;
+        if (this->verbose) {
+            cout << "'" << src << "' -> '" << target << "'\n";
+        }
+    }
+
+    if (this->stats) {
+        double secs = (double)(_monotonicNs() - start_ns) / 1e9;
+        string methods;
+        for (int method = COPY_FILE_RANGE; method <= COPY_BUFFER; method++) {
+            if (methods_used[method]) {
+                methods += (methods.empty() ? "" : ", ") + string(COPY_METHOD_NAMES[method]);
+            }
+        }
+        ostringstream out;
+        out << fixed << "cp: " << n_copied << " files, " << copied << " bytes in " << setprecision(3) << secs
+            << " s, " << setprecision(1) << (secs > 0 ? (double)copied / (1024 * 1024) / secs : 0.0) << " MB/s"
+            << (methods.empty() ? "" : " (" + methods + ")") << '\n';
+        cout << out.str();
+    }
+    smash.setLastExitStatus(smash.fg_interrupted ? EXIT_INTERRUPTED : status);
+    return DEFAULT_PROCESS_ID;
+}
+
+///////////////////Streaming built-ins end//////////////////////////
+
 ///////////////////TimeOutManager start//////////////////////////
 
 bool TimeOutManager::TimeOutEntry::operator< (TimeOutEntry const &obj) {
@@ -1041,7 +3467,8 @@ void TimeOutManager::SetAlarm(pid_t pid_to_insert, time_t duration) {
         throw SmashSysFailure("time failed");
     }
 
-    TimeOutEntry curr(pid_to_insert, curr_time, curr_time + duration);
+    // the command was just forked and is not reaped before the alarm is set, so the pid is still its own
+    TimeOutEntry curr(pid_to_insert, _pidfdOpen(pid_to_insert), curr_time, curr_time + duration);
     if ( time_out_heap.empty() || time_out_heap[0] < curr ) {
         alarm(duration);
     }
@@ -1049,6 +3476,14 @@ void TimeOutManager::SetAlarm(pid_t pid_to_insert, time_t duration) {
     std::push_heap(time_out_heap.begin(), time_out_heap.end());
 }
 
+TimeOutManager::~TimeOutManager() {
+    for (const TimeOutEntry& entry : this->time_out_heap) {
+        if (entry.pidfd != -1) {
+            close(entry.pidfd);
+        }
+    }
+}
+
 
 
 ///////////////////TimeOutManager end//////////////////////////
@@ -1065,11 +3500,9 @@ AlarmCommand::AlarmCommand(const char* cmd_line , TimeOutManager* time_out_manag
     
     this->duration = num;
 
-    size_t index_of_sub = string(cmd_line).find(args[2]);
-    string sub_string = string(cmd_line).substr(index_of_sub);
-
+    // the command as written, its expanded text still literal
     SmallShell& smash = SmallShell::getInstance();
-    this->cmd = smash.CreateCommand(_trim(sub_string).c_str());
+    this->cmd = smash.CreateCommand(_skipWords(cmd_line, 2).c_str());
     this->is_BG = this->cmd->is_BG; //just in case, should be the same
 }
 
@@ -1080,6 +3513,73 @@ pid_t AlarmCommand::execute() {
     return inner_command_pid; //should be pid of an external command
 }
 
+RunCommand::RunCommand(const char* cmd_line) : Command(cmd_line) {
+    int i = 1;
+    while (i < this->n_args) {
+        if (string(this->args[i]) == "--reset") {
+            this->reset = true;
+            i++;
+            continue;
+        }
+        if (string(this->args[i]) == "--") {
+            i++;
+            break;
+        }
+        int used = this->attrs.parseOption(this->args.data(), this->n_args, i);
+        if (used == 0) {
+            break;
+        }
+        i += used;
+    }
+    SmallShell& smash = SmallShell::getInstance();
+    for (const auto& limit : this->attrs.cgroupLimits()) {
+        string controller = limit.first.substr(0, limit.first.find('.'));
+        if (!smash.cgroups.enabled()) {
+            throw SmashCmdError("run: cgroup limits need smash --cgroups");
+        } else if (!smash.cgroups.hasController(controller)) {
+            throw SmashCmdError("run: the " + controller + " controller is not available");
+        }
+    }
+    if (i < this->n_args) {
+        if (this->reset) {
+            throw SmashCmdError("run: --reset takes no command");
+        }
+        this->command = _skipWords(this->raw_cmd_line, i);
+    } else {
+        this->is_BG = false;
+    }
+}
+
+pid_t RunCommand::execute() {
+    SmallShell& smash = SmallShell::getInstance();
+    if (this->command.empty()) {
+        if (this->reset) {
+            smash.spawn_attrs = SpawnAttrs();
+        }
+        smash.spawn_attrs.merge(this->attrs);
+        if (this->n_args == 1) {
+            string desc = smash.spawn_attrs.describe();
+            _writeOutput(desc.empty() ? desc : desc + "\n");
+        }
+        return DEFAULT_PROCESS_ID;
+    }
+    // the attributes are read when the command is created (built-ins give way to the real tools) and
+    // in its children, so they stay on the shell for exactly that long
+    SpawnAttrs saved = smash.spawn_attrs;
+    smash.spawn_attrs.merge(this->attrs);
+    this->spawn_desc = smash.spawn_attrs.describe();
+    pid_t pid;
+    try {
+        CommandPtr inner = smash.CreateCommand(this->command.c_str());
+        pid = (inner == nullptr ? DEFAULT_PROCESS_ID : inner->execute());
+    } catch (SmashError&) {
+        smash.spawn_attrs = saved;
+        throw;
+    }
+    smash.spawn_attrs = saved;
+    return pid;
+}
+
 
 
 void TimeOutManager::SetNextAlarm() {
@@ -1091,7 +3591,8 @@ void TimeOutManager::SetNextAlarm() {
     alarm(int(ceil(diff)));/////maybe a lot more complicated than this. TODO
 }
 
-pid_t TimeOutManager::RemoveTimedOut() {
+pid_t TimeOutManager::RemoveTimedOut(int* pidfd) {
+    *pidfd = -1;
     if (this->time_out_heap.empty())
         return DEFAULT_PROCESS_ID;
 
@@ -1100,6 +3601,7 @@ pid_t TimeOutManager::RemoveTimedOut() {
     if ( calcDiffTimeRemaining(this->time_out_heap[0].end_timestamp) < ALARM_THRESHOLD ){
         pop_heap(time_out_heap.begin() , time_out_heap.end()); //moves the largest to the end
         pid_to_retrun = time_out_heap.back().pid;
+        *pidfd = time_out_heap.back().pidfd;
         time_out_heap.pop_back();
     }
     return pid_to_retrun;
@@ -9,27 +9,64 @@
 #include <cstring>
 #include <ctime>
 #include <memory>
+#include <string>
+#include <list>
+#include <unordered_map>
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <math.h> 
+#include <csignal>
+#include "errors.h"
+#include "proc.h"
+#include "history.h"
+#include "variables.h"
+#include "zygote.h"
+#include "capture.h"
+#include "io.h"
+#include "spawn_attrs.h"
+#include "cgroups.h"
+#include "script.h"
+#include "engine.h"
 
 
-#define COMMAND_ARGS_MAX_LENGTH (200)
-#define COMMAND_MAX_ARGS (20)
 #define DEFAULT_PROMPT "smash"
 #define MSG_PREFIX "smash: "
-#define ERROR_PREFIX "smash error: "
 #define DEFAULT_JOB_ID (-1)
 #define DEFAULT_PROCESS_ID (-1)
-#define STDIN_FD (0)
-#define STDOUT_FD (1)
-#define STDERR_FD (2)
 #define DEFAULT_TAIL_COUNT (10)
+#define TAIL_SCAN_BLOCK_SIZE (64 * 1024)
 #define BUFFER_SIZE (20)
 #define IS_NUMBER true
 #define ALARM_THRESHOLD (0.5)
+#define FINISHED_JOBS_HISTORY (64)
+#define QUIT_TERM_GRACE_MS (500)
+#define QUIT_KILL_DEADLINE_MS (3000)
+#define SIGNAL_POLL_INTERVAL_MS (100)
+#define SHELL_SPECIAL_CHARS "|&;<>()$`\\\"'{}~#"
+#define EXIT_NOT_EXECUTABLE (126)
+#define EXIT_NOT_FOUND (127)
+#define CAPTURE_READ_SIZE (64 * 1024)
+#define PARALLEL_ARGS_SEPARATOR ":::"
+#define PARALLEL_PLACEHOLDER "{}"
+#define PARALLEL_MAX_EXIT_STATUS (101)
+#define PIPE_SIZE_VAR "SMASH_PIPE_SIZE"
+#define PIPE_MAX_SIZE_FILE "/proc/sys/fs/pipe-max-size"
+#define SPLICE_CHUNK_SIZE (1024 * 1024)
+#define COPY_CHUNK_SIZE (64 * 1024 * 1024)
+#define STREAM_BUFFER_SIZE (256 * 1024)
+#define STREAM_STDIN_NAME "-"
+#define DEFAULT_HEAD_COUNT (10)
+#define WC_MIN_PIPE_WIDTH (7)
+#define EXIT_GREP_ERROR (2)
+#define EXIT_INTERRUPTED (130)
+#define EXIT_SYNTAX_ERROR (2)
+#define COMMAND_CACHE_SIZE (1024)
+#define COMMAND_CACHE_SEEN_SLOTS (4096)
 
 typedef int job_id;
 enum JOB_STATUS {UNFINISHED, STOPPED};
+// how a file built-in moved the data, COPY_NONE: not done yet
+enum CopyMethod {COPY_NONE, COPY_FILE_RANGE, COPY_SENDFILE, COPY_SPLICE, COPY_BUFFER};
 
 using std::string;
 
@@ -37,34 +74,27 @@ using std::string;
 class JobsList;
 class TimeOutManager; 
 
-class SmashError : public std::exception {
-    const string msg;
-public:
-    const char* what() const noexcept override;
-    explicit SmashError(const string& msg);
-};
-
-class SmashCmdError : public SmashError {
-public:
-    explicit SmashCmdError(const string& msg) : SmashError(msg) {}
-};
-
-class SmashSysFailure : public SmashError {
-public:
-    explicit SmashSysFailure(const string& msg) : SmashError(msg) {}
-};
-
 class Command {
 protected:
-    char* args[COMMAND_MAX_ARGS];
+    std::vector<char*> args; // nullptr terminated, usable as argv
     int n_args;
-    char cmd_line[COMMAND_ARGS_MAX_LENGTH];
-    char raw_cmd_line[COMMAND_ARGS_MAX_LENGTH];
+    string cmd_line;     // without the trailing &
+    string raw_cmd_line;
+    string shown_line;   // raw_cmd_line with its expanded text decoded, empty if it has none
 public:
     bool is_BG;
+    bool capture_output = false; // started with "&!"
+    string spawn_desc;           // the spawn attributes it was started with, shown by jobs -l
+    JobCgroupPtr cgroup;         // the cgroup its processes joined under --cgroups, else nullptr
     explicit Command(const char* cmd_line);
     virtual ~Command();
     virtual pid_t execute() = 0;
+    // built-ins that change smash itself run in a child when their output is captured by $(...)
+    virtual bool mutatesShell() const { return false; }
+    // built-ins that keep nothing from one execute() to the next, so their parse can be cached by line
+    virtual bool reusable() const { return false; }
+    // as typed, expanded values included: for messages, so it never allocates (signal handlers use it)
+    const char* getRawCmdLine() const { return (shown_line.empty() ? raw_cmd_line : shown_line).c_str(); }
     friend std::ostream& operator<<(std::ostream& os, const Command& cm);
 };
 
@@ -81,6 +111,10 @@ public:
     explicit ExternalCommand(const char* cmd_line);
     virtual ~ExternalCommand() {}
     pid_t execute() override;
+    // the child half of execute(): execs the command in the calling (already forked) process
+    [[noreturn]] void execInPlace();
+    // starts the command through the zygote with out_fd as stdout, -1 if it is not running or failed
+    pid_t launchThroughZygote(int out_fd);
 };
 
 /*TimeOutCommand*/
@@ -94,11 +128,32 @@ public:
     pid_t execute() override;
 };
 
+/*
+ * run [--cpus LIST] [--nice N] [--ionice CLASS[:LEVEL]] [--rlimit-as|cpu|nofile N] [command]
+ * With a command, starts it with these attributes on top of the shell defaults. Without one, the
+ * options become the defaults (--reset clears them first), and a bare "run" prints them.
+ */
+class RunCommand : public Command {
+    SpawnAttrs attrs;
+    bool reset = false;
+    string command;      // the rest of the line, "&" included
+public:
+    explicit RunCommand(const char* cmd_line);
+    virtual ~RunCommand() {}
+    pid_t execute() override;
+    bool mutatesShell() const override { return this->command.empty(); }
+};
 
+
+/*
+ * src | dest, src |& dest (stderr into the pipe), and both with a pipe size: src |{1M} dest.
+ * Without a size the pipe gets $SMASH_PIPE_SIZE, or else the kernel's default (64K).
+ */
 class PipeCommand : public Command {
     CommandPtr cmd_src;
     CommandPtr cmd_dest;
     int write_fd = STDOUT_FD;
+    size_t pipe_size = 0; // 0: the kernel's default
 public:
     PipeCommand(const char* cmd_line);
     virtual ~PipeCommand() {}
@@ -122,6 +177,7 @@ public:
     ChangeDirCommand(const char* cmd_line, string prev_dir);
     virtual ~ChangeDirCommand() {}
     pid_t execute() override;
+    bool mutatesShell() const override { return true; }
 };
 
 class GetCurrDirCommand : public BuiltInCommand {
@@ -129,6 +185,7 @@ public:
     GetCurrDirCommand(const char* cmd_line);
     virtual ~GetCurrDirCommand() {}
     pid_t execute() override;
+    bool reusable() const override { return true; }
 };
 
 class ShowPidCommand : public BuiltInCommand {
@@ -136,15 +193,19 @@ public:
     ShowPidCommand(const char* cmd_line);
     virtual ~ShowPidCommand() {}
     pid_t execute() override;
+    bool reusable() const override { return true; }
 };
 
 class QuitCommand : public BuiltInCommand {
     JobsList* jobs;
     bool kill;
+    bool term_first = false;
+    bool verbose = false;
 public:
     QuitCommand(const char* cmd_line, JobsList* jobs);
     virtual ~QuitCommand() {}
     pid_t execute() override;
+    bool mutatesShell() const override { return true; }
 };
 
 
@@ -158,17 +219,29 @@ public:
         pid_t pid;
         CommandPtr cmd;
         JOB_STATUS status;
-
-        JobEntry_t(job_id id, time_t timestamp, pid_t pid, CommandPtr cmd, JOB_STATUS status) :
-            id(id), timestamp(timestamp), pid(pid), cmd(cmd), status(status) {}
+        int exit_status = 0;     // raw wait status, valid once the job was reaped
+        struct rusage usage{};   // filled by wait4 once the job was reaped
+        int pidfd = -1;          // stable handle to the process, immune to pid reuse (-1 if unsupported)
+        engine_job_id engine_id = 0; // its entry in the jobs list's engine while listed
+        double cgroup_cpu_secs = -1; // the whole tree's accounting from its cgroup, once reaped
+        long cgroup_peak_kb = -1;
+
+        JobEntry_t(job_id id, time_t timestamp, pid_t pid, CommandPtr cmd, JOB_STATUS status);
+        JobEntry_t(JobEntry_t const &) = delete;
+        void operator=(JobEntry_t const &) = delete;
+        ~JobEntry_t();
         double calcDiffTime();
+        double calcDiffTime(time_t now);
+        int sendSignal(int sig_num) const;
     };
 typedef std::shared_ptr<JobEntry_t> JobEntry;
 public:
-    JobsList() = default;
-    ~JobsList() = default;
-    void addJob(pid_t pid, CommandPtr cmd, bool isStopped = false, job_id jobId = DEFAULT_JOB_ID);
-    void printJobsList();
+    JobsList();
+    // jobs still running are left running, as they always were when smash exits
+    ~JobsList();
+    // returns the job's id, also when the job already exited and is not listed
+    job_id addJob(pid_t pid, CommandPtr cmd, bool isStopped = false, job_id jobId = DEFAULT_JOB_ID);
+    void printJobsList(bool as_json = false, bool long_format = false);
     JobEntry getJobByJobId(job_id jobId);
     JobEntry getJobByProcessId(pid_t pid);
     void removeJobByJobId(job_id job_id_to_remove);
@@ -176,16 +249,30 @@ public:
     JobEntry getLastJob(job_id* lastJobId);
     JobEntry getLastStoppedJob(job_id* jobId);
     void removeFinishedJobs(); 
-    void killAllJobs();
+    void killAllJobs(bool term_first = false);
     void updateCurrFGJob(pid_t pid, CommandPtr cmd, job_id jobId = DEFAULT_JOB_ID);
     void resetCurrFGJob();
     void killCurrFGJob();
     void stopCurrFGJob();
     CommandPtr getCmdForPID( pid_t pid);
+    JobEntry getJobForPID(pid_t pid);
+    // readable whenever a listed job exits
+    int exitEventFd() const { return engine.eventFd(); }
+    // how long to wait on exitEventFd() at most before calling removeFinishedJobs(), -1: no limit
+    int exitPollMs() const { return engine.pollTimeoutMs(-1); }
 private:
     std::map<pid_t, job_id> proc_to_job_id;
     std::map<job_id, JobEntry > jobs_list;
+    std::vector<JobEntry> finished_jobs; // reaped since the last 'jobs -l', bounded by FINISHED_JOBS_HISTORY
     JobEntry curr_FG_job;
+    SmashEngine engine;      // watches and reaps the listed jobs
+    void recordFinishedJob(const JobEntry& job, int status, const struct rusage& usage);
+    void jobExited(const EngineJob_t& done);
+    void watchJob(const JobEntry& job);
+    void unwatchJob(const JobEntry& job);
+    void eraseJob(const JobEntry& job);
+    int signalAllJobs(int sig_num);
+    void reapAllJobs(long timeout_ms);
 };
 
 class TimeOutManager {
@@ -193,10 +280,12 @@ private:
     class TimeOutEntry{
     public:
         pid_t pid;
+        int pidfd;  // opened when the alarm is set, tells this process from a later one reusing its pid
         time_t start_timestamp;
         time_t end_timestamp;
 
-        TimeOutEntry(pid_t pid, time_t start_timestamp, time_t end_timestamp) : pid(pid) , 
+        TimeOutEntry(pid_t pid, int pidfd, time_t start_timestamp, time_t end_timestamp) : pid(pid) ,
+                                                                                pidfd(pidfd) ,
                                                                                 start_timestamp(start_timestamp) , 
                                                                                 end_timestamp(end_timestamp){}
 
@@ -204,13 +293,17 @@ private:
     };
     std::vector<TimeOutEntry> time_out_heap;
 public:
-    pid_t RemoveTimedOut();
+    ~TimeOutManager();
+    // the pid whose time is up, its pidfd (-1 if unsupported) goes to the caller to close
+    pid_t RemoveTimedOut(int* pidfd);
     void SetAlarm(pid_t pid_to_insert, time_t duration);
     void SetNextAlarm();
 };
 
 class JobsCommand : public BuiltInCommand {
     JobsList* jobs_list;
+    bool as_json = false;
+    bool long_format = false;
 public:
     JobsCommand(const char* cmd_line, JobsList* jobs_list);
     virtual ~JobsCommand() {}
@@ -234,6 +327,7 @@ public:
     ForegroundCommand(const char* cmd_line, JobsList* jobs);
     virtual ~ForegroundCommand() {}
     pid_t execute() override;
+    bool mutatesShell() const override { return true; }
 };
 
 class BackgroundCommand : public BuiltInCommand {
@@ -243,6 +337,7 @@ public:
     BackgroundCommand(const char* cmd_line, JobsList* jobs);
     virtual ~BackgroundCommand() {}
     pid_t execute() override;
+    bool mutatesShell() const override { return true; }
 };
 
 class TailCommand : public BuiltInCommand {
@@ -254,6 +349,100 @@ public:
     pid_t execute() override;
 };
 
+/*
+ * Base of the streaming built-ins (cat, head, wc, grep, and cp): file tools that run inside smash, or
+ * inside the forked stage of a pipeline, instead of exec'ing coreutils. They read through one large
+ * buffer (or let the kernel copy), and produce the same bytes and exit status as the GNU tools (C locale).
+ * Each knows only the common options: for anything else isSupported() is false and CreateCommand
+ * runs the real tool instead. ctrl-C stops them with status 130.
+ */
+class StreamCommand : public BuiltInCommand {
+protected:
+    std::vector<string> files; // empty: stdin
+    bool supported = true;
+    std::vector<char> buff;
+
+    // the named files, or "-" for stdin
+    std::vector<string> inputs() const;
+    // opens file ("-" is stdin), -1 after printing why
+    int openInput(const string& tool, const string& file) const;
+    void closeInput(int fd) const;
+public:
+    explicit StreamCommand(const char* cmd_line);
+    virtual ~StreamCommand() {}
+    bool isSupported() const { return supported; }
+};
+
+/* cat [file...] */
+class CatCommand : public StreamCommand {
+public:
+    CatCommand(const char* cmd_line);
+    virtual ~CatCommand() {}
+    pid_t execute() override;
+};
+
+/* head [-n N | -c N | -N] [file...] */
+class HeadCommand : public StreamCommand {
+    uint64_t count = DEFAULT_HEAD_COUNT;
+    bool count_bytes = false;
+public:
+    HeadCommand(const char* cmd_line);
+    virtual ~HeadCommand() {}
+    pid_t execute() override;
+};
+
+/* wc [-lwc] [file...] */
+class WcCommand : public StreamCommand {
+    bool count_lines = false;
+    bool count_words = false;
+    bool count_bytes = false;
+    struct Counts_t {
+        uint64_t lines = 0;
+        uint64_t words = 0;
+        uint64_t bytes = 0;
+    };
+    string formatCounts(const Counts_t& counts, int width, const string& name) const;
+public:
+    WcCommand(const char* cmd_line);
+    virtual ~WcCommand() {}
+    pid_t execute() override;
+};
+
+/* grep [-Fvcn] pattern [file...]   fixed strings only (without -F, patterns free of regex characters) */
+class GrepCommand : public StreamCommand {
+    string pattern;
+    bool invert = false;
+    bool count_only = false;
+    bool line_numbers = false;
+
+    struct Scan_t {
+        string prefix;          // "file:" with several files
+        uint64_t selected = 0;
+        uint64_t line_no = 0;   // lines before the current chunk
+        bool binary = false;    // a NUL was seen: lines are no longer printed
+        bool binary_match = false;
+    };
+    void selectLines(Scan_t& scan, const char* start, const char* end);
+    bool scanLines(Scan_t& scan, const char* start, const char* end);
+public:
+    GrepCommand(const char* cmd_line);
+    virtual ~GrepCommand() {}
+    pid_t execute() override;
+};
+
+/* cp [-v] [--stats] source... dest   regular files, copied inside the kernel where possible */
+class CpCommand : public StreamCommand {
+    string dest;
+    bool verbose = false;
+    bool stats = false;   // prints the bytes copied, the rate and the methods used
+    // false after printing why src was not copied, or when ctrl-C cut the copy short
+    bool copyFile(const string& src, const string& target, uint64_t* copied, CopyMethod* method);
+public:
+    CpCommand(const char* cmd_line);
+    virtual ~CpCommand() {}
+    pid_t execute() override;
+};
+
 class TouchCommand : public BuiltInCommand {
     time_t timestamp;
     char* filename;
@@ -263,12 +452,172 @@ public:
     pid_t execute() override;
 };
 
+class TimesCommand : public BuiltInCommand {
+    bool long_format = false;
+public:
+    TimesCommand(const char* cmd_line);
+    virtual ~TimesCommand() {}
+    pid_t execute() override;
+};
+
+class HistoryCommand : public BuiltInCommand {
+    History* history;
+    size_t count = 0; // 0 prints every entry
+    string needle;
+    bool search = false;
+public:
+    HistoryCommand(const char* cmd_line, History* history);
+    virtual ~HistoryCommand() {}
+    pid_t execute() override;
+};
+
+class ExportCommand : public BuiltInCommand {
+    VarTable* variables;
+public:
+    ExportCommand(const char* cmd_line, VarTable* variables);
+    virtual ~ExportCommand() {}
+    pid_t execute() override;
+    bool mutatesShell() const override { return true; }
+    bool reusable() const override { return true; }
+};
+
+class UnsetCommand : public BuiltInCommand {
+    VarTable* variables;
+public:
+    UnsetCommand(const char* cmd_line, VarTable* variables);
+    virtual ~UnsetCommand() {}
+    pid_t execute() override;
+    bool mutatesShell() const override { return true; }
+    bool reusable() const override { return true; }
+};
+
+/* NAME=value on its own, the value quoted or not: sets a shell variable, exported only if it already was */
+class AssignCommand : public BuiltInCommand {
+    VarTable* variables;
+    string name;
+    string value;
+public:
+    AssignCommand(const char* cmd_line, VarTable* variables);
+    virtual ~AssignCommand() {}
+    pid_t execute() override;
+    bool mutatesShell() const override { return true; }
+    bool reusable() const override { return true; }
+};
+
+/*
+ * parallel [-j N] [-k] -f file          runs every line of file as a command
+ * parallel [-j N] [-k] cmd ::: arg...   runs cmd once per arg ({} in cmd is replaced, else arg is appended)
+ * Keeps at most N tasks running (default: online CPUs) and refills a slot as soon as a task exits.
+ * With -k every task's output is collected and printed in input order, otherwise tasks share stdout.
+ * The exit status is the number of failed tasks (at most 101), 130 when interrupted by ctrl-C.
+ */
+class ParallelCommand : public BuiltInCommand {
+    struct Task_t {
+        string line;
+        JobsList::JobEntry job;
+        int out_fd = -1;
+        string output;
+        bool exited = false;
+        bool failed = false;
+    };
+    size_t max_jobs;
+    bool keep_order = false;
+    std::vector<Task_t> tasks;
+
+    void launch(size_t index, int epoll_fd);
+    void drainOutput(Task_t& task, int epoll_fd);
+    bool reap(Task_t& task, int options);
+    // kills and reaps the started tasks, closes their pipes; returns how many were still running
+    int killRunning();
+public:
+    ParallelCommand(const char* cmd_line);
+    virtual ~ParallelCommand() {}
+    pid_t execute() override;
+};
+
+/*
+ * output [-f] %N   prints what job N wrote so far to its capture ring (its stdout and stderr)
+ * With -f it keeps printing new output until the job closes its pipe or ctrl-C is pressed.
+ */
+class OutputCommand : public BuiltInCommand {
+    CaptureTable* captures;
+    job_id dest_jid;
+    bool follow = false;
+public:
+    OutputCommand(const char* cmd_line, CaptureTable* captures);
+    virtual ~OutputCommand() {}
+    pid_t execute() override;
+};
+
+/* capture [on|off] [-s size[K|M]]   whether every & job is captured, and the ring size of new captures */
+class CaptureCommand : public BuiltInCommand {
+    CaptureTable* captures;
+    int capture_all = -1; // -1: unchanged
+    size_t ring_size = 0; // 0: unchanged
+public:
+    CaptureCommand(const char* cmd_line, CaptureTable* captures);
+    virtual ~CaptureCommand() {}
+    pid_t execute() override;
+    bool mutatesShell() const override { return true; }
+};
+
+class StatsCommand : public BuiltInCommand {
+    bool as_json = false;
+    bool reset = false;
+public:
+    StatsCommand(const char* cmd_line);
+    virtual ~StatsCommand() {}
+    pid_t execute() override;
+};
+
 class ChPromptCommand : public BuiltInCommand {
 public:
     string new_prompt;
     ChPromptCommand(const char* cmd_line);
     virtual ~ChPromptCommand() {}
     pid_t execute() override;
+    bool mutatesShell() const override { return true; }
+    bool reusable() const override { return true; }
+};
+
+/* true, ":" and false: only set the exit status, for loop and if conditions */
+class TrueCommand : public BuiltInCommand {
+public:
+    TrueCommand(const char* cmd_line);
+    virtual ~TrueCommand() {}
+    pid_t execute() override;
+    bool reusable() const override { return true; }
+};
+
+class FalseCommand : public BuiltInCommand {
+public:
+    FalseCommand(const char* cmd_line);
+    virtual ~FalseCommand() {}
+    pid_t execute() override;
+    bool reusable() const override { return true; }
+};
+
+/*
+ * Parsed built-ins by line text, after expansion, so that script lines repeated at the top level or
+ * in a loop skip CreateCommand and the tokenizer. Only reusable() commands are kept, and lines with
+ * glob characters never are, since their words are matched at parse time. A line is only kept the
+ * second time it is parsed, so the lines a loop runs once per value ("x=$i") do not push the repeated
+ * ones out. A cached command is handed out only while nothing else holds it. The least recently used
+ * entries go past the capacity.
+ */
+class CommandCache {
+    std::list<std::pair<string, CommandPtr>> entries; // most recently used first
+    std::unordered_map<string, std::list<std::pair<string, CommandPtr>>::iterator> by_line;
+    std::vector<size_t> seen; // hashes of lines parsed once, by hash modulo its size
+    size_t capacity;
+public:
+    explicit CommandCache(size_t capacity = COMMAND_CACHE_SIZE) : seen(COMMAND_CACHE_SEEN_SLOTS), capacity(capacity) {}
+    CommandCache(const CommandCache&) = delete;
+    void operator=(const CommandCache&) = delete;
+    // the command parsed from line, nullptr if it is not cached (or is still in use)
+    CommandPtr get(const string& line);
+    // keeps cmd for line if it is reusable
+    void put(const string& line, const CommandPtr& cmd);
 };
 
 class SmallShell {
@@ -279,12 +628,35 @@ private:
     pid_t pid;
     string curr_dir;
     string prev_dir;
+    int last_exit_status = 0;
+    std::unique_ptr<TimeOutManager> time_out_manager; // created on the first timeout command
+    unsigned call_depth = 0;  // running function calls
+    unsigned loop_depth = 0;  // running loops of the innermost call (or of the top level)
+    unsigned flow_levels = 0; // loops a break or continue still has to leave
+
+    // runs one command line; expands: it may hold $ or ` (always so for lines typed at the prompt)
+    void executeLine(const string& line, bool expands);
+    void callFunction(ScriptNodePtr function, const string& cmd_line);
+    ScriptFlow runBlock(const ScriptBlock& block);
+    ScriptFlow runNode(const ScriptNodePtr& node);
+    // after a loop body: true if the loop ends, with flow left as what the loop itself returns
+    bool loopDone(ScriptFlow& flow);
     //pid_t curr_fg_pid;
     //job_id curr_fg_job_id;
 public:
     bool quit = false;
+    volatile sig_atomic_t fg_interrupted = 0; // set by ctrl-C
     JobsList jobs_list;
-    TimeOutManager time_out_manager;
+    History history;
+    VarTable variables;
+    Zygote zygote; // only started with --zygote
+    CaptureTable captures;
+    AppendFdCache append_fds; // ">>" targets, closed at quit
+    SpawnAttrs spawn_attrs;   // for every external command: the defaults, plus a running "run" prefix
+    CgroupManager cgroups;    // only enabled with --cgroups
+    CommandCache command_cache;
+    ScriptParser script_parser; // holds the blocks still being read
+    std::unordered_map<string, ScriptNodePtr> functions;
     CommandPtr CreateCommand(const char *cmd_line);
     SmallShell(SmallShell const &) = delete; // disable copy ctor
     void operator=(SmallShell const &) = delete; // disable = operator
@@ -300,11 +672,28 @@ public:
     }
     ~SmallShell();
     void executeCommand(const char *cmd_line);
+    // the input ended: reports a block left open
+    void endOfInput();
     void setPromptLine(const string new_prmp_line);
     string getCurrDir();
     void setCurrDir();
-    void printPromptLine() const;
+    string getPromptLine() const;
     void printSmashId() const;
+    int getLastExitStatus() const;
+    void setLastExitStatus(int status);
+    TimeOutManager& getTimeOutManager();
+    // waits until the foreground process exits or stops, draining captured job output meanwhile
+    pid_t waitForeground(pid_t pid, int* status, int pidfd = -1);
+    // replaces every $(...) and `...` in line with the output of the command inside
+    string substituteCommands(const string& line);
+    string captureOutput(const string& cmd_line);
 };
 
+string _trim(const std::string& s);
+bool _parseSize(const char* str, size_t* size);
+void _setPipeSize(int fd, size_t size);
+ssize_t _fullread(int fd, char *buff, size_t nbytes);
+ssize_t _fullwrite(int fd, const char *buff, size_t nbytes);
+void _writeOutput(const string& buff);
+
 #endif //SMASH_COMMAND_H_
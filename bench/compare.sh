@@ -0,0 +1,41 @@
+#!/bin/bash
+# Compares two run_bench.sh outputs workload by workload.
+# usage: compare.sh <baseline.json> <candidate.json>
+
+set -u
+
+awk '
+    function field(line, key,    m) {
+        if (match(line, "\"" key "\":[^,}]+")) {
+            m = substr(line, RSTART + length(key) + 3, RLENGTH - length(key) - 3)
+            gsub(/"/, "", m)
+            return m
+        }
+        return ""
+    }
+    FNR == 1 {
+        file_idx++
+    }
+    {
+        w = field($0, "workload")
+        for (i = 1; i <= nkeys; i++) {
+            v[file_idx, w, keys[i]] = field($0, keys[i])
+        }
+        seen[w] = 1
+    }
+    BEGIN {
+        nkeys = split("cmds_per_sec launch_p50_us launch_p99_us parse_p50_us parse_p99_us peak_rss_kb mean_us p50_us p99_us", keys, " ")
+        printf "%-12s %-14s %14s %14s %9s\n", "workload", "metric", "baseline", "candidate", "change"
+    }
+    END {
+        for (w in seen) {
+            for (i = 1; i <= nkeys; i++) {
+                a = v[1, w, keys[i]]; b = v[2, w, keys[i]]
+                if (a == "" && b == "") {
+                    continue
+                }
+                change = (a + 0 == 0) ? "n/a" : sprintf("%+.1f%%", (b - a) * 100 / a)
+                printf "%-12s %-14s %14s %14s %9s\n", w, keys[i], a, b, change
+            }
+        }
+    }' "${1:?usage: $0 <baseline.json> <candidate.json>}" "${2:?usage: $0 <baseline.json> <candidate.json>}"
@@ -0,0 +1,62 @@
+#!/bin/bash
+# File copy throughput of the cp and cat built-ins against coreutils, one JSON object per
+# configuration and filesystem:
+#   cp big        one N byte file (copy_file_range where the filesystem allows it)
+#   cp many       500 separate "cp file dir" lines of 64K files (an exec each for coreutils)
+#   cat > file    one N byte file through a redirection
+# Every configuration runs inside smash, so both sides pay the same shell overhead.
+# usage: copy_bench.sh <smash binary> [bytes] [dir...]   (default 256M, /dev/shm and /var/tmp)
+
+set -u
+
+SMASH=$(readlink -f "${1:?usage: $0 <smash binary> [bytes] [dir...]}")
+BYTES=${2:-256M}
+shift $(($# >= 2 ? 2 : $#))
+DIRS=("$@")
+[ ${#DIRS[@]} -eq 0 ] && DIRS=(/dev/shm /var/tmp)
+N_SMALL=500
+CP=$(type -P cp)
+CAT=$(type -P cat)
+WORK_DIRS=()
+trap 'rm -rf "${WORK_DIRS[@]}"' EXIT
+
+# run_config <fs> <name> <bytes moved> <smash script line>...
+run_config() {
+    local fs=$1 name=$2 bytes=$3
+    shift 3
+    printf '%s\n' "$@" > "$WORK_DIR/script"
+    sync
+    local start end
+    start=$(date +%s%N)
+    SMASH_HISTFILE= "$SMASH" --no-edit < "$WORK_DIR/script" > /dev/null 2>&1
+    end=$(date +%s%N)
+    awk -v fs="$fs" -v name="$name" -v bytes="$bytes" -v ns=$((end - start)) 'BEGIN {
+        printf "{\"fs\":\"%s\",\"config\":\"%s\",\"bytes\":%d,\"wall_s\":%.3f,\"mb_per_sec\":%.1f}\n",
+               fs, name, bytes, ns / 1e9, bytes / 1048576 / (ns / 1e9)
+    }'
+}
+
+total=$(numfmt --from=iec "$BYTES")
+for dir in "${DIRS[@]}"; do
+    WORK_DIR=$(mktemp -d "$dir/smash_copy.XXXXXX")
+    WORK_DIRS+=("$WORK_DIR")
+    fs=$(stat -f -c %T "$WORK_DIR")
+    head -c "$total" /dev/urandom > "$WORK_DIR/big"
+    mkdir "$WORK_DIR/small" "$WORK_DIR/out"
+    for ((i = 0; i < N_SMALL; i++)); do
+        head -c 65536 /dev/urandom > "$WORK_DIR/small/f$i"
+    done
+
+    run_config "$fs" cp_big_builtin "$total" "cp $WORK_DIR/big $WORK_DIR/big.1"
+    run_config "$fs" cp_big_coreutils "$total" "$CP $WORK_DIR/big $WORK_DIR/big.2"
+    run_config "$fs" cat_big_builtin "$total" "cat $WORK_DIR/big > $WORK_DIR/big.3"
+    run_config "$fs" cat_big_coreutils "$total" "$CAT $WORK_DIR/big > $WORK_DIR/big.4"
+    rm -f "$WORK_DIR"/big.*
+
+    lines=()
+    for ((i = 0; i < N_SMALL; i++)); do
+        lines+=("cp $WORK_DIR/small/f$i $WORK_DIR/out")
+    done
+    run_config "$fs" cp_many_builtin $((N_SMALL * 65536)) "${lines[@]}"
+    run_config "$fs" cp_many_coreutils $((N_SMALL * 65536)) "${lines[@]/#cp /$CP }"
+done
@@ -0,0 +1,109 @@
+/*
+ * Drives the libsmash engine directly, the way an embedding daemon would, and prints one JSON object
+ * per workload like run_bench.sh.
+ *   launch:    N x /bin/true, keeping P running from the job callback
+ *   pipelines: N/10 x "seq 1 10000 | wc -l" into /dev/null
+ *   timeout:   "sleep 10" with a 100 ms timeout, must be killed on time
+ *   adopt:     a child forked here and handed to the engine, as smash does with its jobs
+ *   spawn:     the engine's own counters of its posix_spawn calls
+ * usage: engine_bench [jobs] [parallel]
+ */
+#include "../engine.h"
+#include "../proc.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+static void printResult(const char* name, int commands, uint64_t elapsed_ns, std::vector<uint64_t>& launch_ns) {
+    std::sort(launch_ns.begin(), launch_ns.end());
+    double secs = elapsed_ns / 1e9;
+    printf("{\"workload\":\"engine_%s\",\"commands\":%d,\"wall_s\":%.3f,\"cmds_per_sec\":%.1f,"
+           "\"launch_p50_us\":%.1f,\"launch_p99_us\":%.1f}\n", name, commands, secs, commands / secs,
+           launch_ns[launch_ns.size() / 2] / 1e3, launch_ns[launch_ns.size() * 99 / 100] / 1e3);
+}
+
+int main(int argc, char* argv[]) {
+    int n_jobs = (argc > 1 ? atoi(argv[1]) : 2000);
+    int parallel = (argc > 2 ? atoi(argv[2]) : 8);
+    if (n_jobs < 10 || parallel < 1) {
+        fprintf(stderr, "usage: engine_bench [jobs >= 10] [parallel >= 1]\n");
+        return 2;
+    }
+    try {
+        SmashEngine engine;
+        LaunchOptions_t opts;
+        opts.stdout_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        std::vector<uint64_t> launch_ns;
+        int launched = 0;
+        int running = 0;
+        int failed = 0;
+
+        auto launchOne = [&]() {
+            uint64_t start = _monotonicNs();
+            engine.launch({"/bin/true"}, opts);
+            launch_ns.push_back(_monotonicNs() - start);
+            launched++;
+            running++;
+        };
+        engine.onJobEvent([&](const EngineJob_t& job) {
+            if (job.state != ENGINE_EXITED) {
+                return;
+            }
+            running--;
+            failed += (job.exit_status != 0);
+            engine.forget(job.id);
+            if (launched < n_jobs) {
+                launchOne();
+            }
+        });
+        uint64_t start = _monotonicNs();
+        while (launched < std::min(parallel, n_jobs)) {
+            launchOne();
+        }
+        while (running > 0) {
+            engine.poll(-1);
+        }
+        printResult("launch", n_jobs, _monotonicNs() - start, launch_ns);
+
+        engine.onJobEvent(nullptr);
+        launch_ns.clear();
+        start = _monotonicNs();
+        for (int i = 0; i < n_jobs / 10; i++) {
+            uint64_t launch_start = _monotonicNs();
+            engine_job_id id = engine.pipeline({{"seq", "1", "10000"}, {"wc", "-l"}}, opts);
+            launch_ns.push_back(_monotonicNs() - launch_start);
+            failed += (engine.wait(id) != 0);
+        }
+        printResult("pipelines", n_jobs / 10, _monotonicNs() - start, launch_ns);
+
+        opts.timeout_s = 0.1;
+        start = _monotonicNs();
+        engine_job_id id = engine.launch({"sleep", "10"}, opts);
+        int code = engine.wait(id);
+        double waited_ms = (_monotonicNs() - start) / 1e6;
+        printf("{\"workload\":\"engine_timeout\",\"exit_code\":%d,\"waited_ms\":%.1f}\n", code, waited_ms);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            setpgid(0, 0);
+            _exit(3);
+        }
+        int adopted_code = engine.wait(engine.adopt(pid, "forked"));
+        printf("{\"workload\":\"engine_adopt\",\"exit_code\":%d}\n", adopted_code);
+        const EngineStats_t& stats = engine.stats();
+        printf("{\"workload\":\"engine_spawn\",\"spawns\":%lu,\"spawn_avg_us\":%.1f,\"spawn_max_us\":%.1f}\n",
+               (unsigned long)stats.spawns, stats.spawn_total_ns / 1e3 / stats.spawns, stats.spawn_max_ns / 1e3);
+        if (code != 128 + SIGKILL || waited_ms > 1000 || failed != 0 || adopted_code != 3 ||
+            stats.spawns != (uint64_t)(n_jobs + n_jobs / 10 * 2 + 1)) {
+            fprintf(stderr, "engine_bench: unexpected result (%d failed jobs)\n", failed);
+            return 1;
+        }
+    } catch (SmashError& err) {
+        perror(err.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+# Pipeline throughput through smash's pipes, one JSON object per configuration:
+#   yes | head -c N | wc -c       with the default 64K pipes, |{256K}, |{1M} and SMASH_PIPE_SIZE=1M
+#   tail -HUGE file | wc -c       the tail built-in splicing a N/4 byte file into the pipe,
+#                                 against cat reading and writing it
+# usage: pipe_bench.sh <smash binary> [bytes]   (default 1G, "10G" for the full-size run)
+
+set -u
+
+SMASH=$(readlink -f "${1:?usage: $0 <smash binary> [bytes]}")
+BYTES=${2:-1G}
+WORK_DIR=$(mktemp -d /tmp/smash_pipes.XXXXXX)
+trap 'rm -rf "$WORK_DIR"' EXIT
+FILE=$WORK_DIR/data.txt
+
+# run_config <name> <bytes moved> <smash script line>...
+run_config() {
+    local name=$1 bytes=$2
+    shift 2
+    printf '%s\n' "$@" > "$WORK_DIR/script"
+    local start end out
+    start=$(date +%s%N)
+    out=$(SMASH_HISTFILE= "$SMASH" --no-edit < "$WORK_DIR/script" 2>&1 | tr -dc '0-9\n' | tail -1)
+    end=$(date +%s%N)
+    awk -v name="$name" -v bytes="$bytes" -v out="$out" -v ns=$((end - start)) 'BEGIN {
+        printf "{\"config\":\"%s\",\"bytes\":%d,\"counted\":%d,\"wall_s\":%.3f,\"mb_per_sec\":%.1f}\n",
+               name, bytes, out, ns / 1e9, bytes / 1048576 / (ns / 1e9)
+    }'
+}
+
+total=$(numfmt --from=iec "$BYTES")
+run_config default "$total" "yes | head -c $BYTES | wc -c"
+run_config pipe_256K "$total" "yes |{256K} head -c $BYTES |{256K} wc -c"
+run_config pipe_1M "$total" "yes |{1M} head -c $BYTES |{1M} wc -c"
+run_config setting_1M "$total" "SMASH_PIPE_SIZE=1M" "yes | head -c $BYTES | wc -c"
+
+file_bytes=$((total / 4))
+yes | head -c $file_bytes > "$FILE"
+lines=$(wc -l < "$FILE")
+run_config cat_relay "$file_bytes" "cat $FILE |{1M} wc -c"
+run_config tail_splice "$file_bytes" "tail -$lines $FILE |{1M} wc -c"
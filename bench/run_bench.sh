@@ -0,0 +1,211 @@
+#!/bin/bash
+# Replays synthetic smash workloads and prints one JSON object per workload:
+#   commands/sec, p50/p99 launch (fork) latency and peak RSS of the smash process.
+# Every workload also reports p50/p99 parse time, which includes glob expansion.
+# The startup workload instead times `smash -c true` cold starts (mean/p50/p99 wall time).
+# usage: run_bench.sh <smash binary> [workload...]
+# env:   BENCH_SCALE   multiplies the size of every workload (default 1)
+#        BENCH_TMPDIR  where workload files are generated (default: a fresh dir under /tmp)
+#        BENCH_FLAGS   extra smash flags, e.g. --zygote
+
+set -u
+
+SMASH=$(readlink -f "${1:?usage: $0 <smash binary> [workload...]}")
+shift
+WORKLOADS=${*:-externals pipelines tail text append jobs glob vars subst parallel capture loop unrolled startup}
+SCALE=${BENCH_SCALE:-1}
+read -r -a FLAGS <<< "${BENCH_FLAGS:-}"
+WORK_DIR=${BENCH_TMPDIR:-$(mktemp -d /tmp/smash_bench.XXXXXX)}
+mkdir -p "$WORK_DIR"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+gen_externals() {
+    for ((i = 0; i < 2000 * SCALE; i++)); do
+        echo "/bin/true"
+    done
+}
+
+gen_pipelines() {
+    seq 1 20000 > "$WORK_DIR/lines.txt"
+    for ((i = 0; i < 100 * SCALE; i++)); do
+        echo "tail -5000 $WORK_DIR/lines.txt | cat | cat | cat | cat | cat | cat | wc -l"
+    done
+}
+
+gen_tail() {
+    seq 1 $((2000000 * SCALE)) > "$WORK_DIR/big.txt"
+    for ((i = 0; i < 20; i++)); do
+        echo "tail -$((100000 * SCALE)) $WORK_DIR/big.txt"
+    done
+}
+
+gen_text() {
+    # the streaming built-ins over a ~90MB file: a search, a count and a head feeding a pipeline
+    seq -f "line %g of the text workload" 1 $((3000000 * SCALE)) > "$WORK_DIR/text.txt"
+    for ((i = 0; i < 10; i++)); do
+        echo "grep -c 99$i $WORK_DIR/text.txt"
+        echo "wc $WORK_DIR/text.txt"
+        echo "head -n 1000000 $WORK_DIR/text.txt | grep -v workload | wc -l"
+    done
+}
+
+gen_append() {
+    # a script logging every step: 4000 built-in lines appending to 2 log files, 1000 external ones
+    for ((i = 0; i < 1000 * SCALE; i++)); do
+        echo "pwd >> $WORK_DIR/results.log"
+        echo "showpid >> $WORK_DIR/results.log"
+        echo "pwd >> $WORK_DIR/errors.log"
+        echo "chprompt step_$i >> $WORK_DIR/errors.log"
+        echo "/bin/true >> $WORK_DIR/results.log"
+    done
+}
+
+gen_jobs() {
+    for ((i = 0; i < 300 * SCALE; i++)); do
+        echo "timeout 30 sleep 20&"
+    done
+    echo "jobs"
+}
+
+gen_glob() {
+    # one directory with 1M entries (times BENCH_SCALE), every line rescans it since the cache is per prompt
+    local dir="$WORK_DIR/globdir"
+    mkdir -p "$dir"
+    (cd "$dir" && seq -f "f%08g" 0 $((1000000 * SCALE - 1)) | xargs touch)
+    for ((i = 0; i < 20; i++)); do
+        echo "/bin/true $dir/f00$((i % 10))$((i / 10))???"
+    done
+}
+
+gen_vars() {
+    # expansion-heavy built-ins: no forks, so the rate is bound by variable lookup and parsing
+    for ((i = 0; i < 500; i++)); do
+        echo "VAR_$i=value_$i"
+    done
+    for ((i = 0; i < 20000 * SCALE; i++)); do
+        echo "chprompt \$VAR_$((i % 500))\${VAR_$((i * 7 % 500))}_\$?_\$\$"
+    done
+}
+
+gen_subst() {
+    # half captured in-process (built-in), half through a pipe from an external command
+    seq 1 1000 > "$WORK_DIR/subst.txt"
+    for ((i = 0; i < 1000 * SCALE; i++)); do
+        echo "chprompt \$(tail -1 $WORK_DIR/subst.txt)"
+        echo "chprompt \$(/bin/echo $i)"
+    done
+}
+
+gen_parallel() {
+    # 20 lines of 500 short tasks each, 4 at a time: measures how fast finished slots are refilled
+    local args
+    args=$(seq -s ' ' 1 500)
+    for ((i = 0; i < 20 * SCALE; i++)); do
+        echo "parallel -j 4 /bin/true ::: $args"
+    done
+}
+
+gen_capture() {
+    # 200 captured background jobs of ~600KB output each, drained while smash waits, then read back
+    for ((i = 0; i < 200 * SCALE; i++)); do
+        echo "seq 1 100000 &!"
+    done
+    echo "sleep 1"
+    for ((i = 1; i <= 20; i++)); do
+        echo "output %$i"
+    done
+}
+
+gen_loop() {
+    # 1M iterations (times BENCH_SCALE) of two built-ins in nested loops, parsed once and expanded every time
+    local digits="0 1 2 3 4 5 6 7 8 9"
+    echo "for a in $(seq -s ' ' 1 "$SCALE"); do"
+    for var in b c d e f g; do
+        echo "for $var in $digits; do"
+    done
+    echo "x=\$b\$c\$d\$e\$f\$g"
+    echo "chprompt p\$g"
+    for ((i = 0; i < 7; i++)); do
+        echo "done"
+    done
+    echo $((2000000 * SCALE)) > "$WORK_DIR/loop.count"
+}
+
+gen_unrolled() {
+    # the loop's body written out, as scripts generated it before smash had loops (100K iterations)
+    for ((i = 0; i < 100000 * SCALE; i++)); do
+        echo "x=$i"
+        echo "chprompt p$((i % 10))"
+    done
+}
+
+# run_startup: times repeated `smash -c true` invocations end to end (exec, startup, one command, exit)
+run_startup() {
+    local runs=$((500 * SCALE))
+    local times="$WORK_DIR/startup.times"
+    local i start end
+    : > "$times"
+    for ((i = 0; i < runs; i++)); do
+        start=$EPOCHREALTIME
+        "$SMASH" "${FLAGS[@]}" -c true
+        end=$EPOCHREALTIME
+        echo "$start $end" >> "$times"
+    done
+
+    awk '{ printf "%.1f\n", ($2 - $1) * 1e6 }' "$times" | sort -n | awk -v runs="$runs" '
+        { us[NR] = $1; total += $1 }
+        END {
+            printf "{\"workload\":\"startup\",\"commands\":%d,\"wall_s\":%.3f,\"mean_us\":%.1f,", runs, total / 1e6, total / NR
+            printf "\"p50_us\":%.1f,\"p99_us\":%.1f}\n", us[int((NR + 1) * 0.5)], us[int(NR * 0.99)]
+        }'
+}
+
+# run_workload <name>: generates the script, replays it and reports the metrics
+run_workload() {
+    local name=$1
+    local script="$WORK_DIR/$name.smash"
+    local stats="$WORK_DIR/$name.stats"
+    local out="$WORK_DIR/$name.out"
+
+    "gen_$name" > "$script"
+    local n_commands
+    n_commands=$(wc -l < "$script")
+    if [ -f "$WORK_DIR/$name.count" ]; then
+        n_commands=$(cat "$WORK_DIR/$name.count") # commands run, where the script loops
+    fi
+    echo "times -l" >> "$script"
+    echo "quit kill" >> "$script"
+
+    local start end
+    start=$(date +%s%N)
+    SMASH_STATS_FILE=$stats "$SMASH" "${FLAGS[@]}" < "$script" > "$out" 2>&1
+    end=$(date +%s%N)
+
+    awk -v name="$name" -v n="$n_commands" -v ns=$((end - start)) '
+        FILENAME ~ /\.stats$/ && /"phase":"fork"/ {
+            match($0, /"count":[0-9]+/); forks = substr($0, RSTART + 8, RLENGTH - 8)
+            match($0, /"p50_us":[0-9.]+/); p50 = substr($0, RSTART + 9, RLENGTH - 9)
+            match($0, /"p99_us":[0-9.]+/); p99 = substr($0, RSTART + 9, RLENGTH - 9)
+        }
+        FILENAME ~ /\.stats$/ && /"phase":"parse"/ {
+            match($0, /"p50_us":[0-9.]+/); parse_p50 = substr($0, RSTART + 9, RLENGTH - 9)
+            match($0, /"p99_us":[0-9.]+/); parse_p99 = substr($0, RSTART + 9, RLENGTH - 9)
+        }
+        FILENAME ~ /\.out$/ && /maxrss [0-9]+KB/ {
+            match($0, /maxrss [0-9]+/); rss = substr($0, RSTART + 7, RLENGTH - 7)
+        }
+        END {
+            secs = ns / 1e9
+            printf "{\"workload\":\"%s\",\"commands\":%d,\"wall_s\":%.3f,\"cmds_per_sec\":%.1f,", name, n, secs, n / secs
+            printf "\"forks\":%d,\"launch_p50_us\":%s,\"launch_p99_us\":%s,", forks, p50, p99
+            printf "\"parse_p50_us\":%s,\"parse_p99_us\":%s,\"peak_rss_kb\":%d}\n", parse_p50, parse_p99, rss
+        }' "$stats" "$out"
+}
+
+for workload in $WORKLOADS; do
+    if [ "$workload" = startup ]; then
+        run_startup
+    else
+        run_workload "$workload"
+    fi
+done
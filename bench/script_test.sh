@@ -0,0 +1,102 @@
+#!/bin/bash
+# Checks loops, conditionals and functions: each case runs the same script lines in smash and in bash
+# and compares the output, then checks smash's errors for broken or misplaced blocks.
+# usage: script_test.sh <smash binary>
+
+set -u
+
+SMASH=$(readlink -f "${1:?usage: $0 <smash binary>}")
+FAILED=0
+export LC_ALL=C
+WORK_DIR=$(mktemp -d /tmp/smash_script.XXXXXX)
+trap 'rm -rf "$WORK_DIR"' EXIT
+cd "$WORK_DIR" || exit 1
+touch b.txt a.txt c.log
+
+# run_smash <script line>...: the output without the prompts
+run_smash() {
+    printf '%s\n' "$@" | SMASH_HISTFILE= "$SMASH" --no-edit 2>&1 | sed -E 's/^((smash)?> )+//; /^$/d'
+}
+
+report() {
+    local expected=$1 got=$2
+    shift 2
+    if [ "$expected" = "$got" ]; then
+        echo "PASS $*"
+    else
+        echo "FAIL $*"
+        diff <(echo "$expected") <(echo "$got") | head -10
+        FAILED=1
+    fi
+}
+
+# same <script line>...: smash prints what bash prints
+same() {
+    report "$(printf '%s\n' "$@" | bash 2>&1)" "$(run_smash "$@")" "$@"
+}
+
+# check <expected> <script line>...
+check() {
+    local expected=$1
+    shift
+    report "$expected" "$(run_smash "$@")" "$@"
+}
+
+same "for i in 1 2 3; do for j in a b c; do if test \$j = b; then continue; fi; echo \$i\$j; done; done"
+same "for i in 1 2 3; do for j in a b c; do if test \$j = b; then continue 2; fi; echo \$i\$j; done; done"
+same "for i in 1 2 3; do for j in a b c; do if test \$i = 2; then break 2; fi; echo \$i\$j; done; done"
+same "for f in *.txt; do echo \$f; done" "for n in \$(seq 3) x; do echo n=\$n; done" "for e in; do echo never; done"
+same "n=0" "while test \$n -lt 4" "do" "    n=\$(expr \$n + 1)" "    echo \$n" "done" "echo \$n"
+same "n=3" "until test \$n = 0; do n=\$(expr \$n - 1); echo \$n; done" "until true; do echo never; done; echo \$?"
+same "for i in 1 2 3 4" "do" "    if test \$i = 1" "    then" "        echo one" "    elif test \$i = 2; then echo two" \
+     "    elif test \$i = 3; then" "        echo three" "    else" "        echo other \$i" "    fi" "done"
+
+# variables are expanded on every run of a line, cached or not
+same "x=a" "for i in 1 2 3; do echo \$x; x=\$x\$i; done" "echo \$x"
+same "x=1" "echo \$x" "x=2" "echo \$x" "x=1" "echo \$x" "for i in 1 2 1 2; do x=\$i; echo \$x; done"
+
+# values are text, never syntax, and names smash does not know are left to bash
+V='x; echo INJECTED > pwned | cat &' same 'echo $V' 'echo "$V" $V' 'ls pwned' 'for w in $V; do echo $w; done' \
+    'f() { echo $1; }' 'f $V' 'y=$V' 'echo $y' 'timeout 5 echo $V'
+same 'FOO="ab"' 'echo [$FOO]' 'FOO="a b"' 'echo "[$FOO]" [$FOO]' "FOO='c d'" 'echo "[$FOO]"' 'FOO=a\ b' 'echo "[$FOO]"' \
+    'x="*.txt"' 'echo "$x"' 'echo $x' 'y="a\"b\$c\d"' "z='\$x'" 'echo "$y" "$z"'
+printf 'hello > pwned & echo INJECTED\n' > sub.txt
+same 'V=$(echo a b)' 'echo "$V"' 'W=x`echo  c   d`y' 'echo "$W"' 'U="$(echo "p  q")"' 'echo "$U" $(echo e   f)'
+same 'echo $(cat sub.txt) x' 'ls pwned' 'echo "$(printf "a;b\nc")" `echo "1;2"`' 'for w in $(cat sub.txt); do echo $w; done'
+same 'cd /usr' 'echo $PWD $OLDPWD' 'env | grep ^PWD=' 'cd /' 'echo $PWD $OLDPWD'
+mkdir tools && printf '#!/bin/sh\necho mytool: "$@"\n' > tools/mytool && printf 'echo no shebang\n' > tools/plain
+chmod +x tools/mytool tools/plain
+same 'export PATH=$PWD/tools:$PATH' 'mytool a b' 'plain' 'PATH=$PWD/tools' 'mytool c'
+same '/bin/echo $UID y' 'echo $RANDOM x | wc -w' 'echo ${NOT_SET_ANYWHERE}z'
+
+same "f() { echo f: \$# \$1 \$2 \$@; return 3; }" "f a b c" "echo \$?" "f" "echo \$1 \$#"
+same "fact() {" "    if test \$1 = 1; then echo 1; return; fi" "    echo \$1" "    fact \$(expr \$1 - 1)" "}" "fact 4"
+same "g() { echo first; g() { echo second; }; }" "g" "g"
+same "h() { for i in 1 2 3; do if test \$i = 2; then return 5; fi; echo \$i; done; echo never; }" "h" "echo \$?"
+same "true" "echo \$?" "false" "echo \$?" ":" "echo \$?" "if false; then echo no; else echo yes; fi"
+
+check "smash error: syntax error near unexpected token \`fi'
+smash error: syntax error near unexpected token \`>'
+smash error: syntax error near unexpected token \`then'
+smash error: syntax error near unexpected token \`echo'
+2
+ok" \
+    "fi" "for i in 1; do echo \$i; done > out" "if then" "for i in 1 2; echo" 'echo $?' "echo ok"
+check "smash error: break: only meaningful in a loop
+smash error: return: only meaningful in a function
+smash error: r: maximum function nesting level exceeded (1000)
+smash error: f: functions cannot be piped, redirected or run in the background
+smash error: for: \`1x': not a valid identifier" \
+    "break" "return" "r() { r; }" "r" "f() { echo f; }" "f | cat" "for 1x in a; do echo; done"
+check "smash error: syntax error: unexpected end of file" "while true; do"
+
+# -c keeps no history, even with a history file named
+report "hi
+!!" "$(SMASH_HISTFILE=$WORK_DIR/hist "$SMASH" -c 'echo hi'; SMASH_HISTFILE=$WORK_DIR/hist "$SMASH" -c 'echo !!'; ls hist 2>/dev/null)" "-c history"
+
+# a history file that cannot be written is reported once, the commands still run
+report "smash error: history: write failed: No space left on device
+a
+b" "$(printf 'echo a\necho b\n' | SMASH_HISTFILE=/dev/full "$SMASH" --no-edit 2>&1 | sed -E 's/^(smash> )+//; /^$/d')" "history write failure"
+
+exit $FAILED
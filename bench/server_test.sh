@@ -0,0 +1,91 @@
+#!/bin/bash
+# Exercises "smash --server" with many concurrent clients, then compares the request rate
+# of one long-lived server with starting a new smash per command.
+# usage: server_test.sh <smash binary> <smash_client binary> [clients]
+
+set -u
+
+SMASH=$(readlink -f "${1:?usage: $0 <smash binary> <smash_client binary> [clients]}")
+CLIENT=$(readlink -f "${2:?usage: $0 <smash binary> <smash_client binary> [clients]}")
+N_CLIENTS=${3:-50}
+WORK_DIR=$(mktemp -d /tmp/smash_server.XXXXXX)
+SOCK=$WORK_DIR/smash.sock
+FAILED=0
+
+"$SMASH" --server "$SOCK" > "$WORK_DIR/server.log" 2>&1 &
+SERVER_PID=$!
+trap 'kill -9 $SERVER_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+for ((i = 0; i < 100; i++)); do
+    [ -S "$SOCK" ] && break
+    sleep 0.05
+done
+
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "PASS $1"
+    else
+        echo "FAIL $1: expected '$3', got '$2'"
+        FAILED=1
+    fi
+}
+
+# output and exit status reach the right client
+for ((i = 0; i < N_CLIENTS; i++)); do
+    "$CLIENT" "$SOCK" "echo out_$i" "sh -c 'exit $((i % 5))'" > "$WORK_DIR/out.$i" 2>&1 &
+    pids[i]=$!
+done
+bad=0
+for ((i = 0; i < N_CLIENTS; i++)); do
+    wait "${pids[i]}"
+    status=$?
+    if [ "$status" != $((i % 5)) ] || [ "$(cat "$WORK_DIR/out.$i")" != "out_$i" ]; then
+        bad=$((bad + 1))
+    fi
+done
+check "$N_CLIENTS concurrent clients get their own output and status" "$bad" 0
+
+# waits do not block each other: every client sleeps 1s in the background and waits for it
+start=$SECONDS
+for ((i = 0; i < N_CLIENTS; i++)); do
+    "$CLIENT" "$SOCK" "sleep 1&" "wait" &
+    pids[i]=$!
+done
+bad=0
+for ((i = 0; i < N_CLIENTS; i++)); do
+    wait "${pids[i]}" || bad=$((bad + 1))
+done
+check "$N_CLIENTS concurrent background jobs and waits" "$bad" 0
+check "waits overlap" "$((SECONDS - start < 10))" 1
+
+# the job table is shared: a job started by one client is listed and killed by another
+"$CLIENT" -v "$SOCK" "sleep 30&" "wait" 2> "$WORK_DIR/waiter.err" &
+waiter=$!
+for ((i = 0; i < 100; i++)); do
+    [ -s "$WORK_DIR/waiter.err" ] && break
+    sleep 0.05
+done
+job=$(sed -n 's/^status 0 job \([0-9]*\)$/\1/p' "$WORK_DIR/waiter.err")
+"$CLIENT" "$SOCK" "jobs" | grep -q "sleep 30&"
+check "jobs from another client" "$?" 0
+"$CLIENT" "$SOCK" "kill -9 $job" > /dev/null
+wait "$waiter"
+check "kill from another client ends the wait" "$?" 137
+
+# request rate: one server against a fresh smash per command
+runs=1000
+start=$(date +%s%N)
+"$CLIENT" -r $runs "$SOCK" /bin/true
+server_ns=$(($(date +%s%N) - start))
+start=$(date +%s%N)
+for ((i = 0; i < runs; i++)); do
+    "$SMASH" -c /bin/true
+done
+fresh_ns=$(($(date +%s%N) - start))
+echo "{\"runs\":$runs,\"server_cmds_per_sec\":$((runs * 1000000000 / server_ns)),\"fresh_smash_cmds_per_sec\":$((runs * 1000000000 / fresh_ns))}"
+
+"$CLIENT" "$SOCK" "quit kill" > /dev/null
+wait "$SERVER_PID"
+check "quit stops the server" "$?" 0
+check "socket removed" "$([ -e "$SOCK" ]; echo $?)" 1
+
+exit $FAILED
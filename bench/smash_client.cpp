@@ -0,0 +1,98 @@
+/*
+ * Test client for "smash --server": sends each request in order on one connection and exits with
+ * the status of the last one. The client's stdout and stderr go along with the first request, so
+ * command output lands straight in them.
+ * usage: smash_client [-r repeat] [-v] socket request...
+ *   -r N  sends the whole request list N times (for rate measurements)
+ *   -v    prints every reply to stderr
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define REPLY_MAX_SIZE (256)
+#define EXIT_PROTOCOL_ERROR (2)
+
+static void usage() {
+    fprintf(stderr, "usage: smash_client [-r repeat] [-v] socket request...\n");
+    exit(EXIT_PROTOCOL_ERROR);
+}
+
+static bool sendRequest(int sock, const char* request, bool pass_fds) {
+    struct iovec iov = {(void*)request, strlen(request)};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    if (pass_fds) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) != -1;
+}
+
+int main(int argc, char* argv[]) {
+    long repeat = 1;
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "+r:v")) != -1) {
+        if (opt == 'r') {
+            repeat = strtol(optarg, nullptr, 10);
+        } else if (opt == 'v') {
+            verbose = true;
+        } else {
+            usage();
+        }
+    }
+    if (optind + 2 > argc || repeat < 1) {
+        usage();
+    }
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, argv[optind], sizeof(addr.sun_path) - 1);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("smash_client: connect failed");
+        return EXIT_PROTOCOL_ERROR;
+    }
+
+    int status = 0;
+    bool first = true;
+    for (long i = 0; i < repeat; i++) {
+        for (int arg = optind + 1; arg < argc; arg++) {
+            if (!sendRequest(sock, argv[arg], first)) {
+                perror("smash_client: send failed");
+                return EXIT_PROTOCOL_ERROR;
+            }
+            first = false;
+            char reply[REPLY_MAX_SIZE];
+            ssize_t len = recv(sock, reply, sizeof(reply) - 1, 0);
+            if (len <= 0) {
+                fprintf(stderr, "smash_client: server closed the connection\n");
+                return EXIT_PROTOCOL_ERROR;
+            }
+            reply[len] = '\0';
+            if (verbose) {
+                fprintf(stderr, "%s\n", reply);
+            }
+            if (strncmp(reply, "status ", 7) != 0) {
+                fprintf(stderr, "smash_client: %s\n", reply);
+                return EXIT_PROTOCOL_ERROR;
+            }
+            status = atoi(reply + 7);
+        }
+    }
+    close(sock);
+    return status;
+}
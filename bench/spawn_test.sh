@@ -0,0 +1,125 @@
+#!/bin/bash
+# Checks that "run" prefixes and defaults reach the started processes: each case runs a command line
+# in smash and compares its output with what the processes report about themselves (affinity from
+# /proc, nice, ionice, ulimit), plus the spawn column of "jobs -l" and the errors for bad values.
+# With a writable cgroup v2 hierarchy it also checks that "smash --cgroups" kills whole job trees,
+# daemonized grandchildren included, where plain process groups miss them.
+# usage: spawn_test.sh <smash binary>
+
+set -u
+
+SMASH=$(readlink -f "${1:?usage: $0 <smash binary>}")
+FAILED=0
+export LC_ALL=C
+CPU=$(taskset -cp $$ | sed 's/.*: //; s/[,-].*//') # one cpu this test may use
+NICE=$(nice)
+SMASH_FLAGS=
+WORK_DIR=$(mktemp -d /tmp/smash_spawn.XXXXXX)
+trap 'pkill -f "^sleep 10[0-9][0-9]\$"; rm -rf "$WORK_DIR"' EXIT
+# alive N: how many "sleep N" processes are running (zombies left to a non-reaping init not counted)
+cat > "$WORK_DIR/alive" <<'EOF'
+#!/bin/bash
+ps -eo stat=,args= | awk -v args="sleep $1" '$1 !~ /^Z/ && substr($0, index($0, $2)) == args { n++ } END { print n + 0 }'
+EOF
+chmod +x "$WORK_DIR/alive"
+ALIVE=$WORK_DIR/alive
+
+# check <expected> <smash script line>...
+check() {
+    local expected=$1 got
+    shift
+    # into a file: a pipe would stay open as long as a leftover daemon holds it
+    printf '%s\n' "$@" | SMASH_HISTFILE= "$SMASH" --no-edit $SMASH_FLAGS > "$WORK_DIR/got" 2>&1
+    got=$(sed 's/smash> //g; /^$/d' "$WORK_DIR/got" |
+          sed -E 's/ : [0-9]+ [0-9]+ secs cpu [0-9.]+s maxrss [0-9]+KB/ :/; s/pid [0-9]+$/pid N/; s/^[0-9]+: /N: /')
+    if [ "$expected" = "$got" ]; then
+        echo "PASS $*"
+    else
+        echo "FAIL $*"
+        diff <(echo "$expected") <(echo "$got") | head -10
+        FAILED=1
+    fi
+}
+
+# smash splits a line at every '|', quoted or not, so the probes stay free of pipes
+PROBE='grep Cpus_allowed_list /proc/self/status; nice; ionice; ulimit -n; ulimit -Hn'
+
+check "Cpus_allowed_list:	$CPU
+$((NICE + 5 > 19 ? 19 : NICE + 5))
+idle
+100
+100" "run --cpus $CPU --nice $((NICE + 5 > 19 ? 19 : NICE + 5)) --ionice idle --rlimit-nofile 100 bash -c '$PROBE'"
+
+check "best-effort: prio 6
+$(ulimit -n)" "run --ionice be:6 bash -c 'ionice; ulimit -n'"
+
+# defaults apply to every later command, prefixes override them one attribute at a time
+check "nice=19 rlimit-nofile=50
+19
+50
+17
+best-effort: prio 1
+50
+nice=19 rlimit-nofile=50
+$NICE" \
+    "run --nice 19 --rlimit-nofile 50" "run" "nice" "bash -c 'ulimit -n'" \
+    "run --rlimit-nofile 17 --ionice 2:1 bash -c 'ulimit -n; ionice'" "bash -c 'ulimit -n'" "run" \
+    "run --reset" "run" "nice"
+
+# through pipelines, redirections and timeout, and with built-ins that normally run in smash
+OUT=$WORK_DIR/out
+check "19
+19
+19" "run --nice 19 nice | cat" "run --nice 19 nice > $OUT" "cat $OUT" "run --nice 19 bash -c 'cat; nice' < /dev/null"
+check "19" "run --nice 19 timeout 5 nice"
+check "$CPU" "run --cpus $CPU cat /proc/self/status | grep Cpus_allowed_list | cut -f2"
+
+check "[1] run --nice 19 --rlimit-as 1G sleep 5 & : spawn nice=19 rlimit-as=1G
+[2] sleep 5& : spawn cpus=$CPU
+[3] sleep 5& :
+{\"job_id\":1,\"pid\":0,\"cmd\":\"run --nice 19 --rlimit-as 1G sleep 5 &\",\"spawn\":\"nice=19 rlimit-as=1G\"}
+{\"job_id\":2,\"pid\":0,\"cmd\":\"sleep 5&\",\"spawn\":\"cpus=$CPU\"}
+{\"job_id\":3,\"pid\":0,\"cmd\":\"sleep 5&\"}" \
+    "run --nice 19 --rlimit-as 1G sleep 5 &" "run --cpus $CPU" "sleep 5&" "run --reset" "sleep 5&" \
+    "jobs -l" "jobs -l -j | sed -E 's/\"pid\":[0-9]+/\"pid\":0/; s/,\"elapsed[^}]*maxrss_kb\":[0-9]+//'" \
+    "quit kill > /dev/null"
+
+check "smash error: run: invalid --cpus value 'x'
+smash error: run: --nice needs a value
+smash error: run: invalid --nice value '20'
+smash error: run: invalid --ionice value 'be:8'
+smash error: run: invalid --rlimit-as value '1Q'
+smash error: run: --reset takes no command
+1
+smash error: run: setrlimit failed: Operation not permitted
+1" \
+    "run --cpus x ls" "run --nice" "run --nice 20 ls" "run --ionice be:8 ls" "run --rlimit-as 1Q ls" \
+    "run --reset ls" 'echo $?' "run --rlimit-nofile $(($(cat /proc/sys/fs/nr_open) + 1)) ls" 'echo $?'
+
+check "smash error: run: cgroup limits need smash --cgroups" "run --pids-max 10 ls"
+
+# job trees: a job that leaves a daemon behind (setsid), killed with kill, timeout and quit kill
+DAEMON_JOB='bash -c "setsid sleep 1001 & sleep 1002"'
+check "signal number 9 was sent to pid N
+1" "$DAEMON_JOB &" "sleep 0.3" "kill -9 1" "sleep 0.3" "$ALIVE 1001"
+pkill -f '^sleep 100[12]$'
+
+if SMASH_HISTFILE= "$SMASH" --cgroups -c true 2>&1 | grep -q 'jobs stay process groups'; then
+    echo "SKIP --cgroups: no writable cgroup v2 hierarchy"
+    exit $FAILED
+fi
+SMASH_FLAGS=--cgroups
+check "[1] $DAEMON_JOB & : cgroup job-1
+signal number 9 was sent to pid N
+0
+0" "$DAEMON_JOB &" "sleep 0.3" "jobs -l" "kill -9 1" "sleep 0.3" "$ALIVE 1001" "$ALIVE 1002"
+check "smash: got an alarm
+smash: timeout 1 bash -c \"setsid sleep 1003 & sleep 1004\" timed out!
+0" "timeout 1 bash -c \"setsid sleep 1003 & sleep 1004\"" "sleep 0.3" "$ALIVE 1003"
+check "smash: sending SIGKILL signal to 1 jobs:
+N: sleep 1006&" 'bash -c "setsid sleep 1005 &"' "sleep 1006&" "sleep 0.2" "quit kill"
+sleep 0.3
+check "0
+0" "$ALIVE 1005" "$ALIVE 1006"
+
+exit $FAILED
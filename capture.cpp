@@ -0,0 +1,180 @@
+#include "capture.h"
+#include "errors.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#define CAPTURE_EPOLL_BATCH_SIZE (64)
+#define CAPTURE_MAX_PIPE_SIZE (1024 * 1024) // the default unprivileged /proc/sys/fs/pipe-max-size
+
+using namespace std;
+
+///////////////////RingBuffer start//////////////////////////
+
+RingBuffer::RingBuffer(size_t capacity) : capacity(capacity) {}
+
+void RingBuffer::append(const char* data, size_t len) {
+    if (len > this->capacity) {
+        // only the tail survives
+        data += len - this->capacity;
+        this->written += len - this->capacity;
+        len = this->capacity;
+    }
+    if (this->buff.size() < this->capacity) {
+        if (this->written + len <= this->capacity) {
+            this->buff.insert(this->buff.end(), data, data + len);
+            this->written += len;
+            return;
+        }
+        this->buff.resize(this->capacity); // full from here on, byte n lives at n % capacity
+    }
+    while (len > 0) {
+        size_t pos = this->written % this->capacity;
+        size_t chunk = min(len, this->capacity - pos);
+        memcpy(&this->buff[pos], data, chunk);
+        this->written += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void RingBuffer::read(uint64_t offset, string& out) const {
+    offset = max(offset, this->begin());
+    while (offset < this->written) {
+        size_t pos = offset % this->capacity;
+        size_t chunk = min((size_t)(this->written - offset), this->buff.size() - pos);
+        out.append(&this->buff[pos], chunk);
+        offset += chunk;
+    }
+}
+
+///////////////////RingBuffer end//////////////////////////
+
+///////////////////CaptureTable start//////////////////////////
+
+CaptureTable::~CaptureTable() {
+    for (auto& entry : this->captures) {
+        if (entry.second.fd != -1) {
+            close(entry.second.fd);
+        }
+    }
+    if (this->epoll_fd != -1) {
+        close(this->epoll_fd);
+    }
+}
+
+void CaptureTable::openPipe(int fd[2]) const {
+    if (-1 == pipe2(fd, O_CLOEXEC)) {
+        throw SmashSysFailure("pipe failed");
+    }
+    // smash never waits on the read end; the job keeps the usual blocking write end
+    fcntl(fd[0], F_SETFL, O_NONBLOCK);
+    // room for a burst while smash is busy elsewhere, best effort (per-user pipe limits apply)
+    fcntl(fd[0], F_SETPIPE_SZ, (int)min(this->ring_size, (size_t)CAPTURE_MAX_PIPE_SIZE));
+}
+
+void CaptureTable::add(int id, int read_fd) {
+    if (this->epoll_fd == -1) {
+        this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (this->epoll_fd == -1) {
+            close(read_fd);
+            throw SmashSysFailure("epoll_create1 failed");
+        }
+    }
+    auto old = this->captures.find(id);
+    if (old != this->captures.end()) {
+        this->closePipe(old->second);
+        this->captures.erase(old);
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)id;
+    if (-1 == epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, read_fd, &ev)) {
+        close(read_fd);
+        throw SmashSysFailure("epoll_ctl failed");
+    }
+    this->captures.emplace(id, Capture_t{read_fd, RingBuffer(this->ring_size), this->next_seq++});
+    this->n_open++;
+    this->dropOldFinished();
+}
+
+void CaptureTable::closePipe(Capture_t& capture) {
+    if (capture.fd == -1) {
+        return;
+    }
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, capture.fd, nullptr);
+    close(capture.fd);
+    capture.fd = -1;
+    this->n_open--;
+}
+
+void CaptureTable::dropOldFinished() {
+    size_t n_finished = this->captures.size() - this->n_open;
+    while (n_finished > CAPTURE_MAX_FINISHED) {
+        auto oldest = this->captures.end();
+        for (auto it = this->captures.begin(); it != this->captures.end(); ++it) {
+            if (it->second.fd == -1 && (oldest == this->captures.end() || it->second.seq < oldest->second.seq)) {
+                oldest = it;
+            }
+        }
+        this->captures.erase(oldest);
+        n_finished--;
+    }
+}
+
+/*
+ * Reads until the pipe is empty, but no more than one ring's worth per call: anything past that would
+ * only overwrite what was just read, and a fast writer must not keep smash here forever.
+ */
+void CaptureTable::readPipe(Capture_t& capture) {
+    char buff[CAPTURE_PIPE_READ_SIZE];
+    size_t total = 0;
+    while (capture.fd != -1 && total < this->ring_size) {
+        ssize_t rbytes = ::read(capture.fd, buff, sizeof(buff));
+        if (rbytes > 0) {
+            capture.ring.append(buff, rbytes);
+            total += rbytes;
+        } else if (rbytes == 0 || (errno != EINTR && errno != EAGAIN)) {
+            this->closePipe(capture); // every writer is gone
+        } else if (errno == EAGAIN) {
+            return;
+        }
+    }
+}
+
+bool CaptureTable::drain(int timeout_ms) {
+    if (this->n_open == 0) {
+        return true;
+    }
+    struct epoll_event events[CAPTURE_EPOLL_BATCH_SIZE];
+    int n_ready = epoll_wait(this->epoll_fd, events, CAPTURE_EPOLL_BATCH_SIZE, timeout_ms);
+    if (n_ready == -1) {
+        if (errno == EINTR) {
+            return false;
+        }
+        throw SmashSysFailure("epoll_wait failed");
+    }
+    for (int i = 0; i < n_ready; i++) {
+        auto it = this->captures.find((int)events[i].data.u64);
+        if (it != this->captures.end()) {
+            this->readPipe(it->second);
+        }
+    }
+    this->dropOldFinished();
+    return true;
+}
+
+const RingBuffer* CaptureTable::ring(int id) const {
+    auto it = this->captures.find(id);
+    return (it == this->captures.end() ? nullptr : &it->second.ring);
+}
+
+bool CaptureTable::isOpen(int id) const {
+    auto it = this->captures.find(id);
+    return (it != this->captures.end() && it->second.fd != -1);
+}
+
+///////////////////CaptureTable end//////////////////////////
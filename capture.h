@@ -0,0 +1,87 @@
+#ifndef SMASH_CAPTURE_H_
+#define SMASH_CAPTURE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#define CAPTURE_DEFAULT_RING_SIZE (64 * 1024)
+#define CAPTURE_MIN_RING_SIZE (4 * 1024)
+#define CAPTURE_MAX_RING_SIZE (64 * 1024 * 1024)
+#define CAPTURE_PIPE_READ_SIZE (64 * 1024)
+#define CAPTURE_MAX_FINISHED (64)
+
+/*
+ * Fixed-capacity byte ring keeping the newest bytes written to it. Memory grows with the output up to
+ * the capacity and never past it. Offsets count every byte ever written, so a reader can resume where
+ * it stopped and tell how much was overwritten in between.
+ */
+class RingBuffer {
+    std::vector<char> buff;
+    size_t capacity;
+    uint64_t written = 0;
+public:
+    explicit RingBuffer(size_t capacity);
+    void append(const char* data, size_t len);
+    // offset of the oldest byte still held
+    uint64_t begin() const { return written > capacity ? written - capacity : 0; }
+    uint64_t end() const { return written; }
+    // appends the held bytes from offset (moved up to begin() if they were overwritten) to out
+    void read(uint64_t offset, std::string& out) const;
+};
+
+/*
+ * Output of background jobs started with "&!" (or every "&" job once "capture on" is set). A job's
+ * stdout and stderr share one pipe whose read end smash drains into the job's ring from its event
+ * loops: the prompt, foreground waits and the server. Draining never waits on a reader, and a full
+ * ring drops its oldest bytes, so a job is never blocked on its output for longer than it takes
+ * smash to get back to a loop. The rings of finished jobs are kept for the last CAPTURE_MAX_FINISHED.
+ */
+class CaptureTable {
+    struct Capture_t {
+        int fd;              // read end of the job's pipe, -1 once every writer closed it
+        RingBuffer ring;
+        uint64_t seq;        // creation order, the oldest finished capture is dropped first
+    };
+    std::map<int, Capture_t> captures;  // by job id
+    int epoll_fd = -1;                  // every open pipe, created on first use
+    size_t n_open = 0;
+    uint64_t next_seq = 0;
+    size_t ring_size = CAPTURE_DEFAULT_RING_SIZE;
+    bool capture_all = false;
+
+    void readPipe(Capture_t& capture);
+    void closePipe(Capture_t& capture);
+    void dropOldFinished();
+public:
+    CaptureTable() = default;
+    CaptureTable(const CaptureTable&) = delete;
+    void operator=(const CaptureTable&) = delete;
+    ~CaptureTable();
+
+    // pipe for a new job: fd[0] is handed to add(), fd[1] becomes the job's stdout and stderr
+    void openPipe(int fd[2]) const;
+    // starts draining read_fd into a fresh ring for job id, replacing an older job with the same id
+    void add(int id, int read_fd);
+    /*
+     * Reads every pipe with pending data into its ring, waiting up to timeout_ms (-1: until one has
+     * data) for the first one. Returns false if the wait was interrupted by a signal.
+     */
+    bool drain(int timeout_ms);
+    // readable while some pipe has data, -1 until the first capture
+    int eventFd() const { return epoll_fd; }
+    // whether any job still writes to a pipe
+    bool active() const { return n_open > 0; }
+
+    const RingBuffer* ring(int id) const;
+    // true until the job (and whatever inherited its output) closed the pipe and it was drained
+    bool isOpen(int id) const;
+
+    size_t ringSize() const { return ring_size; }
+    void setRingSize(size_t size) { ring_size = size; }
+    bool captureAll() const { return capture_all; }
+    void setCaptureAll(bool on) { capture_all = on; }
+};
+
+#endif //SMASH_CAPTURE_H_
@@ -0,0 +1,252 @@
+#include "cgroups.h"
+#include "errors.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static bool _writeCgroupFile(const string& path, const string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    bool written = (write(fd, value.c_str(), value.size()) == (ssize_t)value.size());
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return written;
+}
+
+// at most CGROUP_READ_SIZE - 1 bytes of a small cgroup file, nul terminated; -1 if it cannot be read
+static ssize_t _readCgroupFile(int dir_fd, const char* name, char* buff) {
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t len = read(fd, buff, CGROUP_READ_SIZE - 1);
+    close(fd);
+    buff[len > 0 ? len : 0] = '\0';
+    return len;
+}
+
+JobCgroup::JobCgroup(const string& path, int dir_fd, int procs_fd, int kill_fd) :
+    path(path), dir_fd(dir_fd), procs_fd(procs_fd), kill_fd(kill_fd), owner(getpid()) {}
+
+JobCgroup::~JobCgroup() {
+    close(this->dir_fd);
+    close(this->procs_fd);
+    if (this->kill_fd != -1) {
+        close(this->kill_fd);
+    }
+    if (getpid() == this->owner) {
+        rmdir(this->path.c_str()); // EBUSY while processes that outlived the job remain
+    }
+}
+
+bool JobCgroup::join() const {
+    return write(this->procs_fd, "0", 1) == 1;
+}
+
+int JobCgroup::signalAll(int sig, pid_t except) const {
+    if (sig == SIGKILL && this->kill_fd != -1) {
+        return (write(this->kill_fd, "1", 1) == 1 ? 0 : -1);
+    }
+    int fd = openat(this->dir_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    // one pid per line; a pid cut at the end of a read is carried over to the next one
+    char buff[CGROUP_READ_SIZE];
+    size_t carried = 0;
+    ssize_t len;
+    while ((len = read(fd, buff + carried, sizeof(buff) - carried)) > 0) {
+        size_t end = carried + len;
+        size_t start = 0;
+        for (size_t i = 0; i < end; i++) {
+            if (buff[i] == '\n') {
+                buff[i] = '\0';
+                pid_t pid = (pid_t)strtol(buff + start, nullptr, 10);
+                if (pid != except) {
+                    kill(pid, sig);
+                }
+                start = i + 1;
+            }
+        }
+        carried = end - start;
+        memmove(buff, buff + start, carried);
+    }
+    close(fd);
+    return (len == -1 ? -1 : 0);
+}
+
+bool JobCgroup::readUsage(double* cpu_secs, long* peak_kb) const {
+    char buff[CGROUP_READ_SIZE];
+    if (_readCgroupFile(this->dir_fd, "cpu.stat", buff) <= 0) {
+        return false;
+    }
+    const char* usage = strstr(buff, "usage_usec ");
+    if (usage == nullptr) {
+        return false;
+    }
+    *cpu_secs = strtoull(usage + strlen("usage_usec "), nullptr, 10) / 1e6;
+    *peak_kb = -1;
+    if (_readCgroupFile(this->dir_fd, "memory.peak", buff) > 0) {
+        *peak_kb = (long)(strtoull(buff, nullptr, 10) / 1024);
+    }
+    return true;
+}
+
+// the mount point of the cgroup v2 hierarchy, empty when there is none
+static string _findCgroup2Mount() {
+    ifstream mountinfo(CGROUP_MOUNTINFO_FILE);
+    string line;
+    while (getline(mountinfo, line)) {
+        size_t separator = line.find(" - ");
+        if (separator == string::npos || line.compare(separator + 3, strlen("cgroup2 "), "cgroup2 ") != 0) {
+            continue;
+        }
+        istringstream fields(line.substr(0, separator));
+        string id, parent, dev, root, mount_point;
+        fields >> id >> parent >> dev >> root >> mount_point;
+        return mount_point;
+    }
+    return "";
+}
+
+bool CgroupManager::enable(string* error) {
+    string mount_point = _findCgroup2Mount();
+    if (mount_point.empty()) {
+        *error = "no cgroup v2 hierarchy is mounted";
+        return false;
+    }
+    ifstream self(CGROUP_SELF_FILE);
+    string line, own;
+    while (getline(self, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            own = mount_point + (line.size() > 4 ? line.substr(3) : "");
+        }
+    }
+    if (own.empty()) {
+        *error = "smash is not in the cgroup v2 hierarchy";
+        return false;
+    }
+
+    string base = own + "/smash-" + to_string(getpid());
+    string shell = base + "/" CGROUP_SHELL_DIR;
+    rmdir(shell.c_str()); // left by an earlier smash with the same pid
+    rmdir(base.c_str());
+    if (mkdir(base.c_str(), 0755) == -1 || mkdir(shell.c_str(), 0755) == -1 ||
+        !_writeCgroupFile(shell + "/cgroup.procs", to_string(getpid()))) {
+        *error = "cannot create " + base + ": " + strerror(errno);
+        rmdir(shell.c_str());
+        rmdir(base.c_str());
+        return false;
+    }
+
+    ifstream available_file(base + "/cgroup.controllers");
+    string available;
+    getline(available_file, available);
+    available = " " + available + " ";
+    for (const char* controller : {CGROUP_CONTROLLERS}) {
+        if (available.find(string(" ") + controller + " ") != string::npos &&
+            _writeCgroupFile(base + "/cgroup.subtree_control", string("+") + controller)) {
+            this->controllers.push_back(controller);
+        }
+    }
+    this->base = base;
+    this->orig = own;
+    this->owner = getpid();
+    return true;
+}
+
+void CgroupManager::stop() {
+    if (!this->enabled() || getpid() != this->owner) {
+        return;
+    }
+    this->pending = nullptr;
+    _writeCgroupFile(this->orig + "/cgroup.procs", to_string(getpid()));
+    DIR* dir = opendir(this->base.c_str());
+    struct dirent* entry;
+    while (dir != nullptr && (entry = readdir(dir)) != nullptr) {
+        if (strncmp(entry->d_name, CGROUP_JOB_PREFIX, strlen(CGROUP_JOB_PREFIX)) == 0) {
+            rmdir((this->base + "/" + entry->d_name).c_str()); // jobs still running keep theirs
+        }
+    }
+    if (dir != nullptr) {
+        closedir(dir);
+    }
+    rmdir((this->base + "/" CGROUP_SHELL_DIR).c_str());
+    rmdir(this->base.c_str());
+    this->base.clear();
+}
+
+bool CgroupManager::hasController(const string& name) const {
+    for (const string& controller : this->controllers) {
+        if (controller == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+JobCgroupPtr CgroupManager::forFork(const vector<pair<string, string>>& limits) {
+    if (!this->enabled() || this->pending != nullptr) {
+        return this->pending;
+    }
+    string path = this->base + "/" CGROUP_JOB_PREFIX + to_string(this->next_id++);
+    if (mkdir(path.c_str(), 0755) == -1) {
+        throw SmashSysFailure("cgroup: mkdir failed");
+    }
+    int dir_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int procs_fd = (dir_fd == -1 ? -1 : openat(dir_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC));
+    if (procs_fd == -1) {
+        int saved_errno = errno;
+        if (dir_fd != -1) {
+            close(dir_fd);
+        }
+        rmdir(path.c_str());
+        errno = saved_errno;
+        throw SmashSysFailure("cgroup: open failed");
+    }
+    // from here on the destructor cleans up
+    JobCgroupPtr cgroup = make_shared<JobCgroup>(path, dir_fd, procs_fd,
+                                                 openat(dir_fd, "cgroup.kill", O_WRONLY | O_CLOEXEC));
+    for (const auto& limit : limits) {
+        if (!_writeCgroupFile(path + "/" + limit.first, limit.second)) {
+            throw SmashSysFailure("cgroup: " + limit.first + " failed");
+        }
+    }
+    this->pending = cgroup;
+    return cgroup;
+}
+
+JobCgroupPtr CgroupManager::takePending() {
+    JobCgroupPtr cgroup = this->pending;
+    this->pending = nullptr;
+    return cgroup;
+}
+
+void CgroupManager::killAll() {
+    if (!this->enabled()) {
+        return;
+    }
+    DIR* dir = opendir(this->base.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strncmp(entry->d_name, CGROUP_JOB_PREFIX, strlen(CGROUP_JOB_PREFIX)) == 0) {
+            _writeCgroupFile(this->base + "/" + entry->d_name + "/cgroup.kill", "1");
+        }
+    }
+    closedir(dir);
+}
@@ -0,0 +1,85 @@
+#ifndef SMASH_CGROUPS_H_
+#define SMASH_CGROUPS_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <sys/types.h>
+
+#define CGROUP_MOUNTINFO_FILE "/proc/self/mountinfo"
+#define CGROUP_SELF_FILE "/proc/self/cgroup"
+#define CGROUP_SHELL_DIR "shell"
+#define CGROUP_JOB_PREFIX "job-"
+#define CGROUP_CONTROLLERS "cpu", "memory", "pids"
+#define CGROUP_READ_SIZE (4096)
+
+/*
+ * The cgroup of one job, a leaf under smash's own. Every process the job's command line forks joins
+ * it before exec, so the job's whole tree, daemonized grandchildren included, can be signaled and
+ * accounted as one. The directory is removed with the last reference, unless processes remain.
+ */
+class JobCgroup {
+    std::string path;
+    int dir_fd;
+    int procs_fd;   // cgroup.procs, for join()
+    int kill_fd;    // cgroup.kill, -1 before Linux 5.14
+    pid_t owner;    // forked children must not remove the directory
+public:
+    JobCgroup(const std::string& path, int dir_fd, int procs_fd, int kill_fd);
+    JobCgroup(const JobCgroup&) = delete;
+    void operator=(const JobCgroup&) = delete;
+    ~JobCgroup();
+    const std::string& getPath() const { return path; }
+    // in a forked child: moves the calling process into the cgroup
+    bool join() const;
+    /*
+     * Sends sig to every process in the cgroup, through cgroup.kill for SIGKILL. Only raw syscalls on
+     * fds opened at creation, so it is safe from the signal handlers. -1 if the cgroup cannot be read.
+     * except (the job's leader, signaled on its own) is skipped unless cgroup.kill is used.
+     */
+    int signalAll(int sig, pid_t except = -1) const;
+    // CPU time of the whole tree from cpu.stat, and memory.peak in KB (-1 without the memory controller)
+    bool readUsage(double* cpu_secs, long* peak_kb) const;
+};
+
+typedef std::shared_ptr<JobCgroup> JobCgroupPtr;
+
+/*
+ * Job cgroups under a writable cgroup v2 hierarchy ("smash --cgroups"). enable() creates
+ * <smash's cgroup>/smash-<pid>, moves smash itself into its "shell" leaf, which v2 requires before
+ * the cpu, memory and pids controllers can be enabled for the job leaves next to it, and stop()
+ * moves smash back and removes what is empty. Without a usable hierarchy jobs stay plain process
+ * groups.
+ */
+class CgroupManager {
+    std::string base;          // empty while disabled
+    std::string orig;          // smash's cgroup before enable()
+    std::vector<std::string> controllers; // enabled for the job leaves
+    unsigned long next_id = 1;
+    JobCgroupPtr pending;      // the running command line's cgroup, made on its first fork
+    pid_t owner = -1;
+public:
+    CgroupManager() = default;
+    CgroupManager(const CgroupManager&) = delete;
+    void operator=(const CgroupManager&) = delete;
+    ~CgroupManager() { stop(); }
+    // false with the reason in error when no writable cgroup v2 hierarchy holds smash
+    bool enable(std::string* error);
+    void stop();
+    bool enabled() const { return !base.empty(); }
+    bool hasController(const std::string& name) const;
+    // a new command line starts: its first fork gets a fresh cgroup
+    void beginCommand() { pending = nullptr; }
+    /*
+     * Before a fork: the running command line's cgroup, created with limits (file, value) on first
+     * use, or nullptr while disabled. Throws SmashSysFailure when it cannot be created.
+     */
+    JobCgroupPtr forFork(const std::vector<std::pair<std::string, std::string>>& limits);
+    // the running command line's cgroup, for its job entry; nullptr if it forked nothing
+    JobCgroupPtr takePending();
+    // SIGKILL to what is left in every job cgroup (daemons of jobs that are gone), for quit kill
+    void killAll();
+};
+
+#endif //SMASH_CGROUPS_H_
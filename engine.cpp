@@ -0,0 +1,427 @@
+#include "engine.h"
+#include "proc.h"
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+
+using namespace std;
+
+static string _describe(const vector<string>& argv) {
+    string description;
+    for (const string& arg : argv) {
+        description += (description.empty() ? "" : " ") + arg;
+    }
+    return description;
+}
+
+SmashEngine::SmashEngine() {
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd == -1) {
+        throw SmashSysFailure("epoll_create1 failed");
+    }
+}
+
+SmashEngine::~SmashEngine() {
+    for (auto& entry : this->job_table) {
+        if (entry.second.state != ENGINE_EXITED) {
+            killpg(entry.second.pgid, SIGKILL);
+        }
+    }
+    for (auto& entry : this->procs) {
+        int status;
+        _waitProcess(entry.first, &status, 0);
+        if (entry.second.owns_pidfd && entry.second.pidfd != -1) {
+            close(entry.second.pidfd);
+        }
+    }
+    close(this->epoll_fd);
+}
+
+///////////////////Launching start//////////////////////////
+
+pid_t SmashEngine::spawn(char* const argv[], pid_t pgid, int in_fd, int out_fd, int err_fd,
+                         const LaunchOptions_t& opts) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    int fds[] = {in_fd, out_fd, err_fd};
+    for (int fd = STDIN_FD; fd <= STDERR_FD; fd++) {
+        if (fds[fd] != ENGINE_INHERIT_FD) {
+            posix_spawn_file_actions_adddup2(&actions, fds[fd], fd);
+        }
+    }
+    if (!opts.cwd.empty()) {
+        posix_spawn_file_actions_addchdir_np(&actions, opts.cwd.c_str());
+    }
+    // whatever the embedding process ignores or blocks, the job starts with the defaults
+    sigset_t all_signals, no_signals;
+    sigfillset(&all_signals);
+    sigemptyset(&no_signals);
+    posix_spawnattr_setsigdefault(&attr, &all_signals);
+    posix_spawnattr_setsigmask(&attr, &no_signals);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+    vector<char*> env_ptrs;
+    char** envp = environ;
+    if (opts.env != nullptr) {
+        for (const string& entry : *opts.env) {
+            env_ptrs.push_back((char*)entry.c_str());
+        }
+        env_ptrs.push_back(nullptr);
+        envp = env_ptrs.data();
+    }
+
+    pid_t pid;
+    uint64_t start_ns = _monotonicNs();
+    int ret = posix_spawnp(&pid, argv[0], &actions, &attr, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (ret != 0) {
+        errno = ret;
+        throw SmashSysFailure("posix_spawn failed");
+    }
+    uint64_t spawn_ns = _monotonicNs() - start_ns;
+    this->spawn_stats.spawns++;
+    this->spawn_stats.spawn_total_ns += spawn_ns;
+    this->spawn_stats.spawn_max_ns = max(this->spawn_stats.spawn_max_ns, spawn_ns);
+    return pid;
+}
+
+void SmashEngine::track(EngineJob_t& job, pid_t pid, int pidfd) {
+    job.pids.push_back(pid);
+    bool owns_pidfd = (pidfd == -1);
+    if (owns_pidfd) {
+        pidfd = _pidfdOpen(pid);
+    }
+    this->procs[pid] = {job.id, pidfd, owns_pidfd};
+    if (pidfd == -1) {
+        this->unwatched++;
+        return;
+    }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)pid;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, pidfd, &ev);
+}
+
+engine_job_id SmashEngine::launch(const vector<string>& argv, const LaunchOptions_t& opts) {
+    return this->pipeline({argv}, opts);
+}
+
+engine_job_id SmashEngine::launchShell(const string& cmd_line, const LaunchOptions_t& opts) {
+    engine_job_id id = this->pipeline({{"/bin/bash", "-c", cmd_line}}, opts);
+    this->job_table[id].description = cmd_line;
+    return id;
+}
+
+engine_job_id SmashEngine::pipeline(const vector<vector<string>>& stages, const LaunchOptions_t& opts) {
+    if (stages.empty() || any_of(stages.begin(), stages.end(), [](const vector<string>& s) { return s.empty(); })) {
+        throw SmashCmdError("engine: empty command");
+    }
+    EngineJob_t job = {this->next_id, 0, {}, "", ENGINE_RUNNING, 0, false, _monotonicNs(), 0, {}};
+    if (opts.timeout_s > 0) {
+        job.deadline_ns = job.start_ns + (uint64_t)(opts.timeout_s * 1e9);
+    }
+
+    vector<pid_t> started;
+    int prev_read = ENGINE_INHERIT_FD;
+    try {
+        for (size_t i = 0; i < stages.size(); i++) {
+            bool last = (i + 1 == stages.size());
+            int fd[2] = {ENGINE_INHERIT_FD, ENGINE_INHERIT_FD};
+            if (!last && -1 == pipe2(fd, O_CLOEXEC)) {
+                throw SmashSysFailure("pipe failed");
+            }
+            vector<char*> argv;
+            for (const string& arg : stages[i]) {
+                argv.push_back((char*)arg.c_str());
+            }
+            argv.push_back(nullptr);
+
+            pid_t pid = -1;
+            try {
+                pid = this->spawn(argv.data(), job.pgid, (i == 0 ? opts.stdin_fd : prev_read),
+                                  (last ? opts.stdout_fd : fd[STDOUT_FD]), opts.stderr_fd, opts);
+            } catch (SmashSysFailure&) {
+                if (!last) {
+                    close_pipe(fd);
+                }
+                throw;
+            }
+            started.push_back(pid);
+            if (job.pgid == 0) {
+                job.pgid = pid; // the first stage leads the group, it stays alive as a zombie until reaped
+            }
+            if (prev_read != ENGINE_INHERIT_FD) {
+                close(prev_read);
+            }
+            if (!last) {
+                close(fd[STDOUT_FD]);
+                prev_read = fd[STDIN_FD];
+            }
+            job.description += (i == 0 ? "" : " | ") + _describe(stages[i]);
+        }
+    } catch (SmashSysFailure&) {
+        int saved_errno = errno;
+        if (prev_read != ENGINE_INHERIT_FD) {
+            close(prev_read);
+        }
+        if (job.pgid != 0) {
+            killpg(job.pgid, SIGKILL); // half a pipeline is no use
+        }
+        for (pid_t pid : started) {
+            int status;
+            _waitProcess(pid, &status, 0);
+        }
+        errno = saved_errno;
+        throw;
+    }
+
+    this->next_id++;
+    EngineJob_t& entry = (this->job_table[job.id] = job);
+    for (pid_t pid : started) {
+        this->track(entry, pid);
+    }
+    return entry.id;
+}
+
+engine_job_id SmashEngine::adopt(pid_t pid, const string& description, int pidfd) {
+    EngineJob_t job = {this->next_id++, pid, {}, description, ENGINE_RUNNING, 0, false, _monotonicNs(), 0, {}};
+    EngineJob_t& entry = (this->job_table[job.id] = job);
+    this->track(entry, pid, pidfd);
+    return entry.id;
+}
+
+///////////////////Launching end//////////////////////////
+
+///////////////////Job state start//////////////////////////
+
+void SmashEngine::setState(EngineJob_t& job, EngineJobState state) {
+    if (job.state == state) {
+        return;
+    }
+    job.state = state;
+    if (this->callback) {
+        this->callback(job); // last use of job: the callback may forget it
+    }
+}
+
+void SmashEngine::untrack(map<pid_t, Proc_t>::iterator proc) {
+    if (proc->second.pidfd != -1) {
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, proc->second.pidfd, nullptr);
+        if (proc->second.owns_pidfd) {
+            close(proc->second.pidfd);
+        }
+    } else {
+        this->unwatched--;
+    }
+    this->procs.erase(proc);
+}
+
+void SmashEngine::reap(pid_t pid, int options) {
+    auto it = this->procs.find(pid);
+    if (it == this->procs.end()) {
+        return;
+    }
+    auto job_it = this->job_table.find(it->second.job);
+    int status = 0;
+    struct rusage usage;
+    pid_t ret = _waitProcess(pid, &status, options | WNOHANG, &usage);
+    if (ret == 0 || job_it == this->job_table.end() || (ret == -1 && errno != ECHILD)) {
+        return;
+    }
+    EngineJob_t& job = job_it->second;
+    if (ret == pid && WIFSTOPPED(status)) {
+        this->setState(job, ENGINE_STOPPED);
+        return;
+    }
+    if (ret == pid && WIFCONTINUED(status)) {
+        this->setState(job, ENGINE_RUNNING);
+        return;
+    }
+
+    // exited (or reaped behind our back, ECHILD)
+    this->untrack(it);
+    if (pid == job.pids.back() && ret == pid) {
+        job.exit_status = status;
+        job.usage = usage;
+    }
+    bool all_done = none_of(job.pids.begin(), job.pids.end(), [this](pid_t p) { return this->procs.count(p) != 0; });
+    if (all_done) {
+        this->setState(job, ENGINE_EXITED);
+    }
+}
+
+void SmashEngine::refresh(EngineJob_t& job) {
+    vector<pid_t> pids = job.pids; // reap may end in a callback that forgets the job
+    for (pid_t pid : pids) {
+        this->reap(pid, WUNTRACED | WCONTINUED);
+    }
+}
+
+vector<EngineJob_t> SmashEngine::jobs() {
+    vector<engine_job_id> ids;
+    for (auto& entry : this->job_table) {
+        ids.push_back(entry.first);
+    }
+    vector<EngineJob_t> list;
+    for (engine_job_id id : ids) {
+        const EngineJob_t* job = this->job(id);
+        if (job != nullptr) {
+            list.push_back(*job);
+        }
+    }
+    return list;
+}
+
+const EngineJob_t* SmashEngine::job(engine_job_id id) {
+    auto it = this->job_table.find(id);
+    if (it == this->job_table.end()) {
+        return nullptr;
+    }
+    this->refresh(it->second);
+    it = this->job_table.find(id);
+    return (it == this->job_table.end() ? nullptr : &it->second);
+}
+
+void SmashEngine::signal(engine_job_id id, int sig_num) {
+    auto it = this->job_table.find(id);
+    if (it == this->job_table.end()) {
+        throw SmashCmdError("engine: job " + to_string(id) + " does not exist");
+    }
+    if (it->second.state == ENGINE_EXITED) {
+        return; // its process group may already belong to someone else
+    }
+    if (-1 == killpg(it->second.pgid, sig_num)) {
+        throw SmashSysFailure("killpg failed");
+    }
+}
+
+void SmashEngine::setTimeout(engine_job_id id, double seconds) {
+    auto it = this->job_table.find(id);
+    if (it == this->job_table.end()) {
+        throw SmashCmdError("engine: job " + to_string(id) + " does not exist");
+    }
+    it->second.deadline_ns = (seconds > 0 ? _monotonicNs() + (uint64_t)(seconds * 1e9) : 0);
+}
+
+void SmashEngine::onJobEvent(JobCallback cb) {
+    this->callback = std::move(cb);
+}
+
+void SmashEngine::release(engine_job_id id) {
+    auto it = this->job_table.find(id);
+    if (it == this->job_table.end()) {
+        return;
+    }
+    for (pid_t pid : it->second.pids) {
+        auto proc = this->procs.find(pid);
+        if (proc != this->procs.end()) {
+            this->untrack(proc);
+        }
+    }
+    this->job_table.erase(it);
+}
+
+void SmashEngine::forget(engine_job_id id) {
+    auto it = this->job_table.find(id);
+    if (it == this->job_table.end()) {
+        return;
+    }
+    if (it->second.state != ENGINE_EXITED) {
+        throw SmashCmdError("engine: job " + to_string(id) + " is still running");
+    }
+    this->job_table.erase(it);
+}
+
+///////////////////Job state end//////////////////////////
+
+///////////////////Event loop start//////////////////////////
+
+const EngineStats_t& SmashEngine::stats() const {
+    return this->spawn_stats;
+}
+
+int SmashEngine::eventFd() const {
+    return this->epoll_fd;
+}
+
+void SmashEngine::enforceTimeouts(uint64_t now_ns) {
+    for (auto& entry : this->job_table) {
+        EngineJob_t& job = entry.second;
+        if (job.deadline_ns != 0 && job.deadline_ns <= now_ns && job.state != ENGINE_EXITED) {
+            killpg(job.pgid, SIGKILL); // the exit arrives like any other
+            job.timed_out = true;
+            job.deadline_ns = 0;
+        }
+    }
+}
+
+int SmashEngine::pollTimeoutMs(int timeout_ms) const {
+    uint64_t now_ns = _monotonicNs();
+    for (const auto& entry : this->job_table) {
+        const EngineJob_t& job = entry.second;
+        if (job.deadline_ns == 0 || job.state == ENGINE_EXITED) {
+            continue;
+        }
+        int until_ms = (job.deadline_ns <= now_ns ? 0 : (int)((job.deadline_ns - now_ns + 999999) / 1000000));
+        timeout_ms = (timeout_ms < 0 ? until_ms : min(timeout_ms, until_ms));
+    }
+    if (this->unwatched > 0 && (timeout_ms < 0 || timeout_ms > REAP_POLL_INTERVAL_MS)) {
+        timeout_ms = REAP_POLL_INTERVAL_MS; // exits without a pidfd are only seen by polling
+    }
+    return timeout_ms;
+}
+
+int SmashEngine::poll(int timeout_ms) {
+    if (this->procs.empty()) {
+        return 0;
+    }
+    struct epoll_event events[EPOLL_BATCH_SIZE];
+    int n_ready = epoll_wait(this->epoll_fd, events, EPOLL_BATCH_SIZE, this->pollTimeoutMs(timeout_ms));
+    if (n_ready == -1 && errno != EINTR) {
+        throw SmashSysFailure("epoll_wait failed");
+    }
+    for (int i = 0; i < n_ready; i++) {
+        this->reap((pid_t)events[i].data.u64, 0);
+    }
+    if (this->unwatched > 0) {
+        vector<pid_t> pids;
+        for (auto& entry : this->procs) {
+            if (entry.second.pidfd == -1) {
+                pids.push_back(entry.first);
+            }
+        }
+        for (pid_t pid : pids) {
+            this->reap(pid, 0);
+        }
+    }
+    this->enforceTimeouts(_monotonicNs());
+    return max(n_ready, 0);
+}
+
+int SmashEngine::wait(engine_job_id id) {
+    auto it = this->job_table.find(id);
+    if (it == this->job_table.end()) {
+        throw SmashCmdError("engine: job " + to_string(id) + " does not exist");
+    }
+    while ((it = this->job_table.find(id)) != this->job_table.end() && it->second.state != ENGINE_EXITED) {
+        this->poll(-1);
+    }
+    if (it == this->job_table.end()) {
+        throw SmashCmdError("engine: job " + to_string(id) + " was forgotten while waiting");
+    }
+    int code = _exitCode(it->second.exit_status);
+    this->job_table.erase(it);
+    return code;
+}
+
+///////////////////Event loop end//////////////////////////
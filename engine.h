@@ -0,0 +1,135 @@
+#ifndef SMASH_ENGINE_H_
+#define SMASH_ENGINE_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "errors.h"
+
+#define ENGINE_INHERIT_FD (-1)
+
+enum EngineJobState {ENGINE_RUNNING, ENGINE_STOPPED, ENGINE_EXITED};
+
+typedef int engine_job_id;
+
+// how a job is started, the defaults inherit everything from the embedding process
+typedef struct LaunchOptions_t {
+    int stdin_fd = ENGINE_INHERIT_FD;
+    int stdout_fd = ENGINE_INHERIT_FD;
+    int stderr_fd = ENGINE_INHERIT_FD;
+    std::string cwd;                                // empty: the caller's
+    const std::vector<std::string>* env = nullptr;  // "NAME=value" entries, nullptr: the caller's environ
+    double timeout_s = 0;                           // SIGKILL the job after this long, 0: never
+} LaunchOptions_t;
+
+typedef struct EngineJob_t {
+    engine_job_id id;
+    pid_t pgid;               // the job's process group, also the pid of its first process
+    std::vector<pid_t> pids;  // one per pipeline stage
+    std::string description;
+    EngineJobState state;
+    int exit_status;          // raw wait status of the last stage, valid once ENGINE_EXITED
+    bool timed_out;
+    uint64_t start_ns;
+    uint64_t deadline_ns;     // 0: no timeout
+    struct rusage usage;      // of the last stage, valid once ENGINE_EXITED
+} EngineJob_t;
+
+typedef std::function<void(const EngineJob_t&)> JobCallback;
+
+// counters of one instance, the engine records into no process-wide singleton
+typedef struct EngineStats_t {
+    uint64_t spawns = 0;
+    uint64_t spawn_total_ns = 0;  // time spent in posix_spawn
+    uint64_t spawn_max_ns = 0;
+} EngineStats_t;
+
+/*
+ * smash's launch and job control engine as a library object, for programs that embed it instead of
+ * running smash. Each instance owns its own job table. It installs no signal handlers and never
+ * writes to cout: state changes reach the caller through poll() and the job callback. Errors are
+ * thrown as SmashSysFailure (errno set) or SmashCmdError.
+ *
+ * Processes are started with posix_spawn, so embedding in a large process never copies its page
+ * tables. Every job gets its own process group. Exits are watched through pidfds in one epoll set,
+ * whose fd the caller can add to its own event loop. Stops and continues done outside the engine
+ * are picked up by jobs()/job(). An instance is not thread safe.
+ *
+ * smash's own background jobs are tracked by one of these: the REPL launches them (built-ins, the
+ * zygote, spawn attributes, cgroups) and hands each one over with adopt().
+ */
+class SmashEngine {
+    typedef struct Proc_t {
+        engine_job_id job;
+        int pidfd;
+        bool owns_pidfd;
+    } Proc_t;
+
+    std::map<engine_job_id, EngineJob_t> job_table;
+    std::map<pid_t, Proc_t> procs;  // live processes of every job
+    engine_job_id next_id = 1;
+    int epoll_fd = -1;
+    size_t unwatched = 0;           // processes without a pidfd, polled instead
+    JobCallback callback;
+    EngineStats_t spawn_stats;
+
+    pid_t spawn(char* const argv[], pid_t pgid, int in_fd, int out_fd, int err_fd, const LaunchOptions_t& opts);
+    void track(EngineJob_t& job, pid_t pid, int pidfd = -1);
+    void untrack(std::map<pid_t, Proc_t>::iterator proc);
+    void reap(pid_t pid, int options);
+    void refresh(EngineJob_t& job);
+    void setState(EngineJob_t& job, EngineJobState state);
+    void enforceTimeouts(uint64_t now_ns);
+public:
+    SmashEngine();
+    SmashEngine(const SmashEngine&) = delete;
+    void operator=(const SmashEngine&) = delete;
+    // kills and reaps the jobs that are still running
+    ~SmashEngine();
+
+    // argv[0] is looked up in PATH
+    engine_job_id launch(const std::vector<std::string>& argv, const LaunchOptions_t& opts = LaunchOptions_t());
+    // "/bin/bash -c cmd_line"
+    engine_job_id launchShell(const std::string& cmd_line, const LaunchOptions_t& opts = LaunchOptions_t());
+    // stage i's stdout is stage i+1's stdin, all stages share one process group and one job
+    engine_job_id pipeline(const std::vector<std::vector<std::string>>& stages,
+                           const LaunchOptions_t& opts = LaunchOptions_t());
+    /*
+     * Tracks a child the caller started itself, leading its own process group, as a one-process job.
+     * pidfd: one the caller holds for pid and keeps open while the job is tracked, -1: the engine opens its own.
+     */
+    engine_job_id adopt(pid_t pid, const std::string& description, int pidfd = -1);
+    // stops tracking the job without signaling or reaping it, the caller waits for it from now on
+    void release(engine_job_id id);
+
+    std::vector<EngineJob_t> jobs();
+    const EngineJob_t* job(engine_job_id id);
+    // signals the whole process group of the job
+    void signal(engine_job_id id, int sig_num);
+    // (re)arms the job's timeout, counted from now, 0 disarms it
+    void setTimeout(engine_job_id id, double seconds);
+    // called from poll() whenever a job stops, continues or exits
+    void onJobEvent(JobCallback cb);
+    const EngineStats_t& stats() const;
+
+    // readable when poll() has exits to process
+    int eventFd() const;
+    // how long a caller's own loop may wait on eventFd() before calling poll(): at most timeout_ms
+    // (-1: no limit), less when a timeout is due or some exits can only be polled for
+    int pollTimeoutMs(int timeout_ms) const;
+    /*
+     * Processes exits and expired timeouts, waiting up to timeout_ms (-1: until something happens).
+     * Returns the number of exit notifications handled, 0 right away when no job is running.
+     */
+    int poll(int timeout_ms);
+    // blocks until the job exits, returns its exit code (128 + signal if killed) and forgets it
+    int wait(engine_job_id id);
+    // drops an exited job from the table
+    void forget(engine_job_id id);
+};
+
+#endif //SMASH_ENGINE_H_
@@ -0,0 +1,9 @@
+#include "errors.h"
+
+using namespace std;
+
+SmashError::SmashError(const string& msg) : msg(string(ERROR_PREFIX) + msg) {}
+
+const char* SmashError::what() const noexcept {
+    return msg.c_str();
+}
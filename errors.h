@@ -0,0 +1,31 @@
+#ifndef SMASH_ERRORS_H_
+#define SMASH_ERRORS_H_
+
+#include <exception>
+#include <string>
+
+#define ERROR_PREFIX "smash error: "
+
+/*
+ * Errors of the shell and of the engine library. Messages carry the "smash error: " prefix, so the
+ * REPL prints SmashCmdError::what() as is and SmashSysFailure::what() through perror.
+ */
+class SmashError : public std::exception {
+    const std::string msg;
+public:
+    const char* what() const noexcept override;
+    explicit SmashError(const std::string& msg);
+};
+
+class SmashCmdError : public SmashError {
+public:
+    explicit SmashCmdError(const std::string& msg) : SmashError(msg) {}
+};
+
+// a failed system call, errno still describes it
+class SmashSysFailure : public SmashError {
+public:
+    explicit SmashSysFailure(const std::string& msg) : SmashError(msg) {}
+};
+
+#endif //SMASH_ERRORS_H_
@@ -0,0 +1,143 @@
+#include "glob_expand.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+///////////////////DirCache start//////////////////////////
+
+bool DirCache::scan(const string& dir, vector<DirEntry_t>& entries) const {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    vector<char> buff(GETDENTS_BUFFER_SIZE);
+    while (true) {
+        long nread = syscall(SYS_getdents64, fd, buff.data(), buff.size());
+        if (nread <= 0) {
+            close(fd);
+            return (nread == 0);
+        }
+        for (long pos = 0; pos < nread;) {
+            // glibc's dirent64 has the kernel's linux_dirent64 layout
+            auto* ent = (struct dirent64*)(buff.data() + pos);
+            pos += ent->d_reclen;
+            const char* name = ent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            entries.push_back({name, ent->d_type});
+        }
+    }
+}
+
+const vector<DirEntry_t>* DirCache::list(const string& dir) {
+    auto it = this->dirs.find(dir);
+    if (it != this->dirs.end()) {
+        return &it->second;
+    }
+    vector<DirEntry_t> entries;
+    if (!scan(dir, entries)) {
+        return nullptr;
+    }
+    return &(this->dirs[dir] = std::move(entries));
+}
+
+void DirCache::clear() {
+    this->dirs.clear();
+}
+
+///////////////////DirCache end//////////////////////////
+
+bool _hasGlobChars(const char* word) {
+    return strpbrk(word, GLOB_CHARS) != nullptr;
+}
+
+static bool _isDirectory(const string& path, unsigned char type) {
+    if (type == DT_DIR) {
+        return true;
+    }
+    if (type != DT_LNK && type != DT_UNKNOWN) {
+        return false;
+    }
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool _globExpand(const string& pattern, vector<string>& matches) {
+    vector<string> components;
+    size_t start = (pattern[0] == '/' ? 1 : 0);
+    while (true) {
+        size_t slash = pattern.find('/', start);
+        components.push_back(pattern.substr(start, slash - start));
+        if (slash == string::npos) {
+            break;
+        }
+        start = slash + 1;
+    }
+
+    DirCache& cache = DirCache::getInstance();
+    vector<string> prefixes = {pattern[0] == '/' ? "/" : ""};
+    bool literal_after_glob = false;
+    bool globbed = false;
+    for (size_t i = 0; i < components.size() && !prefixes.empty(); i++) {
+        const string& component = components[i];
+        bool last = (i + 1 == components.size());
+        string sep = (last ? "" : "/");
+        vector<string> next;
+
+        if (!_hasGlobChars(component.c_str())) {
+            for (const string& prefix : prefixes) {
+                next.push_back(prefix + component + sep);
+            }
+            literal_after_glob = globbed;
+            prefixes.swap(next);
+            continue;
+        }
+
+        // the literal head of the component rejects most names before fnmatch has to run
+        size_t head_len = component.find_first_of(GLOB_CHARS);
+        for (const string& prefix : prefixes) {
+            const vector<DirEntry_t>* entries = cache.list(prefix.empty() ? "." : prefix);
+            if (entries == nullptr) {
+                continue;
+            }
+            for (const DirEntry_t& entry : *entries) {
+                if (entry.name.compare(0, head_len, component, 0, head_len) != 0 ||
+                    fnmatch(component.c_str(), entry.name.c_str(), FNM_PERIOD) != 0) {
+                    continue;
+                }
+                string path = prefix + entry.name;
+                if (!last && !_isDirectory(path, entry.type)) {
+                    continue;
+                }
+                next.push_back(path + sep);
+            }
+        }
+        globbed = true;
+        literal_after_glob = false;
+        prefixes.swap(next);
+    }
+
+    if (literal_after_glob) {
+        // "dir*/name": the literal tail was never looked up
+        struct stat st;
+        prefixes.erase(remove_if(prefixes.begin(), prefixes.end(), [&st](const string& path) {
+            return lstat(path.c_str(), &st) != 0;
+        }), prefixes.end());
+    }
+    if (prefixes.empty()) {
+        return false;
+    }
+    sort(prefixes.begin(), prefixes.end(), [](const string& a, const string& b) {
+        return strcoll(a.c_str(), b.c_str()) < 0;
+    });
+    matches.insert(matches.end(), prefixes.begin(), prefixes.end());
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef SMASH_GLOB_EXPAND_H_
+#define SMASH_GLOB_EXPAND_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#define GETDENTS_BUFFER_SIZE (256 * 1024)
+#define GLOB_CHARS "*?["
+
+typedef struct DirEntry_t {
+    std::string name;
+    unsigned char type; // d_type, DT_UNKNOWN when the file system does not report it
+} DirEntry_t;
+
+/*
+ * Directory listings read with getdents64, kept until the next prompt. A command line scans
+ * each directory once no matter how many of its words glob in it.
+ */
+class DirCache {
+    std::unordered_map<std::string, std::vector<DirEntry_t>> dirs;
+    DirCache() = default;
+    bool scan(const std::string& dir, std::vector<DirEntry_t>& entries) const;
+public:
+    DirCache(DirCache const&) = delete;
+    void operator=(DirCache const&) = delete;
+    static DirCache& getInstance() {
+        static DirCache instance;
+        return instance;
+    }
+    // entries of dir without "." and "..", nullptr if it cannot be read
+    const std::vector<DirEntry_t>* list(const std::string& dir);
+    void clear();
+};
+
+bool _hasGlobChars(const char* word);
+/*
+ * Expands pattern like bash: *, ? and [...] per path component, dotfiles only when the component
+ * starts with '.', matches sorted. Returns false (matches untouched) when nothing matches.
+ */
+bool _globExpand(const std::string& pattern, std::vector<std::string>& matches);
+
+#endif //SMASH_GLOB_EXPAND_H_
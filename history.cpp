@@ -0,0 +1,227 @@
+#include "history.h"
+#include "Commands.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+using namespace std;
+
+History::~History() {
+    if (this->map != nullptr) {
+        munmap((void*)this->map, this->map_size);
+    }
+    if (this->fd != -1) {
+        close(this->fd);
+    }
+}
+
+/*
+ * Opens the history file on first use, so sessions that never need history pay nothing at startup.
+ */
+bool History::init() {
+    this->initialized = true;
+    const char* env_path = getenv(HISTFILE_ENV);
+    if (env_path != nullptr && env_path[0] != '\0') {
+        this->path = env_path;
+    } else {
+        const char* home = getenv("HOME");
+        if (home == nullptr || !isatty(STDIN_FD)) {
+            return false;
+        }
+        this->path = string(home) + "/" + HISTFILE_NAME;
+    }
+
+    this->fd = open(this->path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (this->fd == -1) {
+        perror("smash error: open failed");
+        return false;
+    }
+    return true;
+}
+
+bool History::isEnabled() {
+    if (!this->initialized) {
+        this->enabled = init();
+    }
+    return this->enabled;
+}
+
+void History::disable() {
+    this->initialized = true;
+    this->enabled = false;
+}
+
+/*
+ * Catches up with whatever this or other sessions appended since the last call: grows the mapping
+ * and indexes the new complete lines. A trailing line without '\n' is still being written, skip it.
+ */
+void History::sync() {
+    struct stat st;
+    if (!isEnabled() || fstat(this->fd, &st) == -1) {
+        return;
+    }
+    if ((size_t)st.st_size < this->map_size) {
+        // truncated behind our back: touching the stale pages would SIGBUS, index it from scratch
+        munmap((void*)this->map, this->map_size);
+        this->map = nullptr;
+        this->map_size = 0;
+        this->indexed_end = 0;
+        this->offsets.clear();
+        for (auto& bucket : this->by_first_char) {
+            bucket.clear();
+        }
+    }
+    if ((size_t)st.st_size <= this->map_size) {
+        return;
+    }
+
+    size_t new_size = st.st_size;
+    void* new_map;
+    if (this->map == nullptr) {
+        new_map = mmap(nullptr, new_size, PROT_READ, MAP_SHARED, this->fd, 0);
+    } else {
+        new_map = mremap((void*)this->map, this->map_size, new_size, MREMAP_MAYMOVE);
+    }
+    if (new_map == MAP_FAILED) {
+        return; // keep serving the part that is already mapped
+    }
+    this->map = (const char*)new_map;
+    this->map_size = new_size;
+
+    while (this->indexed_end < this->map_size) {
+        const char* start = this->map + this->indexed_end;
+        const char* newline = (const char*)memchr(start, '\n', this->map_size - this->indexed_end);
+        if (newline == nullptr) {
+            break;
+        }
+        if (newline != start) {
+            this->by_first_char[(unsigned char)*start].push_back((uint32_t)this->offsets.size());
+        }
+        this->offsets.push_back(this->indexed_end);
+        this->indexed_end = (newline - this->map) + 1;
+    }
+}
+
+size_t History::entryLength(size_t index) const {
+    uint64_t next = (index + 1 < this->offsets.size() ? this->offsets[index + 1] : this->indexed_end);
+    return next - this->offsets[index] - 1;
+}
+
+void History::add(const string& line) {
+    if (line.empty() || !isEnabled()) {
+        return;
+    }
+    string record = line + "\n";
+    // one O_APPEND write per entry, flock keeps writers of other sessions out of the middle of it
+    int ret;
+    do {
+        ret = flock(this->fd, LOCK_EX);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        reportAddFailure("flock"); // unlocked, the entry could land inside another session's
+        return;
+    }
+    if (_fullwrite(this->fd, record.c_str(), record.size()) == -1) {
+        reportAddFailure("write");
+    }
+    flock(this->fd, LOCK_UN);
+}
+
+void History::reportAddFailure(const char* failed_call) {
+    if (this->add_failed) {
+        return;
+    }
+    this->add_failed = true;
+    perror((string("smash error: history: ") + failed_call + " failed").c_str());
+}
+
+size_t History::size() {
+    sync();
+    return this->offsets.size();
+}
+
+bool History::get(size_t n, string& entry) {
+    sync();
+    if (n == 0 || n > this->offsets.size()) {
+        return false;
+    }
+    entry.assign(this->map + this->offsets[n - 1], entryLength(n - 1));
+    return true;
+}
+
+size_t History::findPrefix(const string& prefix) {
+    sync();
+    if (prefix.empty()) {
+        return this->offsets.size();
+    }
+    const vector<uint32_t>& bucket = this->by_first_char[(unsigned char)prefix[0]];
+    for (auto it = bucket.rbegin(); it != bucket.rend(); ++it) {
+        if (entryLength(*it) >= prefix.size() &&
+            memcmp(this->map + this->offsets[*it], prefix.c_str(), prefix.size()) == 0) {
+            return *it + 1;
+        }
+    }
+    return 0;
+}
+
+vector<size_t> History::search(const string& needle) {
+    sync();
+    vector<size_t> matches;
+    if (this->offsets.empty()) {
+        return matches;
+    }
+    const char* pos = this->map;
+    const char* end = this->map + this->indexed_end;
+    while (pos < end) {
+        const char* hit = (const char*)memmem(pos, end - pos, needle.c_str(), needle.size());
+        if (hit == nullptr) {
+            break;
+        }
+        size_t index = upper_bound(this->offsets.begin(), this->offsets.end(), (uint64_t)(hit - this->map))
+                       - this->offsets.begin() - 1;
+        matches.push_back(index + 1);
+        // one match per entry: continue from the start of the next one
+        pos = this->map + (index + 1 < this->offsets.size() ? this->offsets[index + 1] : this->indexed_end);
+    }
+    return matches;
+}
+
+bool History::expand(const string& line, string& expanded) {
+    if (line.size() < 2 || line[0] != '!') {
+        return false;
+    }
+    size_t event_end = line.find_first_of(" \t", 1);
+    if (event_end == string::npos) {
+        event_end = line.size();
+    }
+    string event = line.substr(1, event_end - 1);
+    if (event.empty()) {
+        return false; // "! cmd" is not an event
+    }
+
+    size_t n = 0;
+    if (event == "!") {
+        n = size();
+    } else if (isdigit((unsigned char)event[0]) || (event[0] == '-' && event.size() > 1)) {
+        bool relative = (event[0] == '-');
+        string digits = event.substr(relative ? 1 : 0);
+        if (digits.find_first_not_of("0123456789") == string::npos && digits.size() < 10) {
+            size_t num = strtoul(digits.c_str(), nullptr, 10);
+            n = (relative ? (num <= size() ? size() + 1 - num : 0) : num);
+        }
+    } else {
+        n = findPrefix(event);
+    }
+
+    string entry;
+    if (!get(n, entry)) {
+        throw SmashCmdError(line.substr(0, event_end) + ": event not found");
+    }
+    expanded = entry + line.substr(event_end);
+    return true;
+}
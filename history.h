@@ -0,0 +1,59 @@
+#ifndef SMASH_HISTORY_H_
+#define SMASH_HISTORY_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#define HISTFILE_ENV "SMASH_HISTFILE"
+#define HISTFILE_NAME ".smash_history"
+#define HISTORY_CHAR_BUCKETS (256)
+
+/*
+ * Command history kept in an append-only file, one entry per line, shared by every smash session.
+ * Appends are single O_APPEND writes under flock, so concurrent sessions never interleave entries.
+ * The file is mmap'd read-only and indexed incrementally: entry n is an offset lookup, prefix
+ * search only walks entries with the same first character and substring search is one memmem pass.
+ * Entries are numbered from 1 in file order, so every session sees the same numbers.
+ */
+class History {
+    int fd = -1;
+    bool initialized = false;
+    bool enabled = false;
+    bool add_failed = false; // a failed append is reported once, not on every prompt
+    std::string path;
+    const char* map = nullptr;
+    size_t map_size = 0;
+    std::vector<uint64_t> offsets; // start of every complete entry
+    uint64_t indexed_end = 0;
+    std::vector<uint32_t> by_first_char[HISTORY_CHAR_BUCKETS];
+
+    bool init();
+    void sync();
+    size_t entryLength(size_t index) const;
+    void reportAddFailure(const char* failed_call);
+public:
+    History() = default;
+    History(const History&) = delete;
+    void operator=(const History&) = delete;
+    ~History();
+    // history is on for terminals, or for any input once SMASH_HISTFILE names a file
+    bool isEnabled();
+    // for "smash -c" and "--server": their lines are not the user's typing, keep them out of the file
+    void disable();
+    void add(const std::string& line);
+    size_t size();
+    // entry n, counting from 1
+    bool get(size_t n, std::string& entry);
+    // newest entry starting with prefix, 0 if none
+    size_t findPrefix(const std::string& prefix);
+    // numbers of the entries containing needle, oldest first
+    std::vector<size_t> search(const std::string& needle);
+    /*
+     * Expands a leading history event (!!, !n, !-n, !prefix) in line, keeping the rest of the line.
+     * Returns false when line does not start with an event. Throws SmashCmdError if the event is unknown.
+     */
+    bool expand(const std::string& line, std::string& expanded);
+};
+
+#endif //SMASH_HISTORY_H_
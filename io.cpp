@@ -0,0 +1,438 @@
+#include "io.h"
+#include "Commands.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+
+///////////////////FdOutputBuffer start//////////////////////////
+
+FdOutputBuffer::FdOutputBuffer(int fd) : fd(fd) {
+    setp(buff, buff + IO_WRITE_BUFFER_SIZE);
+}
+
+FdOutputBuffer::~FdOutputBuffer() {
+    sync();
+    if (this->installed_on != nullptr) {
+        this->installed_on->rdbuf(this->prev_buf);
+    }
+}
+
+void FdOutputBuffer::install(ostream& os) {
+    os.flush();
+    this->installed_on = &os;
+    this->prev_buf = os.rdbuf(this);
+}
+
+int _streamFd(ostream& os) {
+    FdOutputBuffer* buff = dynamic_cast<FdOutputBuffer*>(os.rdbuf());
+    return (buff == nullptr ? -1 : buff->getFd());
+}
+
+int FdOutputBuffer::sync() {
+    size_t pending = pptr() - pbase();
+    if (pending == 0) {
+        return 0;
+    }
+    ssize_t ret = _fullwrite(this->fd, pbase(), pending);
+    setp(buff, buff + IO_WRITE_BUFFER_SIZE);
+    return (ret == -1 ? -1 : 0);
+}
+
+FdOutputBuffer::int_type FdOutputBuffer::overflow(int_type ch) {
+    if (sync() == -1) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+streamsize FdOutputBuffer::xsputn(const char* s, streamsize n) {
+    if (n > epptr() - pptr()) {
+        if (sync() == -1) {
+            return 0;
+        }
+        if (n >= IO_WRITE_BUFFER_SIZE) {
+            // bigger than the whole buffer, copying it in first would only add passes
+            return (_fullwrite(this->fd, s, n) == -1 ? 0 : n);
+        }
+    }
+    memcpy(pptr(), s, n);
+    pbump((int)n);
+    return n;
+}
+
+///////////////////FdOutputBuffer end//////////////////////////
+
+///////////////////OutputCapture start//////////////////////////
+
+OutputCapture::OutputCapture(ostream& os) : os(os) {
+    // whatever is pending stays in the previous buffer, ahead of the captured text
+    this->prev_buf = os.rdbuf(&this->buff);
+}
+
+OutputCapture::~OutputCapture() {
+    this->os.rdbuf(this->prev_buf);
+}
+
+///////////////////OutputCapture end//////////////////////////
+
+///////////////////SafeMessage start//////////////////////////
+
+SafeMessage& SafeMessage::operator<<(const char* str) {
+    while (*str != '\0' && this->len < SAFE_MESSAGE_MAX) {
+        this->buff[this->len++] = *str++;
+    }
+    return *this;
+}
+
+SafeMessage& SafeMessage::operator<<(long num) {
+    char digits[24];
+    int n_digits = 0;
+    unsigned long value = (num < 0 ? -(unsigned long)num : (unsigned long)num);
+    do {
+        digits[n_digits++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    if (num < 0 && this->len < SAFE_MESSAGE_MAX) {
+        this->buff[this->len++] = '-';
+    }
+    while (n_digits > 0 && this->len < SAFE_MESSAGE_MAX) {
+        this->buff[this->len++] = digits[--n_digits];
+    }
+    return *this;
+}
+
+void SafeMessage::emit(int fd) const {
+    _fullwrite(fd, this->buff, this->len);
+}
+
+///////////////////SafeMessage end//////////////////////////
+
+///////////////////AppendFdCache start//////////////////////////
+
+void AppendFdCache::drop(list<Entry_t>::iterator entry) {
+    close(entry->fd);
+    this->by_path.erase(entry->path);
+    this->entries.erase(entry);
+}
+
+int AppendFdCache::get(const string& path, mode_t mode) {
+    struct stat st;
+    bool exists = (stat(path.c_str(), &st) == 0);
+    if (exists && !S_ISREG(st.st_mode)) {
+        return -1; // devices and fifos are opened per command, opening a fifo here could block smash
+    }
+    auto found = this->by_path.find(path);
+    if (found != this->by_path.end()) {
+        auto entry = found->second;
+        if (exists && st.st_dev == entry->dev && st.st_ino == entry->ino) {
+            this->entries.splice(this->entries.begin(), this->entries, entry);
+            return entry->fd;
+        }
+        this->drop(entry); // renamed, unlinked or replaced since, or a relative path in another cwd
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, mode);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (this->entries.size() == this->capacity) {
+        this->drop(prev(this->entries.end()));
+    }
+    this->entries.push_front(Entry_t{path, fd, st.st_dev, st.st_ino});
+    this->by_path[path] = this->entries.begin();
+    return fd;
+}
+
+void AppendFdCache::clear() {
+    for (const Entry_t& entry : this->entries) {
+        close(entry.fd);
+    }
+    this->entries.clear();
+    this->by_path.clear();
+}
+
+///////////////////AppendFdCache end//////////////////////////
+
+///////////////////LineReader start//////////////////////////
+
+LineReader::LineReader(int fd) : fd(fd) {}
+
+LineReader::~LineReader() {
+    leaveRawMode();
+}
+
+bool LineReader::enableEditing(int out_fd) {
+    if (!isatty(this->fd) || !isatty(out_fd) || tcgetattr(this->fd, &this->orig_termios) == -1) {
+        return false;
+    }
+    this->out_fd = out_fd;
+    this->editing = true;
+    return true;
+}
+
+bool LineReader::enterRawMode() {
+    struct termios raw = this->orig_termios;
+    // ISIG stays on: ctrl-C/ctrl-Z keep reaching the smash handlers while a line is edited
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(this->fd, TCSADRAIN, &raw) == -1) {
+        return false;
+    }
+    this->raw_mode = true;
+    return true;
+}
+
+void LineReader::leaveRawMode() {
+    if (this->raw_mode) {
+        tcsetattr(this->fd, TCSADRAIN, &this->orig_termios);
+        this->raw_mode = false;
+    }
+}
+
+void LineReader::addHistory(const string& line) {
+    if (line.empty() || (!this->history.empty() && this->history.back() == line)) {
+        return;
+    }
+    if (this->history.size() == EDIT_HISTORY_SIZE) {
+        this->history.erase(this->history.begin());
+    }
+    this->history.push_back(line);
+}
+
+void LineReader::watchEvents(function<int()> event_fd, function<void()> handler) {
+    this->event_fd = std::move(event_fd);
+    this->on_event = std::move(handler);
+}
+
+/*
+ * Blocks until the input fd is readable (or reports an error or hangup), serving the watched events
+ * in the meantime.
+ */
+void LineReader::waitForInput() {
+    if (!this->on_event) {
+        return;
+    }
+    int watched;
+    while ((watched = this->event_fd()) != -1) {
+        struct pollfd fds[2] = {{this->fd, POLLIN, 0}, {watched, POLLIN, 0}};
+        if (-1 == poll(fds, 2, -1) && errno != EINTR) {
+            return; // read() will report it
+        }
+        if (fds[1].revents & POLLIN) {
+            this->on_event();
+        }
+        if (fds[0].revents != 0) {
+            return;
+        }
+    }
+}
+
+/*
+ * Refills the (fully consumed) buffer. Returns false at end of input or on a read error.
+ */
+bool LineReader::fill() {
+    this->waitForInput();
+    ssize_t rbytes;
+    do {
+        rbytes = read(this->fd, this->buff, IO_READ_BUFFER_SIZE);
+    } while (rbytes == -1 && errno == EINTR);
+    if (rbytes <= 0) {
+        this->begin = this->end = 0;
+        return false;
+    }
+    this->begin = 0;
+    this->end = rbytes;
+    return true;
+}
+
+int LineReader::nextByte() {
+    if (this->begin == this->end && !fill()) {
+        return -1;
+    }
+    return (unsigned char)this->buff[this->begin++];
+}
+
+bool LineReader::readRawLine(string& line) {
+    line.clear();
+    while (true) {
+        if (this->begin == this->end && !fill()) {
+            return !line.empty(); // a last line without '\n' still counts
+        }
+        const char* start = this->buff + this->begin;
+        size_t available = this->end - this->begin;
+        const char* newline = (const char*)memchr(start, '\n', available);
+        if (newline != nullptr) {
+            line.append(start, newline - start);
+            this->begin += (newline - start) + 1;
+            return true;
+        }
+        line.append(start, available);
+        this->begin = this->end;
+    }
+}
+
+void LineReader::refresh(const string& prompt, const string& line, size_t cursor) const {
+    string out = "\r" + prompt + line + "\x1b[K";
+    if (cursor < line.size()) {
+        out += "\x1b[" + to_string(line.size() - cursor) + "D";
+    }
+    _fullwrite(this->out_fd, out.c_str(), out.size());
+}
+
+bool LineReader::readEditedLine(const string& prompt, string& line) {
+    line.clear();
+    size_t cursor = 0;
+    size_t hist_index = this->history.size();
+    string edited_line; // the new line while browsing history
+    refresh(prompt, line, cursor);
+
+    while (true) {
+        int key = nextByte();
+        if (key == -1) {
+            return false;
+        }
+        switch (key) {
+            case '\r':
+            case '\n':
+                refresh(prompt, line, line.size());
+                _fullwrite(this->out_fd, "\r\n", 2);
+                return true;
+            case KEY_CTRL('d'):
+                if (line.empty()) {
+                    _fullwrite(this->out_fd, "\r\n", 2);
+                    return false;
+                }
+                if (cursor < line.size()) {
+                    line.erase(cursor, 1);
+                }
+                break;
+            case KEY_BACKSPACE:
+            case KEY_CTRL('h'):
+                if (cursor > 0) {
+                    line.erase(--cursor, 1);
+                }
+                break;
+            case KEY_CTRL('a'):
+                cursor = 0;
+                break;
+            case KEY_CTRL('e'):
+                cursor = line.size();
+                break;
+            case KEY_CTRL('b'):
+                cursor = (cursor > 0 ? cursor - 1 : 0);
+                break;
+            case KEY_CTRL('f'):
+                cursor = (cursor < line.size() ? cursor + 1 : cursor);
+                break;
+            case KEY_CTRL('k'):
+                line.erase(cursor);
+                break;
+            case KEY_CTRL('u'):
+                line.erase(0, cursor);
+                cursor = 0;
+                break;
+            case KEY_CTRL('w'): {
+                size_t word_start = cursor;
+                while (word_start > 0 && line[word_start - 1] == ' ') word_start--;
+                while (word_start > 0 && line[word_start - 1] != ' ') word_start--;
+                line.erase(word_start, cursor - word_start);
+                cursor = word_start;
+                break;
+            }
+            case KEY_CTRL('l'):
+                _fullwrite(this->out_fd, "\x1b[H\x1b[2J", 7);
+                break;
+            case KEY_CTRL('p'):
+            case KEY_CTRL('n'):
+            case KEY_ESC: {
+                int action = key;
+                if (key == KEY_ESC) {
+                    int seq = nextByte();
+                    if (seq != '[' && seq != 'O') {
+                        break;
+                    }
+                    action = nextByte();
+                    if (action >= '0' && action <= '9') {
+                        // ESC [ n ~ : only delete (3) is handled, the rest is swallowed
+                        int last = nextByte();
+                        while (last != '~' && last != -1) last = nextByte();
+                        if (action == '3' && cursor < line.size()) {
+                            line.erase(cursor, 1);
+                        }
+                        break;
+                    }
+                }
+                if (action == 'A' || action == KEY_CTRL('p')) {
+                    if (hist_index == 0) {
+                        break;
+                    }
+                    if (hist_index == this->history.size()) {
+                        edited_line = line;
+                    }
+                    line = this->history[--hist_index];
+                    cursor = line.size();
+                } else if (action == 'B' || action == KEY_CTRL('n')) {
+                    if (hist_index == this->history.size()) {
+                        break;
+                    }
+                    hist_index++;
+                    line = (hist_index == this->history.size() ? edited_line : this->history[hist_index]);
+                    cursor = line.size();
+                } else if (action == 'C') {
+                    cursor = (cursor < line.size() ? cursor + 1 : cursor);
+                } else if (action == 'D') {
+                    cursor = (cursor > 0 ? cursor - 1 : 0);
+                } else if (action == 'H') {
+                    cursor = 0;
+                } else if (action == 'F') {
+                    cursor = line.size();
+                }
+                break;
+            }
+            default:
+                if (key >= ' ' || key == '\t') {
+                    line.insert(cursor++, 1, (char)key);
+                }
+                break;
+        }
+        // a paste arrives as one read: redraw once it is consumed, not once per character
+        if (this->begin == this->end) {
+            refresh(prompt, line, cursor);
+        }
+    }
+}
+
+bool LineReader::readLine(const string& prompt, string& line) {
+    if (!this->editing || !enterRawMode()) {
+        cout << prompt;
+        cout.flush();
+        return readRawLine(line);
+    }
+    cout.flush();
+    bool got_line = readEditedLine(prompt, line);
+    leaveRawMode();
+    if (got_line) {
+        addHistory(line);
+    }
+    return got_line;
+}
+
+///////////////////LineReader end//////////////////////////
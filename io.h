@@ -0,0 +1,170 @@
+#ifndef SMASH_IO_H_
+#define SMASH_IO_H_
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <streambuf>
+#include <sstream>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#define IO_READ_BUFFER_SIZE (64 * 1024)
+#define IO_WRITE_BUFFER_SIZE (64 * 1024)
+#define EDIT_HISTORY_SIZE 1000
+#define SAFE_MESSAGE_MAX 512
+#define APPEND_CACHE_SIZE 16
+
+/*
+ * streambuf writing straight to a raw fd. Output accumulates until an explicit flush (prompt read,
+ * fork, raw fd writes) and then leaves with a single write(2).
+ */
+class FdOutputBuffer : public std::streambuf {
+    int fd;
+    char buff[IO_WRITE_BUFFER_SIZE];
+    std::ostream* installed_on = nullptr;
+    std::streambuf* prev_buf = nullptr;
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+public:
+    explicit FdOutputBuffer(int fd);
+    FdOutputBuffer(const FdOutputBuffer&) = delete;
+    void operator=(const FdOutputBuffer&) = delete;
+    ~FdOutputBuffer();
+    // routes os through this buffer until it is destroyed, then flushes and restores the previous one
+    void install(std::ostream& os);
+    int getFd() const { return fd; }
+};
+
+// the fd os writes to when it goes through an FdOutputBuffer, -1 otherwise (e.g. captured in memory)
+int _streamFd(std::ostream& os);
+
+/*
+ * Points an ostream at an in-memory buffer for its lifetime. $(...) runs output-only built-ins
+ * in-process this way and collects what they print, without a fork or a pipe.
+ */
+class OutputCapture {
+    std::ostream& os;
+    std::stringbuf buff;
+    std::streambuf* prev_buf;
+public:
+    explicit OutputCapture(std::ostream& os);
+    OutputCapture(const OutputCapture&) = delete;
+    void operator=(const OutputCapture&) = delete;
+    ~OutputCapture();
+    std::string str() const { return buff.str(); }
+};
+
+/*
+ * Message assembled in a fixed buffer and written with one write(2), without allocating.
+ * Signal handlers use it instead of cout, which the main loop may be in the middle of using.
+ */
+class SafeMessage {
+    char buff[SAFE_MESSAGE_MAX];
+    size_t len = 0;
+public:
+    SafeMessage& operator<<(const char* str);
+    SafeMessage& operator<<(long num);
+    void emit(int fd = STDOUT_FILENO) const;
+};
+
+/*
+ * Owns an open fd and closes it when it goes out of scope, so a throw while it is in use does not
+ * leak it. release() hands it back to a caller that wants to check the close itself.
+ */
+class FdGuard {
+    int fd;
+public:
+    explicit FdGuard(int fd) : fd(fd) {}
+    FdGuard(const FdGuard&) = delete;
+    void operator=(const FdGuard&) = delete;
+    ~FdGuard() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    int get() const { return fd; }
+    int release() {
+        int released = fd;
+        fd = -1;
+        return released;
+    }
+};
+
+/*
+ * Reads lines from a raw fd through a large buffer (partial reads, EINTR, pasted input).
+ * On a terminal it can also edit the line in place, with in-memory history.
+ */
+class LineReader {
+    int fd;
+    char buff[IO_READ_BUFFER_SIZE];
+    size_t begin = 0;
+    size_t end = 0;
+    bool editing = false;
+    bool raw_mode = false;
+    int out_fd = STDOUT_FILENO;
+    struct termios orig_termios;
+    std::vector<std::string> history;
+    std::function<int()> event_fd;
+    std::function<void()> on_event;
+
+    void waitForInput();
+    bool fill();
+    int nextByte();
+    bool readEditedLine(const std::string& prompt, std::string& line);
+    void refresh(const std::string& prompt, const std::string& line, size_t cursor) const;
+    bool enterRawMode();
+    void leaveRawMode();
+public:
+    explicit LineReader(int fd);
+    LineReader(const LineReader&) = delete;
+    void operator=(const LineReader&) = delete;
+    ~LineReader();
+    // turns line editing on when both fds are terminals, returns whether it did
+    bool enableEditing(int out_fd);
+    // shows the prompt and reads the next line (without the '\n'), false at end of input
+    bool readLine(const std::string& prompt, std::string& line);
+    // next line without prompt or editing, false at end of input
+    bool readRawLine(std::string& line);
+    void addHistory(const std::string& line);
+    // while waiting for input, calls handler whenever the fd event_fd() returns (-1: none) is readable
+    void watchEvents(std::function<int()> event_fd, std::function<void()> handler);
+};
+
+/*
+ * Descriptors of the files ">>" appends to, kept open so that a script appending to the same log line
+ * after line skips the open. An fd is reused only while its path still names the same file (stat
+ * against the cached dev/inode), so a rename, unlink or replacement of the file opens the new one.
+ * The least recently used fds are closed past the capacity. They are O_CLOEXEC: commands get a dup2.
+ */
+class AppendFdCache {
+    struct Entry_t {
+        std::string path;
+        int fd;
+        dev_t dev;
+        ino_t ino;
+    };
+    std::list<Entry_t> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry_t>::iterator> by_path;
+    size_t capacity;
+
+    void drop(std::list<Entry_t>::iterator entry);
+public:
+    explicit AppendFdCache(size_t capacity = APPEND_CACHE_SIZE) : capacity(capacity) {}
+    AppendFdCache(const AppendFdCache&) = delete;
+    void operator=(const AppendFdCache&) = delete;
+    ~AppendFdCache() { clear(); }
+    // an O_APPEND fd on path, which is created with mode if missing; -1 if it cannot be opened or is not
+    // a regular file, and the caller opens it on its own
+    int get(const std::string& path, mode_t mode);
+    // closes every cached fd
+    void clear();
+};
+
+#endif //SMASH_IO_H_
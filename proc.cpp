@@ -0,0 +1,126 @@
+#include "proc.h"
+#include "errors.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <alloca.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+uint64_t _monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * waitpid replacement that also collects the resource usage of the reaped child and retries on EINTR.
+ */
+pid_t _waitProcess(pid_t pid, int* status, int options, struct rusage* usage) {
+    pid_t ret;
+    do {
+        ret = wait4(pid, status, options, usage);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+/*
+ * Translates a raw wait status into a shell exit code (128 + signal for killed/stopped children).
+ */
+int _exitCode(int status) {
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status))
+        return 128 + WSTOPSIG(status);
+    return 0;
+}
+
+int _pidfdOpen(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int _pidfdSendSignal(int pidfd, int sig_num) {
+#ifdef SYS_pidfd_send_signal
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig_num, nullptr, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * execve of a file without a shell: asks /bin/sh to run it like execvp(3) does.
+ * alloca keeps it off the heap, this runs in zygote clones too.
+ */
+static void _execAsScript(const char* path, char* const argv[], char* const envp[]) {
+    size_t argc = 0;
+    while (argv[argc] != nullptr)
+        argc++;
+    char** sh_argv = (char**)alloca((argc + 2) * sizeof(char*));
+    sh_argv[0] = (char*)"/bin/sh";
+    sh_argv[1] = (char*)path;
+    for (size_t i = 1; i <= argc; i++)
+        sh_argv[i + 1] = argv[i];
+    execve(sh_argv[0], sh_argv, envp);
+}
+
+/*
+ * execvpe(3) that looks the command up in the PATH of envp: glibc's searches smash's own environ,
+ * which export and unset never change. Async-signal-safe and allocation free, returns only on failure.
+ */
+int _execPath(const char* file, char* const argv[], char* const envp[]) {
+    if (strchr(file, '/') != nullptr) {
+        execve(file, argv, envp);
+        if (errno == ENOEXEC)
+            _execAsScript(file, argv, envp);
+        return -1;
+    }
+    const char* search = "/bin:/usr/bin"; // glibc's default when PATH is unset
+    for (char* const* env = envp; *env != nullptr; env++) {
+        if (strncmp(*env, "PATH=", strlen("PATH=")) == 0) {
+            search = *env + strlen("PATH=");
+            break;
+        }
+    }
+    size_t file_len = strlen(file);
+    char path[PATH_MAX];
+    bool denied = false;
+    for (const char* dir = search; ; ) {
+        const char* dir_end = strchrnul(dir, ':');
+        size_t dir_len = dir_end - dir;
+        if (dir_len + 1 + file_len < sizeof(path)) {
+            // an empty entry is the current directory
+            memcpy(path, dir, dir_len);
+            if (dir_len > 0)
+                path[dir_len++] = '/';
+            memcpy(path + dir_len, file, file_len + 1);
+            execve(path, argv, envp);
+            if (errno == ENOEXEC)
+                _execAsScript(path, argv, envp);
+            if (errno == EACCES)
+                denied = true;
+            else if (errno != ENOENT && errno != ENOTDIR && errno != ESTALE && errno != ENODEV && errno != ETIMEDOUT)
+                return -1;
+        }
+        if (*dir_end == '\0')
+            break;
+        dir = dir_end + 1;
+    }
+    errno = denied ? EACCES : ENOENT;
+    return -1;
+}
+
+void close_pipe(int fd[2]) {
+    if ( -1 == close(fd[0]) || -1 == close(fd[1]) ) {
+        throw SmashSysFailure("close failed");
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef SMASH_PROC_H_
+#define SMASH_PROC_H_
+
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define STDIN_FD (0)
+#define STDOUT_FD (1)
+#define STDERR_FD (2)
+#define EPOLL_BATCH_SIZE (64)
+#define REAP_POLL_INTERVAL_MS (10)
+
+/*
+ * Process helpers shared by the shell and the engine library. They use nothing of SmallShell, so
+ * programs embedding the engine do not link the shell in.
+ */
+uint64_t _monotonicNs();
+pid_t _waitProcess(pid_t pid, int* status, int options, struct rusage* usage = nullptr);
+int _exitCode(int status);
+int _pidfdOpen(pid_t pid);
+int _pidfdSendSignal(int pidfd, int sig_num);
+int _execPath(const char* file, char* const argv[], char* const envp[]);
+void close_pipe(int fd[2]);
+
+#endif //SMASH_PROC_H_
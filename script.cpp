@@ -0,0 +1,235 @@
+#include "script.h"
+#include "errors.h"
+#include "variables.h"
+#include <cstring>
+
+using namespace std;
+
+static const char* const SCRIPT_WHITESPACE = " \t\r\n\f\v";
+
+static string _scriptTrim(const string& s) {
+    size_t start = s.find_first_not_of(SCRIPT_WHITESPACE);
+    if (start == string::npos) {
+        return "";
+    }
+    return s.substr(start, s.find_last_not_of(SCRIPT_WHITESPACE) - start + 1);
+}
+
+// splits s at its first whitespace: the first word and the (trimmed) rest
+static string _firstWord(const string& s, string* rest) {
+    size_t end = s.find_first_of(SCRIPT_WHITESPACE);
+    *rest = (end == string::npos ? "" : _scriptTrim(s.substr(end)));
+    return s.substr(0, end);
+}
+
+static SmashCmdError _syntaxError(const string& token) {
+    return SmashCmdError("syntax error near unexpected token `" + token + "'");
+}
+
+// the length of "NAME()" (spaces allowed before the parens) at start in s, 0 if no such header is there
+static size_t _functionHeader(const string& s, size_t start = 0) {
+    size_t name_end = start;
+    while (name_end < s.size() && (isalnum((unsigned char)s[name_end]) || s[name_end] == '_')) {
+        name_end++;
+    }
+    if (name_end == start || isdigit((unsigned char)s[start])) {
+        return 0;
+    }
+    size_t parens = s.find_first_not_of(" \t", name_end);
+    if (parens == string::npos || s.compare(parens, 2, "()") != 0) {
+        return 0;
+    }
+    return parens + 2 - start;
+}
+
+// line split at every ';' outside quotes, $(...) and `...`
+static vector<string> _splitStatements(const string& line) {
+    vector<string> statements;
+    string current;
+    char quote = '\0';
+    int depth = 0;          // of $( and (
+    bool in_backticks = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '\\' && quote != '\'' && i + 1 < line.size()) {
+            current += c;
+            current += line[++i];
+            continue;
+        }
+        if (quote != '\0') {
+            quote = (c == quote ? '\0' : quote);
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '`') {
+            in_backticks = !in_backticks;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && depth > 0) {
+            depth--;
+        } else if (c == ';' && depth == 0 && !in_backticks) {
+            statements.push_back(current);
+            current.clear();
+            continue;
+        }
+        current += c;
+    }
+    statements.push_back(current);
+    return statements;
+}
+
+bool ScriptParser::opensBlock(const string& line) {
+    // asked for every line typed, so the first word is compared in place
+    size_t start = line.find_first_not_of(SCRIPT_WHITESPACE);
+    if (start == string::npos || (strchr("bcdefirtuw}", line[start]) == nullptr && line.find('(') == string::npos)) {
+        return false; // neither a keyword nor a function header
+    }
+    size_t end = line.find_first_of(" \t\r\n\f\v;", start);
+    size_t len = (end == string::npos ? line.size() : end) - start;
+    // the keywords that cannot start a statement are taken too, for their syntax error
+    for (const char* keyword : {"for", "while", "until", "if", "break", "continue", "return",
+                                "then", "elif", "else", "fi", "do", "done", "}"}) {
+        if (line.compare(start, len, keyword) == 0) {
+            return true;
+        }
+    }
+    return _functionHeader(line, start) != 0;
+}
+
+ScriptBlock& ScriptParser::currentBlock() {
+    if (this->frames.empty()) {
+        return this->done;
+    }
+    Frame_t& frame = this->frames.back();
+    return (frame.in_body ? frame.node->bodies.back() : frame.node->conds.back());
+}
+
+void ScriptParser::closeFrame() {
+    ScriptNodePtr node = this->frames.back().node;
+    this->frames.pop_back();
+    currentBlock().push_back(node);
+}
+
+void ScriptParser::addStatement(const string& text) {
+    string statement = _scriptTrim(text);
+    if (statement.empty() || statement[0] == '#') {
+        return;
+    }
+    string rest;
+    string word = _firstWord(statement, &rest);
+    Frame_t* top = (this->frames.empty() ? nullptr : &this->frames.back());
+    ScriptNodeKind top_kind = (top == nullptr ? NODE_LINE : top->node->kind);
+    bool in_header = (top != nullptr && !top->in_body && (top_kind == NODE_FOR || top_kind == NODE_FUNCTION));
+
+    if (in_header) {
+        // only "do" may follow "for NAME in WORDS", and only "{" may follow "NAME()"
+        if ((top_kind == NODE_FOR && word != "do") || (top_kind == NODE_FUNCTION && word != "{")) {
+            throw _syntaxError(word);
+        }
+        top->node->bodies.emplace_back();
+        top->in_body = true;
+        addStatement(rest);
+        return;
+    }
+
+    if (word == "for") {
+        string words, list;
+        string name = _firstWord(rest, &words);
+        string in_word = _firstWord(words, &list);
+        if (!_isValidVarName(name)) {
+            throw SmashCmdError("for: `" + name + "': not a valid identifier");
+        }
+        if (in_word != "in") {
+            throw _syntaxError(in_word.empty() ? "newline" : in_word);
+        }
+        ScriptNodePtr node = make_shared<ScriptNode_t>(NODE_FOR);
+        node->text = name;
+        node->words = list;
+        node->expands = (list.find_first_of("$`") != string::npos);
+        this->frames.push_back({node, false});
+    } else if (word == "while" || word == "until" || word == "if") {
+        ScriptNodePtr node = make_shared<ScriptNode_t>(word == "if" ? NODE_IF : (word == "while" ? NODE_WHILE : NODE_UNTIL));
+        node->conds.emplace_back();
+        this->frames.push_back({node, false});
+        addStatement(rest);
+    } else if (word == "do") {
+        if (top == nullptr || top->in_body || (top_kind != NODE_WHILE && top_kind != NODE_UNTIL) ||
+            top->node->conds.back().empty()) {
+            throw _syntaxError(word);
+        }
+        top->node->bodies.emplace_back();
+        top->in_body = true;
+        addStatement(rest);
+    } else if (word == "then") {
+        if (top_kind != NODE_IF || top->in_body || top->node->conds.back().empty()) {
+            throw _syntaxError(word);
+        }
+        top->node->bodies.emplace_back();
+        top->in_body = true;
+        addStatement(rest);
+    } else if (word == "elif" || word == "else") {
+        // both only after a "then" branch, and nothing but "fi" after the else branch
+        if (top_kind != NODE_IF || !top->in_body || top->node->bodies.size() != top->node->conds.size() ||
+            top->node->bodies.back().empty()) {
+            throw _syntaxError(word);
+        }
+        if (word == "elif") {
+            top->node->conds.emplace_back();
+            top->in_body = false;
+        } else {
+            top->node->bodies.emplace_back();
+        }
+        addStatement(rest);
+    } else if (word == "done" || word == "fi" || word == "}") {
+        bool matches = (word == "done" && (top_kind == NODE_FOR || top_kind == NODE_WHILE || top_kind == NODE_UNTIL)) ||
+                       (word == "fi" && top_kind == NODE_IF) || (word == "}" && top_kind == NODE_FUNCTION);
+        if (!matches || !top->in_body || top->node->bodies.back().empty()) {
+            throw _syntaxError(word);
+        }
+        if (!rest.empty()) {
+            // no redirections or pipes on compound commands
+            string after;
+            throw _syntaxError(_firstWord(rest, &after));
+        }
+        closeFrame();
+    } else if (word == "{" || word == "in") {
+        throw _syntaxError(word);
+    } else if (word == "break" || word == "continue" || word == "return") {
+        ScriptNodePtr node = make_shared<ScriptNode_t>(word == "break" ? NODE_BREAK :
+                                                       (word == "continue" ? NODE_CONTINUE : NODE_RETURN));
+        node->text = rest;
+        node->expands = (rest.find_first_of("$`") != string::npos);
+        currentBlock().push_back(node);
+    } else if (size_t header = _functionHeader(statement)) {
+        ScriptNodePtr node = make_shared<ScriptNode_t>(NODE_FUNCTION);
+        node->text = statement.substr(0, statement.find_first_of(" \t("));
+        this->frames.push_back({node, false});
+        addStatement(statement.substr(header)); // "{" on the same line, or on the next one
+    } else {
+        ScriptNodePtr node = make_shared<ScriptNode_t>(NODE_LINE);
+        node->text = statement;
+        node->expands = (statement.find_first_of("$`") != string::npos);
+        currentBlock().push_back(node);
+    }
+}
+
+bool ScriptParser::feed(const string& line, ScriptBlock& out) {
+    try {
+        for (const string& statement : _splitStatements(line)) {
+            addStatement(statement);
+        }
+    } catch (SmashCmdError&) {
+        reset();
+        throw;
+    }
+    if (!this->frames.empty()) {
+        return false;
+    }
+    out.swap(this->done);
+    this->done.clear();
+    return true;
+}
+
+void ScriptParser::reset() {
+    this->frames.clear();
+    this->done.clear();
+}
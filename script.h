@@ -0,0 +1,66 @@
+#ifndef SMASH_SCRIPT_H_
+#define SMASH_SCRIPT_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#define SCRIPT_MAX_CALL_DEPTH (1000)
+#define SCRIPT_CONTINUATION_PROMPT "> "
+
+enum ScriptNodeKind {NODE_LINE, NODE_BREAK, NODE_CONTINUE, NODE_RETURN, NODE_FOR, NODE_WHILE, NODE_UNTIL,
+                     NODE_IF, NODE_FUNCTION};
+
+// how a statement left the block running it: on to the next one, or unwinding to a loop, a function or the top
+enum ScriptFlow {FLOW_NEXT, FLOW_BREAK, FLOW_CONTINUE, FLOW_RETURN, FLOW_STOP};
+
+struct ScriptNode_t;
+typedef std::shared_ptr<ScriptNode_t> ScriptNodePtr; // shared: a function's body outlives its parse
+typedef std::vector<ScriptNodePtr> ScriptBlock;
+
+/*
+ * One statement of a parsed script. Command lines are kept as text, since variables and $(...) are
+ * expanded each time they run, but whether they need expanding at all is decided once here.
+ */
+struct ScriptNode_t {
+    ScriptNodeKind kind;
+    std::string text;        // LINE: the command line, FOR: the variable, FUNCTION: the name,
+                             // RETURN: the status (may be empty)
+    std::string words;       // FOR: the word list, expanded and split on each run
+    bool expands = false;    // LINE/FOR: holds '$' or '`'
+    std::vector<ScriptBlock> conds;  // IF: one per if/elif, WHILE/UNTIL: one
+    std::vector<ScriptBlock> bodies; // IF: one per cond, plus the else branch, others: one
+    explicit ScriptNode_t(ScriptNodeKind kind) : kind(kind) {}
+};
+
+/*
+ * Turns input lines holding for/while/until/if blocks and "name() { ... }" functions into nodes,
+ * a line at a time, so a block can span lines or sit on one ("for i in a b; do x=$i; done").
+ * Inside blocks ';' separates statements (outside quotes and $(...)); lines outside blocks are
+ * not parsed here and run as before.
+ */
+class ScriptParser {
+    struct Frame_t {
+        ScriptNodePtr node;
+        bool in_body;        // false: in the condition (or the for/function header)
+    };
+    std::vector<Frame_t> frames;
+    ScriptBlock done;        // complete top-level statements of the current input
+
+    ScriptBlock& currentBlock();
+    void addStatement(const std::string& statement);
+    void closeFrame();
+public:
+    // the first word of line is a block keyword (or line holds a function definition): a job for feed()
+    static bool opensBlock(const std::string& line);
+    // inside an unfinished block: lines go to feed() and get the continuation prompt
+    bool pending() const { return !frames.empty(); }
+    /*
+     * Parses one line. Returns true with the finished top-level statements in out once every block
+     * is closed. A syntax error throws SmashCmdError and drops the unfinished blocks.
+     */
+    bool feed(const std::string& line, ScriptBlock& out);
+    void reset();
+};
+
+#endif //SMASH_SCRIPT_H_
@@ -0,0 +1,283 @@
+#include "server.h"
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+
+using namespace std;
+
+// a handler instead of SIG_IGN: exec resets it, so commands still die of SIGPIPE as usual
+static void _ignoreSigpipe(int) {}
+
+ControlServer::~ControlServer() {
+    for (auto& entry : this->clients) {
+        close(entry.first);
+        if (entry.second.out_fd != -1) {
+            close(entry.second.out_fd);
+        }
+        if (entry.second.err_fd != -1) {
+            close(entry.second.err_fd);
+        }
+    }
+    for (int fd : {this->epoll_fd, this->null_fd, this->saved_out, this->saved_err}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    if (this->listen_fd != -1) {
+        close(this->listen_fd);
+        unlink(this->path.c_str());
+    }
+}
+
+bool ControlServer::listen() {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (this->path.size() >= sizeof(addr.sun_path)) {
+        cerr << "smash error: server: socket path too long" << endl;
+        return false;
+    }
+    strcpy(addr.sun_path, this->path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        perror("smash error: socket failed");
+        return false;
+    }
+    struct stat st;
+    if (lstat(this->path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        // left behind by a server that did not exit cleanly, unless one still answers on it
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            cerr << "smash error: server: " << this->path << " is in use" << endl;
+            close(fd);
+            return false;
+        }
+        unlink(this->path.c_str());
+    }
+    if (-1 == bind(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        perror("smash error: bind failed");
+        close(fd);
+        return false;
+    }
+    this->listen_fd = fd;
+    if (-1 == ::listen(fd, SERVER_BACKLOG)) {
+        perror("smash error: listen failed");
+        return false;
+    }
+
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    this->null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    this->saved_out = fcntl(STDOUT_FD, F_DUPFD_CLOEXEC, 0);
+    this->saved_err = fcntl(STDERR_FD, F_DUPFD_CLOEXEC, 0);
+    if (this->epoll_fd == -1 || this->null_fd == -1 || this->saved_out == -1 || this->saved_err == -1) {
+        perror("smash error: server setup failed");
+        return false;
+    }
+    struct sigaction sig = {};
+    sigemptyset(&sig.sa_mask);
+    sig.sa_handler = &_ignoreSigpipe;
+    sigaction(SIGPIPE, &sig, nullptr);
+
+    this->buff.resize(SERVER_MAX_REQUEST);
+    this->watch(this->listen_fd, EPOLLIN, EPOLL_CTL_ADD);
+    return true;
+}
+
+void ControlServer::watch(int fd, uint32_t events, int op) {
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(this->epoll_fd, op, fd, &ev);
+}
+
+void ControlServer::run() {
+    SmallShell& smash = SmallShell::getInstance();
+    struct epoll_event events[EPOLL_BATCH_SIZE];
+    while (!smash.quit) {
+        int exit_fd = smash.jobs_list.exitEventFd();
+        if (exit_fd != this->jobs_fd) {
+            this->jobs_fd = exit_fd;
+            this->watch(exit_fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+        int captures_fd = smash.captures.eventFd();
+        if (captures_fd != this->captures_fd) {
+            this->captures_fd = captures_fd;
+            this->watch(captures_fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+        // without pidfds job exits raise no event, so pending waits poll
+        int timeout = (this->n_waiting > 0 ? smash.jobs_list.exitPollMs() : -1);
+        int n_ready = epoll_wait(this->epoll_fd, events, EPOLL_BATCH_SIZE, timeout);
+        if (n_ready == -1 && errno != EINTR) {
+            perror("smash error: epoll_wait failed");
+            return;
+        }
+        for (int i = 0; i < n_ready && !smash.quit; i++) {
+            int fd = events[i].data.fd;
+            if (fd == this->listen_fd) {
+                this->acceptClients();
+            } else if (fd == this->jobs_fd) {
+                smash.jobs_list.removeFinishedJobs(); // also keeps the event from firing again
+            } else if (fd == this->captures_fd) {
+                smash.captures.drain(0);
+            } else if (this->clients.count(fd) != 0 && this->clients[fd].waiting == nullptr) {
+                this->readRequest(fd);
+            } else if (this->clients.count(fd) != 0 && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                this->closeClient(fd); // gave up waiting
+            }
+        }
+        this->finishWaits();
+    }
+}
+
+void ControlServer::acceptClients() {
+    int fd;
+    while ((fd = accept4(this->listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK)) != -1) {
+        this->clients[fd] = Client_t();
+        this->watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+}
+
+void ControlServer::closeClient(int fd) {
+    Client_t& client = this->clients[fd];
+    if (client.waiting != nullptr) {
+        this->n_waiting--;
+    }
+    if (client.out_fd != -1) {
+        close(client.out_fd);
+    }
+    if (client.err_fd != -1) {
+        close(client.err_fd);
+    }
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    this->clients.erase(fd);
+}
+
+void ControlServer::reply(int fd, const string& msg) {
+    // a client that went away is noticed on its next read
+    send(fd, msg.c_str(), msg.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+void ControlServer::readRequest(int fd) {
+    char control[CMSG_SPACE(sizeof(int) * SERVER_CLIENT_FDS)];
+    struct iovec iov = {this->buff.data(), this->buff.size()};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t len = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (len == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (len <= 0) {
+        this->closeClient(fd);
+        return;
+    }
+
+    Client_t& client = this->clients[fd];
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int fds[SERVER_CLIENT_FDS] = {-1, -1};
+        size_t n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), min(n_fds, (size_t)SERVER_CLIENT_FDS) * sizeof(int));
+        if (n_fds == 1) {
+            fds[1] = fcntl(fds[0], F_DUPFD_CLOEXEC, 0); // one fd for both streams
+        }
+        for (int* slot : {&client.out_fd, &client.err_fd}) {
+            if (*slot != -1) {
+                close(*slot);
+            }
+        }
+        client.out_fd = fds[0];
+        client.err_fd = fds[1];
+    }
+    if (msg.msg_flags & MSG_TRUNC) {
+        this->reply(fd, "error request too long");
+        return;
+    }
+
+    string line(this->buff.data(), len);
+    while (!line.empty() && line.back() == '\n') {
+        line.pop_back();
+    }
+    string trimmed = _trim(line);
+    string first_word = trimmed.substr(0, trimmed.find_first_of(" \t"));
+    if (first_word == SERVER_WAIT_REQUEST) {
+        this->startWait(fd, client, line);
+    } else {
+        this->runRequest(fd, client, line);
+    }
+}
+
+void ControlServer::runRequest(int fd, Client_t& client, const string& line) {
+    SmallShell& smash = SmallShell::getInstance();
+    JobsList::JobEntry last_before = smash.jobs_list.getLastJob(nullptr);
+
+    cout.flush();
+    dup2(client.out_fd != -1 ? client.out_fd : this->null_fd, STDOUT_FD);
+    dup2(client.err_fd != -1 ? client.err_fd : this->null_fd, STDERR_FD);
+    smash.executeCommand(line.c_str());
+    cout.flush();
+    cerr.flush();
+    fflush(stdout);
+    fflush(stderr);
+    // a client that closed its end must not leave cout failed for everyone after it
+    cout.clear();
+    cerr.clear();
+    dup2(this->saved_out, STDOUT_FD);
+    dup2(this->saved_err, STDERR_FD);
+
+    string msg = "status " + to_string(smash.getLastExitStatus());
+    JobsList::JobEntry last_after = smash.jobs_list.getLastJob(nullptr);
+    if (last_after != nullptr && last_after != last_before) {
+        client.last_job = last_after;
+        msg += " job " + to_string(last_after->id);
+    }
+    this->reply(fd, msg);
+}
+
+void ControlServer::startWait(int fd, Client_t& client, const string& line) {
+    SmallShell& smash = SmallShell::getInstance();
+    string arg = _trim(_trim(line).substr(strlen(SERVER_WAIT_REQUEST)));
+    if (!arg.empty() && arg[0] == '%') {
+        arg = arg.substr(1);
+    }
+    JobsList::JobEntry job;
+    if (arg.empty()) {
+        job = client.last_job; // may have finished already, its status is kept in the entry
+    } else if (arg.size() < 10 && arg.find_first_not_of("0123456789") == string::npos) {
+        job = smash.jobs_list.getJobByJobId(stoi(arg));
+    }
+    if (job == nullptr) {
+        this->reply(fd, "error no such job");
+        return;
+    }
+    client.waiting = job;
+    this->n_waiting++;
+    this->watch(fd, 0, EPOLL_CTL_MOD); // hangups are still reported
+}
+
+void ControlServer::finishWaits() {
+    if (this->n_waiting == 0) {
+        return;
+    }
+    SmallShell& smash = SmallShell::getInstance();
+    smash.jobs_list.removeFinishedJobs();
+    for (auto& entry : this->clients) {
+        Client_t& client = entry.second;
+        if (client.waiting == nullptr || smash.jobs_list.getJobByJobId(client.waiting->id) == client.waiting) {
+            continue;
+        }
+        this->reply(entry.first, "status " + to_string(_exitCode(client.waiting->exit_status)));
+        client.waiting = nullptr;
+        this->n_waiting--;
+        this->watch(entry.first, EPOLLIN, EPOLL_CTL_MOD);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef SMASH_SERVER_H_
+#define SMASH_SERVER_H_
+
+#include <string>
+#include <unordered_map>
+#include "Commands.h"
+
+#define SERVER_MAX_REQUEST (64 * 1024)
+#define SERVER_BACKLOG (128)
+#define SERVER_CLIENT_FDS (2) // stdout and stderr of the client
+#define SERVER_WAIT_REQUEST "wait"
+
+/*
+ * "smash --server PATH": one shell serving command lines from many local clients over a
+ * SOCK_SEQPACKET Unix socket, one request per message.
+ *
+ * A request is a command line, run through SmallShell::executeCommand with the client's stdout and
+ * stderr (passed as SCM_RIGHTS with the request, kept for later requests) as fds 1 and 2, so output
+ * streams to the client without passing through the server. Built-ins such as jobs and kill act on
+ * the shared job table. "wait [N]" waits for job N, or for the last job this client started,
+ * without blocking other clients.
+ *
+ * Every request gets one reply message: "status N" (plus " job N" when it started a background job),
+ * or "error <message>". Requests run one at a time: a foreground command holds the server until it
+ * ends, background jobs and waits do not.
+ */
+class ControlServer {
+    typedef struct Client_t {
+        int out_fd = -1;
+        int err_fd = -1;
+        JobsList::JobEntry last_job; // started by this client's last background request
+        JobsList::JobEntry waiting;  // job of a pending "wait", the client is not read meanwhile
+    } Client_t;
+
+    std::string path;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int jobs_fd = -1;  // JobsList::exitEventFd(), once it exists
+    int captures_fd = -1; // CaptureTable::eventFd(), once it exists
+    int null_fd = -1;  // output of clients that passed no fds
+    int saved_out = -1;
+    int saved_err = -1;
+    std::unordered_map<int, Client_t> clients;
+    size_t n_waiting = 0;
+    std::vector<char> buff;
+
+    void acceptClients();
+    void readRequest(int fd);
+    void runRequest(int fd, Client_t& client, const std::string& line);
+    void startWait(int fd, Client_t& client, const std::string& line);
+    void finishWaits();
+    void reply(int fd, const std::string& msg);
+    void closeClient(int fd);
+    void watch(int fd, uint32_t events, int op);
+public:
+    explicit ControlServer(const std::string& path) : path(path) {}
+    ControlServer(const ControlServer&) = delete;
+    void operator=(const ControlServer&) = delete;
+    ~ControlServer();
+    // binds and listens on path, false (after printing why) if it cannot
+    bool listen();
+    // serves clients until one of them runs "quit"
+    void run();
+};
+
+#endif //SMASH_SERVER_H_
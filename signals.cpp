@@ -1,35 +1,61 @@
-#include <iostream>
 #include <signal.h>
+#include <poll.h>
 #include "signals.h"
 #include "Commands.h"
+#include "stats.h"
+#include "io.h"
 
 using namespace std;
 
 void ctrlZHandler(int sig_num) {
-  cout << MSG_PREFIX << "got ctrl-Z" << endl;
+    StatTimer timer(STAT_SIGNAL);
+    (SafeMessage() << MSG_PREFIX << "got ctrl-Z\n").emit();
 	SmallShell& smash = SmallShell::getInstance();
     smash.jobs_list.stopCurrFGJob();
 }
 
 void ctrlCHandler(int sig_num) {
-    cout << MSG_PREFIX << "got ctrl-C" << endl;
+    StatTimer timer(STAT_SIGNAL);
+    (SafeMessage() << MSG_PREFIX << "got ctrl-C\n").emit();
     SmallShell& smash = SmallShell::getInstance();
+    smash.fg_interrupted = 1; // for built-ins that run many children themselves (parallel)
     smash.jobs_list.killCurrFGJob();
 }
 
 void alarmHandler(int sig_num) {
-    cout << MSG_PREFIX << "got an alarm" << endl;
+    StatTimer timer(STAT_SIGNAL);
+    (SafeMessage() << MSG_PREFIX << "got an alarm\n").emit();
 
     SmallShell& smash = SmallShell::getInstance();
 
-    pid_t pid_to_kill = smash.time_out_manager.RemoveTimedOut();
+    int pidfd = -1;
+    pid_t pid_to_kill = smash.getTimeOutManager().RemoveTimedOut(&pidfd);
     while ( pid_to_kill != DEFAULT_PROCESS_ID) {
         smash.jobs_list.removeFinishedJobs();
-        if ( 0 == kill(pid_to_kill, SIGKILL ) ) {
-            cout << MSG_PREFIX << *(smash.jobs_list.getCmdForPID(pid_to_kill)) << " timed out!" << endl;
+        // the pid may have been reaped and handed to another job since, only the pidfd taken with the alarm
+        // says whether the timed command itself is still running (without pidfds, a reaped job is not listed)
+        struct pollfd exited = {pidfd, POLLIN, 0};
+        bool running = ( pidfd == -1 || poll(&exited, 1, 0) == 0 );
+        JobsList::JobEntry job = running ? smash.jobs_list.getJobForPID(pid_to_kill) : nullptr;
+        if ( job != nullptr && 0 == job->sendSignal(SIGKILL) ) {
+            (SafeMessage() << MSG_PREFIX << job->cmd->getRawCmdLine() << " timed out!\n").emit();
         }
-        pid_to_kill = smash.time_out_manager.RemoveTimedOut();
+        if (pidfd != -1) {
+            close(pidfd);
+        }
+        pid_to_kill = smash.getTimeOutManager().RemoveTimedOut(&pidfd);
     }
-    smash.time_out_manager.SetNextAlarm();
+    smash.getTimeOutManager().SetNextAlarm();
 }
 
+
+// installed together with the TimeOutManager, so shells that never run timeout skip the syscall
+void installAlarmHandler() {
+    struct sigaction sig;
+    sig.sa_handler = &alarmHandler;
+    sigemptyset(&sig.sa_mask);
+    sig.sa_flags = SA_RESTART;
+    if(sigaction(SIGALRM , &sig , nullptr) == -1) {
+        perror("smash error: failed to set alarm handler");
+    }
+}
@@ -1,33 +1,164 @@
 #include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include "Commands.h"
 #include "signals.h"
+#include "stats.h"
+#include "io.h"
+#include "server.h"
 
-int main(int argc, char* argv[]) {
-    if(signal(SIGTSTP , ctrlZHandler)==SIG_ERR) {
-        perror("smash error: failed to set ctrl-Z handler");
-    }
+#define STARTUP_TRACE_FLAG "--startup-trace"
+#define NO_EDIT_FLAG "--no-edit"
+#define ZYGOTE_FLAG "--zygote"
+#define CGROUPS_FLAG "--cgroups"
+#define SERVER_FLAG "--server"
+#define COMMAND_FLAG "-c"
+#define USAGE_MSG "usage: smash [--startup-trace] [--no-edit] [--zygote] [--cgroups] [-c command | --server socket]\n"
 
-    if(signal(SIGINT , ctrlCHandler)==SIG_ERR) {
-        perror("smash error: failed to set ctrl-C handler");
+// timeline of the startup phases, printed to stderr with --startup-trace
+class StartupTrace {
+    bool enabled = false;
+    uint64_t start_ns;
+    std::vector<std::pair<const char*, uint64_t>> marks;
+public:
+    StartupTrace() : start_ns(_monotonicNs()) {}
+    void enable() { enabled = true; }
+    void mark(const char* phase) {
+        if (enabled) {
+            marks.emplace_back(phase, _monotonicNs());
+        }
+    }
+    void print() const {
+        if (!enabled) {
+            return;
+        }
+        std::string out;
+        char line[128];
+        uint64_t prev_ns = start_ns;
+        for (const auto& mark : marks) {
+            snprintf(line, sizeof(line), "startup: %-20s +%9.1fus (%9.1fus total)\n", mark.first,
+                     (mark.second - prev_ns) / 1e3, (mark.second - start_ns) / 1e3);
+            out += line;
+            prev_ns = mark.second;
+        }
+        _fullwrite(STDERR_FILENO, out.c_str(), out.size());
     }
+};
 
+static void installHandlers() {
     struct sigaction sig;
-    sig.sa_handler = &alarmHandler;
     sigemptyset(&sig.sa_mask);
     sig.sa_flags = SA_RESTART;
-    if(sigaction(SIGALRM , &sig , nullptr) == -1) {
-        perror("smash error: failed to set alarm handler");
+
+    sig.sa_handler = &ctrlZHandler;
+    if(sigaction(SIGTSTP , &sig , nullptr) == -1) {
+        perror("smash error: failed to set ctrl-Z handler");
+    }
+
+    sig.sa_handler = &ctrlCHandler;
+    if(sigaction(SIGINT , &sig , nullptr) == -1) {
+        perror("smash error: failed to set ctrl-C handler");
+    }
+    // SIGALRM is only installed once a timeout command needs it (see SmallShell::getTimeOutManager)
+}
+
+int main(int argc, char* argv[]) {
+    StartupTrace trace;
+    // cout is flushed explicitly (prompt read, fork, raw fd writes), so skip the per-write stdio sync
+    std::ios::sync_with_stdio(false);
+    FdOutputBuffer out_buff(STDOUT_FILENO);
+    out_buff.install(std::cout);
+
+    const char* command = nullptr;
+    const char* server_path = nullptr;
+    bool line_editing = true;
+    bool zygote = false;
+    bool cgroups = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], STARTUP_TRACE_FLAG) == 0) {
+            trace.enable();
+        } else if (strcmp(argv[i], NO_EDIT_FLAG) == 0) {
+            line_editing = false;
+        } else if (strcmp(argv[i], ZYGOTE_FLAG) == 0) {
+            zygote = true;
+        } else if (strcmp(argv[i], CGROUPS_FLAG) == 0) {
+            cgroups = true;
+        } else if (strcmp(argv[i], COMMAND_FLAG) == 0 && i + 1 < argc) {
+            command = argv[++i];
+        } else if (strcmp(argv[i], SERVER_FLAG) == 0 && i + 1 < argc) {
+            server_path = argv[++i];
+        } else {
+            _fullwrite(STDERR_FILENO, USAGE_MSG, strlen(USAGE_MSG));
+            return 2;
+        }
     }
+    trace.mark("args parsed");
+
+    installHandlers();
+    trace.mark("signals installed");
 
     SmallShell& smash = SmallShell::getInstance();
+    trace.mark("shell constructed");
+    std::string cgroups_error;
+    if (cgroups && !smash.cgroups.enable(&cgroups_error)) {
+        std::cerr << "smash error: --cgroups: " << cgroups_error << ", jobs stay process groups" << std::endl;
+    } else if (cgroups) {
+        trace.mark("cgroups enabled");
+    }
+    if (zygote && smash.zygote.start()) {
+        trace.mark("zygote started");
+    }
+
+    if (command != nullptr || server_path != nullptr) {
+        smash.history.disable(); // no file to create, no ! expansion
+    }
+    if (command != nullptr) {
+        trace.mark("command start");
+        trace.print();
+        smash.executeCommand(command);
+        smash.endOfInput();
+        return smash.getLastExitStatus();
+    }
+
+    if (server_path != nullptr) {
+        ControlServer server(server_path);
+        if (!server.listen()) {
+            return 1;
+        }
+        trace.mark("server listening");
+        trace.print();
+        server.run();
+        return 0;
+    }
+
+    LineReader reader(STDIN_FILENO);
+    if (line_editing && reader.enableEditing(STDOUT_FILENO) && smash.history.isEnabled()) {
+        // up-arrow starts from the most recent persistent entries
+        size_t total = smash.history.size();
+        std::string entry;
+        for (size_t n = (total > EDIT_HISTORY_SIZE ? total - EDIT_HISTORY_SIZE + 1 : 1); n <= total; n++) {
+            if (smash.history.get(n, entry)) {
+                reader.addHistory(entry);
+            }
+        }
+    }
+    // captured background jobs keep draining into their rings while smash sits at the prompt
+    reader.watchEvents([&smash]() { return (smash.captures.active() ? smash.captures.eventFd() : -1); },
+                       [&smash]() { smash.captures.drain(0); });
+    trace.mark("first prompt");
+    trace.print();
+    std::string cmd_line;
     while(!smash.quit) {
-        smash.printPromptLine();
-        std::string cmd_line;
-        std::getline(std::cin, cmd_line);
+        if (!reader.readLine(smash.getPromptLine(), cmd_line)) {
+            break; // end of input
+        }
         smash.executeCommand(cmd_line.c_str());
     }
+    smash.endOfInput();
     return 0;
-}
\ No newline at end of file
+}
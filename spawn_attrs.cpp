@@ -0,0 +1,249 @@
+#include "spawn_attrs.h"
+#include "Commands.h"
+#include "errors.h"
+#include <cctype>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+static const char* const IOPRIO_CLASS_NAMES[] = {"none", "rt", "be", "idle"};
+
+SpawnAttrs::SpawnAttrs() : limits{{"rlimit-as", RLIMIT_AS, false, 0, ""},
+                                  {"rlimit-cpu", RLIMIT_CPU, false, 0, ""},
+                                  {"rlimit-nofile", RLIMIT_NOFILE, false, 0, ""}},
+                           cgroup_limits{{"memory-max", "memory.max", false, "", ""},
+                                         {"cpu-max", "cpu.max", false, "", ""},
+                                         {"pids-max", "pids.max", false, "", ""}} {
+    CPU_ZERO(&this->cpus);
+}
+
+// "0,2,4-7"
+static bool _parseCpuList(const string& spec, cpu_set_t* cpus) {
+    CPU_ZERO(cpus);
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t end = spec.find(',', pos);
+        string range = spec.substr(pos, end == string::npos ? string::npos : end - pos);
+        size_t dash = range.find('-');
+        char* first_end = nullptr;
+        char* last_end = nullptr;
+        unsigned long first = strtoul(range.c_str(), &first_end, 10);
+        unsigned long last = (dash == string::npos ? first : strtoul(range.c_str() + dash + 1, &last_end, 10));
+        bool valid = !range.empty() && isdigit((unsigned char)range[0]) &&
+                     (dash == string::npos ? *first_end == '\0' :
+                      first_end == range.c_str() + dash && isdigit((unsigned char)range[dash + 1]) && *last_end == '\0');
+        if (!valid || first > last || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+        if (end == string::npos) {
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+// "be:7", "idle", "2:4": a class name or number (1-3) and a level (0-7)
+static bool _parseIoPriority(const string& spec, int* ioprio_class, int* level) {
+    string class_part = spec.substr(0, spec.find(':'));
+    *ioprio_class = 0;
+    for (int i = 1; i <= 3; i++) {
+        if (class_part == IOPRIO_CLASS_NAMES[i] || class_part == to_string(i)) {
+            *ioprio_class = i;
+        }
+    }
+    *level = IOPRIO_DEFAULT_LEVEL;
+    if (spec.find(':') != string::npos) {
+        string level_part = spec.substr(spec.find(':') + 1);
+        if (level_part.size() != 1 || level_part[0] < '0' || level_part[0] > '0' + IOPRIO_MAX_LEVEL) {
+            return false;
+        }
+        *level = level_part[0] - '0';
+    }
+    return *ioprio_class != 0;
+}
+
+int SpawnAttrs::parseOption(char* const* args, int n_args, int i) {
+    string option = args[i];
+    if (option.compare(0, 2, "--") != 0) {
+        return 0;
+    }
+    option = option.substr(2);
+    bool known = (option == "cpus" || option == "nice" || option == "ionice");
+    for (const Limit_t& limit : this->limits) {
+        known = known || option == limit.option;
+    }
+    for (const CgroupLimit_t& limit : this->cgroup_limits) {
+        known = known || option == limit.option;
+    }
+    if (!known) {
+        return 0;
+    }
+    if (i + 1 >= n_args) {
+        throw SmashCmdError("run: --" + option + " needs a value");
+    }
+    string value = args[i + 1];
+    auto invalid = [&]() {
+        return SmashCmdError("run: invalid --" + option + " value '" + value + "'");
+    };
+
+    if (option == "cpus") {
+        if (!_parseCpuList(value, &this->cpus)) {
+            throw invalid();
+        }
+        this->has_cpus = true;
+        this->cpus_spec = value;
+    } else if (option == "nice") {
+        char* end = nullptr;
+        long nice = strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || nice < -20 || nice > 19) {
+            throw invalid();
+        }
+        this->has_nice = true;
+        this->nice = (int)nice;
+    } else if (option == "ionice") {
+        if (!_parseIoPriority(value, &this->ioprio_class, &this->ioprio_level)) {
+            throw invalid();
+        }
+    } else if (option == "memory-max" || option == "cpu-max" || option == "pids-max") {
+        CgroupLimit_t& limit = this->cgroup_limits[option == "memory-max" ? 0 : (option == "cpu-max" ? 1 : 2)];
+        size_t size = 0;
+        char* end = nullptr;
+        unsigned long long count = strtoull(value.c_str(), &end, 10);
+        bool is_count = isdigit((unsigned char)value[0]) && *end == '\0';
+        if (value == "unlimited") {
+            limit.value = (option == "cpu-max" ? "max " + to_string(CGROUP_CPU_PERIOD_US) : "max");
+        } else if (option == "memory-max" && _parseSize(value.c_str(), &size)) {
+            limit.value = to_string(size);
+        } else if (option == "cpu-max" && is_count && count > 0) {
+            // percent of one CPU per period, 150 for one and a half
+            limit.value = to_string(count * CGROUP_CPU_PERIOD_US / 100) + " " + to_string(CGROUP_CPU_PERIOD_US);
+        } else if (option == "pids-max" && is_count && count > 0) {
+            limit.value = value;
+        } else {
+            throw invalid();
+        }
+        limit.set = true;
+        limit.spec = value;
+    } else {
+        for (Limit_t& limit : this->limits) {
+            if (option != limit.option) {
+                continue;
+            }
+            size_t size = 0;
+            char* end = nullptr;
+            unsigned long long count = strtoull(value.c_str(), &end, 10);
+            if (value == "unlimited") {
+                limit.value = RLIM_INFINITY;
+            } else if (limit.resource == RLIMIT_AS && _parseSize(value.c_str(), &size)) {
+                limit.value = size;
+            } else if (limit.resource != RLIMIT_AS && isdigit((unsigned char)value[0]) && *end == '\0') {
+                limit.value = count;
+            } else {
+                throw invalid();
+            }
+            limit.set = true;
+            limit.spec = value;
+        }
+    }
+    return 2;
+}
+
+void SpawnAttrs::merge(const SpawnAttrs& other) {
+    if (other.has_cpus) {
+        this->has_cpus = true;
+        this->cpus = other.cpus;
+        this->cpus_spec = other.cpus_spec;
+    }
+    if (other.has_nice) {
+        this->has_nice = true;
+        this->nice = other.nice;
+    }
+    if (other.ioprio_class != 0) {
+        this->ioprio_class = other.ioprio_class;
+        this->ioprio_level = other.ioprio_level;
+    }
+    for (int i = 0; i < SPAWN_N_LIMITS; i++) {
+        if (other.limits[i].set) {
+            this->limits[i] = other.limits[i];
+        }
+    }
+    for (int i = 0; i < SPAWN_N_CGROUP_LIMITS; i++) {
+        if (other.cgroup_limits[i].set) {
+            this->cgroup_limits[i] = other.cgroup_limits[i];
+        }
+    }
+}
+
+bool SpawnAttrs::empty() const {
+    return this->describe().empty();
+}
+
+bool SpawnAttrs::apply(const char** failed_call) const {
+    if (this->has_cpus && sched_setaffinity(0, sizeof(this->cpus), &this->cpus) == -1) {
+        *failed_call = "sched_setaffinity";
+        return false;
+    }
+    if (this->has_nice && setpriority(PRIO_PROCESS, 0, this->nice) == -1) {
+        *failed_call = "setpriority";
+        return false;
+    }
+    if (this->ioprio_class != 0) {
+        int ioprio = (this->ioprio_class << IOPRIO_CLASS_SHIFT) | this->ioprio_level;
+        // IOPRIO_WHO_PROCESS, no glibc wrapper
+        if (syscall(SYS_ioprio_set, 1, 0, ioprio) == -1) {
+            *failed_call = "ioprio_set";
+            return false;
+        }
+    }
+    for (const Limit_t& limit : this->limits) {
+        struct rlimit rlim = {limit.value, limit.value}; // soft and hard, like ulimit and prlimit
+        if (limit.set && setrlimit(limit.resource, &rlim) == -1) {
+            *failed_call = "setrlimit";
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<pair<string, string>> SpawnAttrs::cgroupLimits() const {
+    vector<pair<string, string>> files;
+    for (const CgroupLimit_t& limit : this->cgroup_limits) {
+        if (limit.set) {
+            files.emplace_back(limit.file, limit.value);
+        }
+    }
+    return files;
+}
+
+string SpawnAttrs::describe() const {
+    string desc;
+    auto add = [&desc](const string& attr) {
+        desc += (desc.empty() ? "" : " ") + attr;
+    };
+    if (this->has_cpus) {
+        add("cpus=" + this->cpus_spec);
+    }
+    if (this->has_nice) {
+        add("nice=" + to_string(this->nice));
+    }
+    if (this->ioprio_class != 0) {
+        add(string("ionice=") + IOPRIO_CLASS_NAMES[this->ioprio_class] + ":" + to_string(this->ioprio_level));
+    }
+    for (const Limit_t& limit : this->limits) {
+        if (limit.set) {
+            add(string(limit.option) + "=" + limit.spec);
+        }
+    }
+    for (const CgroupLimit_t& limit : this->cgroup_limits) {
+        if (limit.set) {
+            add(string(limit.option) + "=" + limit.spec);
+        }
+    }
+    return desc;
+}
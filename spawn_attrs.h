@@ -0,0 +1,65 @@
+#ifndef SMASH_SPAWN_ATTRS_H_
+#define SMASH_SPAWN_ATTRS_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <sched.h>
+#include <sys/resource.h>
+
+#define IOPRIO_CLASS_SHIFT (13)
+#define IOPRIO_MAX_LEVEL (7)
+#define IOPRIO_DEFAULT_LEVEL (4)
+#define SPAWN_N_LIMITS (3)
+#define SPAWN_N_CGROUP_LIMITS (3)
+#define CGROUP_CPU_PERIOD_US (100000)
+
+/*
+ * What an external command gets in its child between fork and exec: CPU affinity, a nice level, an
+ * I/O priority and RLIMIT_AS/CPU/NOFILE. They come from "run" prefixes on top of the shell defaults
+ * ("run" without a command), and whatever is not set is inherited from smash as usual. The memory,
+ * CPU and pids limits are not applied here: they are written to the job's cgroup before it forks.
+ */
+class SpawnAttrs {
+    struct Limit_t {
+        const char* option;  // without the leading "--"
+        int resource;
+        bool set;
+        rlim_t value;
+        std::string spec;    // as given, for describe()
+    };
+    struct CgroupLimit_t {
+        const char* option;
+        const char* file;    // in the job's cgroup
+        bool set;
+        std::string value;   // as the file takes it
+        std::string spec;
+    };
+    bool has_cpus = false;
+    cpu_set_t cpus;
+    std::string cpus_spec;
+    bool has_nice = false;
+    int nice = 0;
+    int ioprio_class = 0;    // 0: not set
+    int ioprio_level = 0;
+    Limit_t limits[SPAWN_N_LIMITS];
+    CgroupLimit_t cgroup_limits[SPAWN_N_CGROUP_LIMITS];
+public:
+    SpawnAttrs();
+    /*
+     * Parses the option at args[i] and its value at args[i + 1]. Returns the number of args used,
+     * 0 when args[i] is not a spawn option. A bad value throws SmashCmdError.
+     */
+    int parseOption(char* const* args, int n_args, int i);
+    // the attributes set in other replace these
+    void merge(const SpawnAttrs& other);
+    bool empty() const;
+    // in the child: applies every set attribute; false with errno set and failed_call naming the call
+    bool apply(const char** failed_call) const;
+    // ("memory.max", "536870912") for each cgroup limit that is set
+    std::vector<std::pair<std::string, std::string>> cgroupLimits() const;
+    // "cpus=2-3 nice=10 ionice=be:7 rlimit-nofile=1024", empty when nothing is set
+    std::string describe() const;
+};
+
+#endif //SMASH_SPAWN_ATTRS_H_
@@ -0,0 +1,104 @@
+#include "stats.h"
+#include "Commands.h"
+#include <ctime>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+using namespace std;
+
+static const char* const PHASE_NAMES[STAT_PHASES_COUNT] = {"parse", "fork", "wait", "signal", "reap", "command", "shutdown"};
+
+SmashStats::SmashStats() {
+    this->reset();
+}
+
+void SmashStats::reset() {
+    memset(this->phases, 0, sizeof(this->phases));
+}
+
+static int _bucketOf(uint64_t ns) {
+    if (ns < STATS_SUB_BUCKETS) {
+        return (int)ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    int sub = (int)((ns >> (msb - 2)) & (STATS_SUB_BUCKETS - 1));
+    return min(msb * STATS_SUB_BUCKETS + sub, STATS_BUCKETS - 1);
+}
+
+static uint64_t _bucketUpperBound(int bucket) {
+    if (bucket < STATS_SUB_BUCKETS) {
+        return bucket + 1;
+    }
+    int msb = bucket / STATS_SUB_BUCKETS;
+    uint64_t step = ((uint64_t)1 << msb) / STATS_SUB_BUCKETS;
+    return ((uint64_t)1 << msb) + (bucket % STATS_SUB_BUCKETS + 1) * step;
+}
+
+void SmashStats::record(StatPhase phase, uint64_t elapsed_ns) {
+    PhaseStats& stats = this->phases[phase];
+    stats.count += 1;
+    stats.total_ns += elapsed_ns;
+    stats.buckets[_bucketOf(elapsed_ns)] += 1;
+    if (elapsed_ns > stats.max_ns) {
+        stats.max_ns = elapsed_ns;
+    }
+}
+
+/*
+ * Upper bound of the histogram bucket holding the requested fraction of the samples, capped by the max seen.
+ */
+uint64_t SmashStats::percentile(StatPhase phase, double fraction) const {
+    const PhaseStats& stats = this->phases[phase];
+    if (stats.count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)ceil(fraction * stats.count);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < STATS_BUCKETS; bucket++) {
+        seen += stats.buckets[bucket];
+        if (seen >= rank) {
+            return min(_bucketUpperBound(bucket), stats.max_ns);
+        }
+    }
+    return stats.max_ns;
+}
+
+string SmashStats::format(bool as_json) const {
+    ostringstream out;
+    out << fixed << setprecision(1);
+    if (!as_json) {
+        out << left << setw(10) << "phase" << right << setw(10) << "count" << setw(14) << "total_us"
+            << setw(12) << "avg_us" << setw(12) << "p50_us" << setw(12) << "p99_us" << setw(12) << "max_us" << "\n";
+    }
+    for (int phase = 0; phase < STAT_PHASES_COUNT; phase++) {
+        const PhaseStats& stats = this->phases[phase];
+        double avg_us = stats.count == 0 ? 0 : (double)stats.total_ns / stats.count / 1000;
+        double p50_us = this->percentile((StatPhase)phase, 0.5) / 1000.0;
+        double p99_us = this->percentile((StatPhase)phase, 0.99) / 1000.0;
+        if (as_json) {
+            out << "{\"phase\":\"" << PHASE_NAMES[phase] << "\",\"count\":" << stats.count
+                << ",\"total_us\":" << stats.total_ns / 1000.0 << ",\"avg_us\":" << avg_us
+                << ",\"p50_us\":" << p50_us << ",\"p99_us\":" << p99_us
+                << ",\"max_us\":" << stats.max_ns / 1000.0 << "}\n";
+            continue;
+        }
+        out << left << setw(10) << PHASE_NAMES[phase] << right << setw(10) << stats.count
+            << setw(14) << stats.total_ns / 1000.0 << setw(12) << avg_us << setw(12) << p50_us
+            << setw(12) << p99_us << setw(12) << stats.max_ns / 1000.0 << "\n";
+    }
+    return out.str();
+}
+
+void SmashStats::dumpToFile(const string& path) const {
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1) {
+        throw SmashSysFailure("open failed");
+    }
+    string buff = this->format(true);
+    ssize_t wbytes = _fullwrite(fd, buff.data(), buff.size());
+    close(fd);
+    if (wbytes == -1) {
+        throw SmashSysFailure("write failed");
+    }
+}
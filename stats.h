@@ -0,0 +1,53 @@
+#ifndef SMASH__STATS_H_
+#define SMASH__STATS_H_
+
+#include <cstdint>
+#include <string>
+#include "proc.h"
+
+#define STATS_SUB_BUCKETS (4)  // each power of two is split in 4 linear buckets
+#define STATS_BUCKETS (40 * STATS_SUB_BUCKETS)  // nanoseconds, enough for ~18 minutes
+#define STATS_FILE_ENV "SMASH_STATS_FILE"
+
+enum StatPhase {STAT_PARSE, STAT_FORK, STAT_WAIT, STAT_SIGNAL, STAT_REAP, STAT_COMMAND, STAT_SHUTDOWN, STAT_PHASES_COUNT};
+
+/*
+ * Per-phase latency counters and histograms of the shell itself.
+ * Recording only does integer arithmetic, so it is safe to use from the signal handlers.
+ */
+class SmashStats {
+private:
+    struct PhaseStats {
+        uint64_t count;
+        uint64_t total_ns;
+        uint64_t max_ns;
+        uint64_t buckets[STATS_BUCKETS];
+    };
+    PhaseStats phases[STAT_PHASES_COUNT];
+    SmashStats();
+public:
+    SmashStats(SmashStats const &) = delete; // disable copy ctor
+    void operator=(SmashStats const &) = delete; // disable = operator
+    static SmashStats &getInstance() {
+        static SmashStats instance;
+        return instance;
+    }
+    void record(StatPhase phase, uint64_t elapsed_ns);
+    uint64_t percentile(StatPhase phase, double fraction) const;
+    void reset();
+    std::string format(bool as_json) const;
+    void dumpToFile(const std::string& path) const;
+};
+
+/*
+ * Records the lifetime of the object into the given phase.
+ */
+class StatTimer {
+    StatPhase phase;
+    uint64_t start_ns;
+public:
+    explicit StatTimer(StatPhase phase) : phase(phase), start_ns(_monotonicNs()) {}
+    ~StatTimer() { SmashStats::getInstance().record(phase, _monotonicNs() - start_ns); }
+};
+
+#endif //SMASH__STATS_H_
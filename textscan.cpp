@@ -0,0 +1,120 @@
+#include "textscan.h"
+#include <cstring>
+#include <cstdint>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SIMD_WIDTH (16)
+#define MAX_BYTE_LANE_STEPS (255) // a per-lane 8-bit counter would wrap after this many steps
+
+#ifdef __SSE2__
+
+static inline __m128i _load(const char* ptr) {
+    return _mm_loadu_si128((const __m128i*)ptr);
+}
+
+size_t _countByte(const char* data, size_t len, char byte) {
+    const __m128i target = _mm_set1_epi8(byte);
+    size_t count = 0;
+    size_t i = 0;
+    while (i + SIMD_WIDTH <= len) {
+        // every match subtracts -1 (all ones) from its lane, summed up every 255 steps
+        __m128i lanes = _mm_setzero_si128();
+        for (int step = 0; step < MAX_BYTE_LANE_STEPS && i + SIMD_WIDTH <= len; step++, i += SIMD_WIDTH) {
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_load(data + i), target));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+        count += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+    for (; i < len; i++) {
+        count += (data[i] == byte);
+    }
+    return count;
+}
+
+const char* _findNthByte(const char* data, size_t len, char byte, size_t n) {
+    if (n == 0) {
+        return nullptr;
+    }
+    const __m128i target = _mm_set1_epi8(byte);
+    size_t i = 0;
+    for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_load(data + i), target));
+        size_t found = (size_t)__builtin_popcount(mask);
+        if (found < n) {
+            n -= found;
+            continue;
+        }
+        while (--n > 0) {
+            mask &= mask - 1;
+        }
+        return data + i + __builtin_ctz(mask);
+    }
+    for (; i < len; i++) {
+        if (data[i] == byte && --n == 0) {
+            return data + i;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Compares the needle's first and last bytes against 16 candidate positions at once, and only runs
+ * memcmp where both match. Text rarely has the pair at the right distance, so most blocks cost two
+ * loads and two compares.
+ */
+const char* _findBytes(const char* data, size_t len, const char* needle, size_t needle_len) {
+    if (needle_len <= 1) {
+        return (needle_len == 0 ? data : (const char*)memchr(data, needle[0], len));
+    }
+    if (needle_len > len) {
+        return nullptr;
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+        __m128i at_first = _mm_cmpeq_epi8(_load(data + i), first);
+        __m128i at_last = _mm_cmpeq_epi8(_load(data + i + needle_len - 1), last);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(at_first, at_last));
+        while (mask != 0) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (memcmp(data + pos + 1, needle + 1, needle_len - 2) == 0) {
+                return data + pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return (const char*)memmem(data + i, len - i, needle, needle_len);
+}
+
+#else
+
+size_t _countByte(const char* data, size_t len, char byte) {
+    size_t count = 0;
+    const char* end = data + len;
+    while ((data = (const char*)memchr(data, byte, end - data)) != nullptr) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+const char* _findNthByte(const char* data, size_t len, char byte, size_t n) {
+    const char* end = data + len;
+    for (; n > 0; n--) {
+        const char* found = (const char*)memchr(data, byte, end - data);
+        if (found == nullptr || n == 1) {
+            return found;
+        }
+        data = found + 1;
+    }
+    return nullptr;
+}
+
+const char* _findBytes(const char* data, size_t len, const char* needle, size_t needle_len) {
+    return (const char*)memmem(data, len, needle, needle_len);
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SMASH_TEXTSCAN_H_
+#define SMASH_TEXTSCAN_H_
+
+#include <cstddef>
+
+/*
+ * Byte scanning kernels of the streaming built-ins (cat, head, wc, grep). With SSE2 (every x86-64)
+ * they look at 16 bytes per step; elsewhere they fall back to the C library.
+ */
+
+// number of times byte occurs in [data, data + len)
+size_t _countByte(const char* data, size_t len, char byte);
+
+// position of the n-th (1-based) occurrence of byte, nullptr if there are fewer than n
+const char* _findNthByte(const char* data, size_t len, char byte, size_t n);
+
+// first occurrence of needle in [data, data + len), nullptr if there is none (an empty needle is at data)
+const char* _findBytes(const char* data, size_t len, const char* needle, size_t needle_len);
+
+#endif //SMASH_TEXTSCAN_H_
@@ -0,0 +1,422 @@
+#include "variables.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+
+bool _isValidVarName(const string& name) {
+    if (name.empty() || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        return false;
+    }
+    return all_of(name.begin(), name.end(), [](char c) { return isalnum((unsigned char)c) || c == '_'; });
+}
+
+bool _splitAssignment(const string& word, string& name, string& value) {
+    size_t eq = word.find('=');
+    if (eq == string::npos || !_isValidVarName(word.substr(0, eq))) {
+        return false;
+    }
+    name = word.substr(0, eq);
+    value = word.substr(eq + 1);
+    return true;
+}
+
+bool _parseAssignment(const string& line, string& name, string& value) {
+    size_t start = line.find_first_not_of(" \t");
+    size_t eq = (start == string::npos ? string::npos : line.find('=', start));
+    if (eq == string::npos || !_isValidVarName(line.substr(start, eq - start))) {
+        return false;
+    }
+    string word;
+    char quote = '\0';
+    size_t i = eq + 1;
+    for (; i < line.size(); i++) {
+        char c = line[i];
+        if (c == LITERAL_MARK && i + 1 < line.size()) {
+            word += (char)(line[++i] & 0x7f);
+        } else if (c == UNKNOWN_VAR_MARK) {
+            i = line.find(UNKNOWN_VAR_MARK, i + 1); // smash has no value for it
+            if (i == string::npos) {
+                return false;
+            }
+        } else if (quote == '\'') {
+            quote = (c == '\'' ? '\0' : quote);
+            word += (c == '\'' ? "" : string(1, c));
+        } else if (c == '\\' && i + 1 < line.size()) {
+            // inside double quotes only $ ` " \ and newline are escaped
+            if (quote == '"' && strchr("$`\"\\\n", line[i + 1]) == nullptr) {
+                word += c;
+            } else {
+                word += line[++i];
+            }
+        } else if (quote == '"') {
+            quote = (c == '"' ? '\0' : quote);
+            word += (c == '"' ? "" : string(1, c));
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (strchr(" \t\r\n\f\v", c) != nullptr) {
+            break;
+        } else if (strchr("|&;<>()", c) != nullptr) {
+            return false; // syntax, bash's to run
+        } else {
+            word += c;
+        }
+    }
+    // "NAME=value cmd" sets NAME for cmd only, bash runs those
+    if (quote != '\0' || line.find_first_not_of(" \t\r\n\f\v", i) != string::npos) {
+        return false;
+    }
+    name = line.substr(start, eq - start);
+    value = word;
+    return true;
+}
+
+void VarTable::init() {
+    this->initialized = true;
+    for (char** env = environ; *env != nullptr; env++) {
+        const char* eq = strchr(*env, '=');
+        if (eq != nullptr) {
+            this->vars[string(*env, eq - *env)] = {string(eq + 1), true};
+        }
+    }
+}
+
+const Var_t* VarTable::get(const string& name) {
+    if (!this->initialized) {
+        init();
+    }
+    auto it = this->vars.find(name);
+    return (it == this->vars.end() ? nullptr : &it->second);
+}
+
+void VarTable::set(const string& name, const string& value, bool exported) {
+    if (!this->initialized) {
+        init();
+    }
+    Var_t& var = this->vars[name];
+    var.value = value;
+    var.exported = var.exported || exported;
+    if (var.exported) {
+        this->env_modified = this->env_dirty = true;
+        this->env_generation++;
+    }
+}
+
+void VarTable::exportVar(const string& name) {
+    if (!this->initialized) {
+        init();
+    }
+    Var_t& var = this->vars[name];
+    if (!var.exported) {
+        var.exported = true;
+        this->env_modified = this->env_dirty = true;
+        this->env_generation++;
+    }
+}
+
+void VarTable::unset(const string& name) {
+    if (!this->initialized) {
+        init();
+    }
+    auto it = this->vars.find(name);
+    if (it == this->vars.end()) {
+        return;
+    }
+    if (it->second.exported) {
+        this->env_modified = this->env_dirty = true;
+        this->env_generation++;
+    }
+    this->vars.erase(it);
+}
+
+vector<string> VarTable::exportedList() {
+    if (!this->initialized) {
+        init();
+    }
+    vector<string> list;
+    for (const auto& var : this->vars) {
+        if (var.second.exported) {
+            list.push_back(var.first + "=" + var.second.value);
+        }
+    }
+    sort(list.begin(), list.end());
+    return list;
+}
+
+char** VarTable::envp() {
+    if (!this->env_modified) {
+        return environ;
+    }
+    if (this->env_dirty) {
+        this->env_storage = exportedList();
+        this->env_ptrs.clear();
+        for (string& entry : this->env_storage) {
+            this->env_ptrs.push_back(&entry[0]);
+        }
+        this->env_ptrs.push_back(nullptr);
+        this->env_dirty = false;
+    }
+    return this->env_ptrs.data();
+}
+
+bool VarTable::positionalArg(const string& name, string& value) const {
+    if (this->positional.empty() || name.empty()) {
+        return false;
+    }
+    const vector<string>& args = this->positional.back();
+    if (name == "#") {
+        value = to_string(args.size());
+    } else if (name == "@") {
+        value.clear();
+        for (size_t i = 0; i < args.size(); i++) {
+            value += (i == 0 ? "" : " ") + args[i];
+        }
+    } else if (all_of(name.begin(), name.end(), [](char c) { return isdigit((unsigned char)c); }) ) {
+        size_t n = strtoul(name.c_str(), nullptr, 10);
+        if (n == 0) {
+            return false; // $0 is not an argument
+        }
+        value = (n <= args.size() ? args[n - 1] : "");
+    } else {
+        return false;
+    }
+    return true;
+}
+
+enum LiteralClass : uint8_t {LITERAL_PLAIN, LITERAL_SYNTAX, LITERAL_SPACE, LITERAL_NUL};
+
+// every expanded character goes through here, so the classes are looked up rather than searched
+static const struct LiteralClasses_t {
+    uint8_t of[256] = {};
+    LiteralClasses_t() {
+        for (const char* c = LITERAL_SYNTAX_CHARS; *c != '\0'; c++) {
+            of[(unsigned char)*c] = LITERAL_SYNTAX;
+        }
+        for (const char* c = LITERAL_SPACE_CHARS; *c != '\0'; c++) {
+            of[(unsigned char)*c] = LITERAL_SPACE;
+        }
+        of[0] = LITERAL_NUL;
+    }
+} literal_classes;
+
+// _literalText(value, split) appended to out
+static void _appendLiteral(string& out, const string& value, bool split) {
+    size_t plain = 0;
+    while (plain < value.size() && literal_classes.of[(unsigned char)value[plain]] == LITERAL_PLAIN) {
+        plain++;
+    }
+    out.append(value, 0, plain); // usually all of it
+    for (size_t i = plain; i < value.size(); i++) {
+        char c = value[i];
+        uint8_t kind = literal_classes.of[(unsigned char)c];
+        if (kind == LITERAL_PLAIN) {
+            out += c;
+        } else if (kind == LITERAL_SPACE && split) {
+            out += ' ';
+        } else if (kind != LITERAL_NUL) {
+            out += LITERAL_MARK;
+            out += (char)(c | 0x80);
+        }
+    }
+}
+
+string _literalText(const string& value, bool split) {
+    string out;
+    out.reserve(value.size());
+    _appendLiteral(out, value, split);
+    return out;
+}
+
+bool _hasLiteralText(const string& text) {
+    static const char marks[] = {LITERAL_MARK, UNKNOWN_VAR_MARK, '\0'};
+    return text.find_first_of(marks) != string::npos;
+}
+
+string _decodeLiteral(const string& text) {
+    if (!_hasLiteralText(text)) {
+        return text;
+    }
+    string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == LITERAL_MARK && i + 1 < text.size()) {
+            out += (char)(text[++i] & 0x7f);
+        } else if (text[i] == UNKNOWN_VAR_MARK) {
+            i = text.find(UNKNOWN_VAR_MARK, i + 1); // dropped: smash has no value for it
+            if (i == string::npos) {
+                break;
+            }
+        } else {
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+string _shellText(const string& text) {
+    if (!_hasLiteralText(text)) {
+        return text;
+    }
+    string out;
+    out.reserve(text.size() * 2);
+    char quote = '\0';
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == UNKNOWN_VAR_MARK) {
+            size_t end = text.find(UNKNOWN_VAR_MARK, i + 1);
+            if (end == string::npos) {
+                break;
+            }
+            out += "${" + text.substr(i + 1, end - i - 1) + "}";
+            i = end;
+            continue;
+        }
+        if (c != LITERAL_MARK || i + 1 == text.size()) {
+            if (c == '\\' && quote != '\'' && i + 1 < text.size() && text[i + 1] != LITERAL_MARK) {
+                out += c;
+                out += text[++i];
+                continue;
+            }
+            if ((c == '\'' || c == '"') && (quote == '\0' || quote == c)) {
+                quote = (quote == c ? '\0' : c);
+            }
+            out += c;
+            continue;
+        }
+        c = (char)(text[++i] & 0x7f);
+        if (quote == '\'') {
+            out += (c == '\'' ? "'\\''" : string(1, c));
+        } else if (quote == '"') {
+            if (strchr("$`\"\\", c) != nullptr) {
+                out += '\\';
+            }
+            out += c;
+        } else if (c == '\n') {
+            out += "$'\\n'"; // a backslash-newline would be a line continuation
+        } else {
+            out += '\\';
+            out += c;
+        }
+    }
+    return out;
+}
+
+size_t _assignmentEnd(const string& line) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == string::npos || !(isalpha((unsigned char)line[start]) || line[start] == '_')) {
+        return 0;
+    }
+    size_t eq = start;
+    while (eq < line.size() && (isalnum((unsigned char)line[eq]) || line[eq] == '_')) {
+        eq++;
+    }
+    if (eq == line.size() || line[eq] != '=') {
+        return 0;
+    }
+    char quote = '\0';
+    int depth = 0;          // of $( and (, whose spaces do not end the word
+    bool in_backticks = false;
+    size_t i = eq + 1;
+    for (; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '\\' && quote != '\'') {
+            i++;
+        } else if (quote == '\'') {
+            quote = (c == '\'' ? '\0' : quote);
+        } else if (c == '\'' && quote == '\0') {
+            quote = c;
+        } else if (c == '"') {
+            quote = (quote == '"' ? '\0' : c);
+        } else if (c == '`') {
+            in_backticks = !in_backticks;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && depth > 0) {
+            depth--;
+        } else if ((c == ' ' || c == '\t') && quote == '\0' && depth == 0 && !in_backticks) {
+            break;
+        }
+    }
+    return i;
+}
+
+string VarTable::expand(const string& line, int last_status, pid_t pid) {
+    if (line.find('$') == string::npos) {
+        return line;
+    }
+    string out;
+    out.reserve(line.size());
+    char quote = '\0';
+    size_t assignment_end = _assignmentEnd(line);
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '\\' && quote != '\'' && i + 1 < line.size()) {
+            out += c;
+            out += line[++i];
+            continue;
+        }
+        if ((c == '\'' || c == '"') && (quote == '\0' || quote == c)) {
+            quote = (quote == c ? '\0' : c);
+        }
+        if (c != '$' || quote == '\'' || i + 1 == line.size()) {
+            out += c;
+            continue;
+        }
+        bool split = (quote == '\0' && i >= assignment_end);
+
+        char next = line[i + 1];
+        if (next == '?') {
+            out += to_string(last_status);
+            i++;
+            continue;
+        }
+        if (next == '$') {
+            out += to_string(pid);
+            i++;
+            continue;
+        }
+        string name;
+        size_t end;
+        string arg;
+        if (!this->positional.empty() && next != '{' && positionalArg(string(1, next), arg)) {
+            _appendLiteral(out, arg, split); // "$12" is $1 followed by 2, like in sh
+            i++;
+            continue;
+        }
+        if (next == '{') {
+            end = line.find('}', i + 2);
+            if (end == string::npos) {
+                out += c;
+                continue;
+            }
+            name = line.substr(i + 2, end - i - 2);
+        } else {
+            end = i + 1;
+            while (end < line.size() && (isalnum((unsigned char)line[end]) || line[end] == '_')) {
+                end++;
+            }
+            name = line.substr(i + 1, end - i - 1);
+            end--;
+        }
+        if (!this->positional.empty() && positionalArg(name, arg)) {
+            _appendLiteral(out, arg, split);
+            i = end;
+            continue;
+        }
+        if (!_isValidVarName(name)) {
+            out += c; // a lone '$' (or "$1", "${}") stays literal
+            continue;
+        }
+        const Var_t* var = get(name);
+        if (var != nullptr) {
+            _appendLiteral(out, var->value, split);
+        } else {
+            out += UNKNOWN_VAR_MARK + name + UNKNOWN_VAR_MARK; // bash may know it ($RANDOM, $UID)
+        }
+        i = end;
+    }
+    return out;
+}
@@ -0,0 +1,86 @@
+#ifndef SMASH_VARIABLES_H_
+#define SMASH_VARIABLES_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+typedef struct Var_t {
+    std::string value;
+    bool exported;
+} Var_t;
+
+/*
+ * Shell variables, hashed by name. Starts as a copy of the inherited environment, made on first use.
+ * Spawns get envp(): the inherited environ itself until something is exported or unset, afterwards
+ * an array rebuilt only when the exported set changed since the last spawn.
+ */
+class VarTable {
+    std::unordered_map<std::string, Var_t> vars;
+    bool initialized = false;
+    bool env_modified = false; // environ no longer matches the exported variables
+    bool env_dirty = false;    // env_ptrs is stale
+    uint64_t env_generation = 0; // bumped on every change to the exported set
+    std::vector<std::string> env_storage;
+    std::vector<char*> env_ptrs;
+    std::vector<std::vector<std::string>> positional; // arguments of the running function calls, innermost last
+
+    void init();
+    // $1..$9, $# and $@ inside a function call; false for anything else
+    bool positionalArg(const std::string& name, std::string& value) const;
+public:
+    VarTable() = default;
+    VarTable(const VarTable&) = delete;
+    void operator=(const VarTable&) = delete;
+    const Var_t* get(const std::string& name);
+    void set(const std::string& name, const std::string& value, bool exported = false);
+    // marks an existing (or new, empty) variable as exported
+    void exportVar(const std::string& name);
+    void unset(const std::string& name);
+    // the exported variables as "NAME=value", sorted by name
+    std::vector<std::string> exportedList();
+    char** envp();
+    uint64_t envGeneration() const { return env_generation; }
+    // a function call starts or returns: its arguments become (or stop being) $1.., $# and $@
+    void pushArgs(std::vector<std::string> args) { positional.push_back(std::move(args)); }
+    void popArgs() { positional.pop_back(); }
+    /*
+     * Replaces $NAME, ${NAME}, $? and $$ in line, and inside a function $1..$9, $# and $@, with their
+     * values as literal text. Unquoted values split into words, values in double quotes or after
+     * "NAME=" do not. Unknown variables are left for bash, text inside single quotes and escaped \$
+     * are left alone.
+     */
+    std::string expand(const std::string& line, int last_status, pid_t pid);
+};
+
+/*
+ * Expanded text stays data: a character of a variable's value or of $(...) output that smash or bash
+ * would read as syntax is stored as LITERAL_MARK followed by the character with its high bit set, so
+ * '|', '>', '&' or ';' in a value never split a line. A variable smash does not know is kept for bash
+ * as UNKNOWN_VAR_MARK NAME UNKNOWN_VAR_MARK ($RANDOM, $UID). _decodeLiteral() restores the text for
+ * argv and file names, _shellText() quotes it for "bash -c".
+ */
+#define LITERAL_MARK '\x01'
+#define UNKNOWN_VAR_MARK '\x02'
+#define UNKNOWN_VAR_MARK_STR "\x02"
+#define LITERAL_SYNTAX_CHARS "|&;<>()$`\\\"'{}~#=\x01\x02"
+#define LITERAL_SPACE_CHARS " \t\n\v\f\r"
+
+// value as expanded text; split: unquoted, so its whitespace still separates words (each one a space)
+std::string _literalText(const std::string& value, bool split);
+// the expanded text with its literal characters restored and unknown variables dropped
+std::string _decodeLiteral(const std::string& text);
+bool _hasLiteralText(const std::string& text);
+// the expanded text for "bash -c": literal characters quoted for where they stand, unknown variables as ${NAME}
+std::string _shellText(const std::string& text);
+
+bool _isValidVarName(const std::string& name);
+// "NAME=value" with a valid name, split into its parts
+bool _splitAssignment(const std::string& word, std::string& name, std::string& value);
+// the end of "NAME=word" at the start of line (its value is not split into words), 0 if line is no assignment
+size_t _assignmentEnd(const std::string& line);
+// line is just "NAME=word" (word may be quoted or escaped, or hold expanded text): the name and the word as text
+bool _parseAssignment(const std::string& line, std::string& name, std::string& value);
+
+#endif //SMASH_VARIABLES_H_
@@ -0,0 +1,247 @@
+#include "zygote.h"
+#include "Commands.h"
+#include "stats.h"
+#include <iostream>
+#include <csignal>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sched.h>
+
+using namespace std;
+
+///////////////////Zygote process start//////////////////////////
+
+typedef struct ZygoteExec_t {
+    uint32_t flags;
+    char* const* argv;
+    char** envp;
+    const int* fds;
+} ZygoteExec_t;
+
+/*
+ * Runs in the clone, on the helper's memory and a stack of its own until execve replaces it:
+ * becomes its own process group like every command smash forks, takes over the passed fds and execs.
+ * Only async-signal-safe calls, and nothing that allocates.
+ */
+static int _zygoteExec(void* arg) {
+    const ZygoteExec_t& exec = *(const ZygoteExec_t*)arg;
+    setpgrp();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    for (int fd = 0; fd < ZYGOTE_STD_FDS; fd++) {
+        if (-1 == dup2(exec.fds[fd], fd)) {
+            perror("smash error: dup2 failed");
+            _exit(EXIT_FAILURE);
+        }
+    }
+    if (exec.flags & ZYGOTE_SEARCH_PATH) {
+        _execPath(exec.argv[0], exec.argv, exec.envp);
+        int exec_errno = errno; // perror may clobber it
+        perror("smash error: execvp failed");
+        _exit(exec_errno == ENOENT ? EXIT_NOT_FOUND : EXIT_NOT_EXECUTABLE);
+    }
+    execve(exec.argv[0], exec.argv, exec.envp);
+    perror("execv failed");
+    _exit(EXIT_FAILURE);
+}
+
+[[noreturn]] static void _zygoteMain(int sock) {
+    // ctrl-C/ctrl-Z reach smash's whole process group, which the helper is part of
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    vector<char> buff(ZYGOTE_MAX_MESSAGE);
+    vector<string> env_storage;
+    vector<char*> env_ptrs;
+    char** envp = environ;
+    string curr_cwd;
+    vector<char*> argv;
+    vector<char> stack(ZYGOTE_STACK_SIZE);
+    char control[CMSG_SPACE(sizeof(int) * ZYGOTE_STD_FDS)];
+
+    while (true) {
+        struct iovec iov = {buff.data(), buff.size()};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (len == -1 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            _exit(0); // smash is gone
+        }
+
+        int fds[ZYGOTE_STD_FDS] = {-1, -1, -1};
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        }
+
+        int32_t reply = -EINVAL;
+        ZygoteRequest_t req;
+        if ((size_t)len >= sizeof(req) && fds[ZYGOTE_STD_FDS - 1] != -1 && buff[len - 1] == '\0') {
+            memcpy(&req, buff.data(), sizeof(req));
+            const char* str = buff.data() + sizeof(req);
+            const char* cwd = str;
+            str += strlen(str) + 1;
+            argv.clear();
+            for (uint32_t i = 0; i < req.argc && str < buff.data() + len; i++, str += strlen(str) + 1) {
+                argv.push_back((char*)str);
+            }
+            argv.push_back(nullptr);
+            if (req.flags & ZYGOTE_NEW_ENV) {
+                env_storage.clear();
+                for (uint32_t i = 0; i < req.envc && str < buff.data() + len; i++, str += strlen(str) + 1) {
+                    env_storage.emplace_back(str);
+                }
+                env_ptrs.clear();
+                for (string& entry : env_storage) {
+                    env_ptrs.push_back(&entry[0]);
+                }
+                env_ptrs.push_back(nullptr);
+                envp = env_ptrs.data();
+            }
+
+            // following smash's cwd here keeps the chdir out of every clone
+            if (curr_cwd != cwd && -1 == chdir(cwd)) {
+                reply = -errno;
+            } else if (argv.size() > 1) {
+                curr_cwd = cwd;
+                /*
+                 * CLONE_VM|CLONE_VFORK skips copying the helper's page tables, like posix_spawn, and
+                 * CLONE_PARENT makes the command smash's child instead of ours. The helper is
+                 * suspended until the exec, so the pid is only sent once the command is running.
+                 */
+                ZygoteExec_t exec = {req.flags, argv.data(), envp, fds};
+                int child = clone(_zygoteExec, stack.data() + stack.size(),
+                                  CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD, &exec);
+                reply = (child > 0 ? (int32_t)child : -errno);
+            }
+        }
+        for (int fd : fds) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+        send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+}
+
+///////////////////Zygote process end//////////////////////////
+
+Zygote::~Zygote() {
+    this->stop();
+}
+
+bool Zygote::start() {
+    int sv[2];
+    if (-1 == socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv)) {
+        perror("smash error: socketpair failed");
+        return false;
+    }
+    cout.flush();
+    pid_t child = fork();
+    if (child == -1) {
+        perror("smash error: fork failed");
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (child == 0) {
+        close(sv[0]);
+        _zygoteMain(sv[1]);
+    }
+    close(sv[1]);
+    this->pid = child;
+    this->sock = sv[0];
+    this->owner = getpid();
+    return true;
+}
+
+void Zygote::stop() {
+    if (this->sock == -1 || getpid() != this->owner) {
+        return;
+    }
+    close(this->sock); // the helper exits on end of input
+    this->sock = -1;
+    int status;
+    _waitProcess(this->pid, &status, 0);
+}
+
+bool Zygote::isRunning() const {
+    return this->sock != -1 && getpid() == this->owner;
+}
+
+pid_t Zygote::launch(char* const argv[], bool search_path, const string& cwd, VarTable& vars, int out_fd) {
+    if (!this->isRunning()) {
+        return -1;
+    }
+    ZygoteRequest_t req = {search_path ? ZYGOTE_SEARCH_PATH : 0u, 0, 0};
+    this->request.assign(sizeof(req), '\0');
+    this->request.append(cwd.c_str(), cwd.size() + 1);
+    for (; argv[req.argc] != nullptr; req.argc++) {
+        this->request.append(argv[req.argc], strlen(argv[req.argc]) + 1);
+    }
+    bool new_env = (vars.envGeneration() != this->sent_env_generation);
+    if (new_env) {
+        req.flags |= ZYGOTE_NEW_ENV;
+        for (char** env = vars.envp(); *env != nullptr; env++, req.envc++) {
+            this->request.append(*env, strlen(*env) + 1);
+        }
+    }
+    if (this->request.size() > ZYGOTE_MAX_MESSAGE) {
+        return -1;
+    }
+    memcpy(&this->request[0], &req, sizeof(req));
+
+    int fds[ZYGOTE_STD_FDS] = {STDIN_FD, out_fd, STDERR_FD};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct iovec iov = {&this->request[0], this->request.size()};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // the command shares smash's stdout, so whatever smash printed so far goes first
+    cout.flush();
+    uint64_t start_ns = _monotonicNs();
+    ssize_t sent;
+    do {
+        sent = sendmsg(this->sock, &msg, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    if (sent == -1 && errno != EPIPE && errno != ECONNRESET) {
+        return -1; // e.g. one of the std fds is closed
+    }
+    int32_t reply = 0;
+    ssize_t received = -1;
+    if (sent != -1) {
+        do {
+            received = recv(this->sock, &reply, sizeof(reply), 0);
+        } while (received == -1 && errno == EINTR);
+    }
+    if (received != sizeof(reply)) {
+        this->stop(); // the helper died, launch everything directly from now on
+        return -1;
+    }
+    if (new_env) {
+        this->sent_env_generation = vars.envGeneration();
+    }
+    if (reply < 0) {
+        return -1;
+    }
+    SmashStats::getInstance().record(STAT_FORK, _monotonicNs() - start_ns);
+    return reply;
+}
@@ -0,0 +1,54 @@
+#ifndef SMASH_ZYGOTE_H_
+#define SMASH_ZYGOTE_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unistd.h>
+
+#define ZYGOTE_MAX_MESSAGE (256 * 1024)
+#define ZYGOTE_STACK_SIZE (256 * 1024)
+#define ZYGOTE_STD_FDS (3)
+#define ZYGOTE_SEARCH_PATH (1 << 0) // execvpe argv[0] instead of execve
+#define ZYGOTE_NEW_ENV (1 << 1)     // the request carries a new environment
+
+class VarTable;
+
+typedef struct ZygoteRequest_t {
+    uint32_t flags;
+    uint32_t argc;
+    uint32_t envc;
+    // followed by cwd, argv and env as '\0' terminated strings, stdin/stdout/stderr as SCM_RIGHTS
+} ZygoteRequest_t;
+
+/*
+ * Helper process forked at startup ("smash --zygote") that launches external commands for smash.
+ * Requests (argv, cwd, the environment when it changed, and the three std fds) go over a
+ * SOCK_SEQPACKET socketpair. The helper starts commands with a vfork-style clone that shares its
+ * small address space, so a launch never copies smash's page tables. With CLONE_PARENT the command is a direct child of smash, and the job table
+ * waits, stops and signals it exactly like one smash forked itself.
+ */
+class Zygote {
+    pid_t pid = -1;
+    int sock = -1;
+    pid_t owner = -1; // children forked from smash share the socket but must not use it
+    uint64_t sent_env_generation = 0;
+    std::string request;
+
+    void stop();
+public:
+    Zygote() = default;
+    Zygote(const Zygote&) = delete;
+    void operator=(const Zygote&) = delete;
+    ~Zygote();
+    bool start();
+    bool isRunning() const;
+    /*
+     * Starts argv with smash's stdin/stderr and out_fd as stdout. Returns the pid, or -1 when the
+     * helper cannot do it (gone, request too large, bad cwd), in which case the caller forks itself.
+     */
+    pid_t launch(char* const argv[], bool search_path, const std::string& cwd, VarTable& vars,
+                 int out_fd = STDOUT_FILENO);
+};
+
+#endif //SMASH_ZYGOTE_H_